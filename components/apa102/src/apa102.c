@@ -1,5 +1,6 @@
 #include "esp_log.h"
 #include "apa102.h"
+#include "tracelog.h"
 
 #define TAG "APA102"
 
@@ -92,7 +93,7 @@ void apa102_sendColor24(const apa102_t * apa102,rgb_color *color, uint8_t bright
 
 void apa102_init(const apa102_t *apa102)
 {
-    ESP_LOGI(TAG, "Init clk:%d data:%d", apa102->clockPin, apa102->dataPin);
+    TRACE_LOGI(TAG, "Init clk:%d data:%d", apa102->clockPin, apa102->dataPin);
     gpio_config_t d_gpio_config = {
         .mode = GPIO_MODE_OUTPUT,
         .pin_bit_mask = 1ULL << apa102->dataPin
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+
+// Fill kernels for RGB565 buffers in the byte-swapped order the panel takes
+// (LV_COLOR_16_SWAP). Colors are blended per channel exactly like LVGL's
+// lv_color_mix() with LV_COLOR_MIX_ROUND_OFS 128, so a backend can replace
+// LVGL's loops without changing a single pixel. Strides are in pixels for
+// the destination and in bytes for the mask.
+typedef struct {
+    const char *name;
+    // Every pixel becomes `color`
+    void (*fill)(uint16_t *dst, int32_t dst_stride, int32_t w, int32_t h, uint16_t color);
+    // Every pixel becomes `color` mixed over it with opacity `opa`
+    void (*fill_opa)(uint16_t *dst, int32_t dst_stride, int32_t w, int32_t h, uint16_t color, uint8_t opa);
+    // Each pixel mixes `color` over it with the opacity of its mask byte,
+    // scaled by `opa` unless that is 255
+    void (*fill_mask)(uint16_t *dst, int32_t dst_stride, int32_t w, int32_t h, uint16_t color, uint8_t opa,
+                      const uint8_t *mask, int32_t mask_stride);
+} draw565_kernels_t;
+
+// GCC vector extensions, eight pixels at a time on any target
+extern const draw565_kernels_t draw565_vector;
+
+// lv_color_mix() of one pixel, for the edges the kernels leave over
+static inline uint16_t draw565_mix(uint16_t fg, uint16_t bg, uint8_t a)
+{
+    uint32_t f = (uint16_t)(fg << 8 | fg >> 8);
+    uint32_t b = (uint16_t)(bg << 8 | bg >> 8);
+    uint32_t ia = 255 - a;
+    uint32_t r = ((f >> 11) * a + (b >> 11) * ia + 128) * 0x8081 >> 23;
+    uint32_t g = ((f >> 5 & 63) * a + (b >> 5 & 63) * ia + 128) * 0x8081 >> 23;
+    uint32_t bl = ((f & 31) * a + (b & 31) * ia + 128) * 0x8081 >> 23;
+    uint32_t out = r << 11 | g << 5 | bl;
+    return (uint16_t)(out << 8 | out >> 8);
+}
+
+// The opacity of a mask byte under `opa`, as LVGL computes it
+static inline uint8_t draw565_mask_opa(uint8_t mask, uint8_t opa)
+{
+    return opa == 255 ? mask : mask == 255 ? opa : (uint32_t)mask * opa >> 8;
+}
@@ -0,0 +1,122 @@
+#include <string.h>
+#include "draw565.h"
+
+// Eight pixels, or the eight mask bytes of them: one SSE or NEON register,
+// GCC lowers them to plain integer operations on targets without one.
+#define LANES 8
+typedef uint16_t u16v __attribute__((vector_size(2 * LANES)));
+typedef uint8_t u8v __attribute__((vector_size(LANES)));
+
+// Channel sums stay below 64 * 255 + 128, so they fit 16-bit lanes and the
+// division by 255 needs no widening: (x + 1 + (x >> 8)) >> 8 is exact for
+// x < 65535 and LV_UDIV255 is exact over this range.
+static inline u16v div255(u16v x)
+{
+    return (x + 1 + (x >> 8)) >> 8;
+}
+
+typedef struct {
+    u16v r, g, b;
+} fg_t;
+
+static inline fg_t split(uint16_t color)
+{
+    uint16_t c = color << 8 | color >> 8;
+    fg_t fg;
+    fg.r = (u16v){ 0 } + (c >> 11);
+    fg.g = (u16v){ 0 } + (c >> 5 & 63);
+    fg.b = (u16v){ 0 } + (c & 31);
+    return fg;
+}
+
+static inline u16v mix(const fg_t *fg, u16v bg, u16v a)
+{
+    u16v u = bg << 8 | bg >> 8;
+    u16v ia = 255 - a;
+    u16v r = div255(fg->r * a + (u >> 11) * ia + 128);
+    u16v g = div255(fg->g * a + (u >> 5 & 63) * ia + 128);
+    u16v b = div255(fg->b * a + (u & 31) * ia + 128);
+    u16v out = r << 11 | g << 5 | b;
+    return out << 8 | out >> 8;
+}
+
+static inline u16v load(const uint16_t *p)
+{
+    u16v v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline void store(uint16_t *p, u16v v)
+{
+    memcpy(p, &v, sizeof(v));
+}
+
+static void fill(uint16_t *dst, int32_t dst_stride, int32_t w, int32_t h, uint16_t color)
+{
+    u16v c = (u16v){ 0 } + color;
+    for (int32_t y = 0; y < h; y++, dst += dst_stride) {
+        int32_t x = 0;
+        for (; x + LANES <= w; x += LANES) {
+            store(dst + x, c);
+        }
+        for (; x < w; x++) {
+            dst[x] = color;
+        }
+    }
+}
+
+static void fill_opa(uint16_t *dst, int32_t dst_stride, int32_t w, int32_t h, uint16_t color, uint8_t opa)
+{
+    fg_t fg = split(color);
+    u16v a = (u16v){ 0 } + opa;
+    for (int32_t y = 0; y < h; y++, dst += dst_stride) {
+        int32_t x = 0;
+        for (; x + LANES <= w; x += LANES) {
+            store(dst + x, mix(&fg, load(dst + x), a));
+        }
+        for (; x < w; x++) {
+            dst[x] = draw565_mix(color, dst[x], opa);
+        }
+    }
+}
+
+static void fill_mask(uint16_t *dst, int32_t dst_stride, int32_t w, int32_t h, uint16_t color, uint8_t opa,
+                      const uint8_t *mask, int32_t mask_stride)
+{
+    fg_t fg = split(color);
+    u16v c = (u16v){ 0 } + color;
+    for (int32_t y = 0; y < h; y++, dst += dst_stride, mask += mask_stride) {
+        int32_t x = 0;
+        for (; x + LANES <= w; x += LANES) {
+            uint64_t m64;
+            memcpy(&m64, mask + x, sizeof(m64));
+            // Antialiased edges are narrow, most runs are all out or all in
+            if (m64 == 0) continue;
+            if (opa == 255 && m64 == UINT64_MAX) {
+                store(dst + x, c);
+                continue;
+            }
+            u8v m8;
+            memcpy(&m8, &m64, sizeof(m8));
+            u16v a = __builtin_convertvector(m8, u16v);
+            if (opa != 255) {
+                u16v cover = (u16v)(a == 255);
+                a = (cover & opa) | (~cover & (a * opa >> 8));
+            }
+            store(dst + x, mix(&fg, load(dst + x), a));
+        }
+        for (; x < w; x++) {
+            if (mask[x]) {
+                dst[x] = draw565_mix(color, dst[x], draw565_mask_opa(mask[x], opa));
+            }
+        }
+    }
+}
+
+const draw565_kernels_t draw565_vector = {
+    .name = "vector",
+    .fill = fill,
+    .fill_opa = fill_opa,
+    .fill_mask = fill_mask,
+};
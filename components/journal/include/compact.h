@@ -0,0 +1,24 @@
+#pragma once
+
+// Retention: sessions older than a cutoff are merged into one record per day
+// and activity in a second journal, the archive, and their pages in the
+// session journal are erased.
+//
+// An archive record starts with the first session it covers and lasts as
+// long as all of them together. A day that spans two pages gets a record for
+// each part. Records are appended in start order, so a page that is compacted
+// again after a reset skips what the archive already has.
+
+#include <stdint.h>
+#include "journal.h"
+
+typedef struct {
+    uint32_t pages_erased;
+    uint32_t sessions_merged;
+    uint32_t records_written;   // to the archive
+    uint32_t bytes_reclaimed;   // erased in the journal minus written to the archive
+} compact_stats_t;
+
+// Compact the oldest page of `journal` if it is full and every session in it
+// ended before `before`. ESP_ERR_NOT_FOUND when there is nothing to do.
+esp_err_t compact_oldest_page(journal_t *journal, journal_t *archive, uint32_t before, compact_stats_t *stats);
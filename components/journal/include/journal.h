@@ -0,0 +1,163 @@
+#pragma once
+
+// Append-only journal of finished sessions.
+//
+// The journal is a ring of flash pages. Each page starts with a header
+// holding a sequence number that grows by one for every page opened and the
+// start of its first session, followed by records. Records are only ever
+// appended; when the ring is full the oldest page is erased to make room.
+//
+// Records are varints relative to the session before them (session_codec.h),
+// about half the size of the fixed 12-byte records of the first formats.
+// Pages in those formats are still read, but new sessions always go to a
+// varint page. A varint page only holds start times that never go back, a
+// session starting before the previous one opens a new page.
+//
+// The start time of the first record of every page is kept in RAM as a sparse
+// index, so finding a date takes a binary search over pages and then a scan of
+// the records of one page.
+//
+// Power can fail in the middle of a write. Records end with a CRC, so a torn
+// one is recognised, and the page headers act as sync markers every 4 KB.
+// Opening decodes the newest page up to its last complete record. If a torn
+// record follows, the rest of that page is given up and the next session
+// opens a new page. Recovery costs one header read per page plus the reads of
+// one page, whatever the history.
+//
+// This file and journal.c do not depend on ESP-IDF beyond esp_err.h, so the
+// same code runs in the host tools. Flash access goes through journal_flash_t.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#define JOURNAL_PAGE_SIZE 4096
+#define JOURNAL_PAGE_MAGIC 0x314a5454   // "TTJ1"
+
+// A finished session
+typedef struct {
+    uint32_t start;      // unix time in seconds
+    uint32_t duration;   // seconds
+    uint8_t activity;    // index of the activity
+} session_record_t;
+
+// Page header as stored in flash, little endian
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t base_time;  // start of the first record in the page
+    uint32_t format;     // JOURNAL_FORMAT_VARINT, pages in any other are not read
+} journal_page_header_t;
+
+#define JOURNAL_FORMAT_VARINT 2    // session_codec.h records
+
+#define JOURNAL_HEADER_SIZE sizeof(journal_page_header_t)
+
+// Position of a record: page sequence number times the page size plus the
+// offset in the page. Positions only grow, so they also work as cursors that
+// stay valid while new records are appended.
+typedef uint32_t journal_pos_t;
+
+#define JOURNAL_POS(seq, offset) ((journal_pos_t)(seq) * JOURNAL_PAGE_SIZE + (offset))
+#define JOURNAL_POS_SEQ(pos) ((pos) / JOURNAL_PAGE_SIZE)
+#define JOURNAL_POS_OFFSET(pos) ((pos) % JOURNAL_PAGE_SIZE)
+
+// Storage the journal lives in. Offsets are relative to the start of the
+// area, erase works on whole pages.
+typedef struct {
+    uint32_t size;
+    esp_err_t (*read)(void *ctx, uint32_t offset, void *dst, size_t len);
+    esp_err_t (*write)(void *ctx, uint32_t offset, const void *src, size_t len);
+    esp_err_t (*erase)(void *ctx, uint32_t offset, size_t len);
+    void *ctx;
+    // The whole area mapped into memory, or NULL. Iterators then decode
+    // records where they are instead of copying blocks out with read().
+    // Writes and erases must keep the mapping coherent.
+    const uint8_t *mapped;
+} journal_flash_t;
+
+typedef struct {
+    journal_flash_t flash;
+    uint32_t page_count;
+    uint32_t head_seq;      // page being appended to, 0 if the journal is empty
+    uint32_t head_page;     // its index in the flash area
+    uint32_t head_offset;   // next free byte in that page
+    uint32_t head_start;    // start of its newest session, varint records count from it
+    uint32_t tail_seq;      // oldest page still in flash
+    uint32_t last_end;      // end time of the newest session
+    uint32_t torn;          // torn records found by journal_open()
+    uint32_t *page_time;    // sparse time index: start of the first record of each page
+} journal_t;
+
+// Unmapped flash is read in blocks of this size, most reads serve several
+// records
+#define JOURNAL_READ_BLOCK 64
+
+typedef struct {
+    const journal_t *journal;
+    journal_pos_t pos;
+    uint32_t prev_start;    // start of the session before `pos` in its page
+    // Last block read, unused when the flash is mapped
+    uint32_t block_seq;
+    uint32_t block_offset;
+    uint32_t block_len;
+    uint8_t block[JOURNAL_READ_BLOCK];
+} journal_iter_t;
+
+// Scan the page headers, find where to append after a torn record left by a
+// power cut and build the time index. The index takes 5 bytes of heap per
+// page, journal_close() frees it.
+esp_err_t journal_open(journal_t *journal, const journal_flash_t *flash);
+void journal_close(journal_t *journal);
+
+// Erase everything
+esp_err_t journal_format(journal_t *journal);
+
+esp_err_t journal_append(journal_t *journal, const session_record_t *rec);
+
+// Erase the oldest page before the ring needs it. Never the page being
+// appended to, ESP_ERR_INVALID_STATE if that is the only one.
+esp_err_t journal_drop_oldest(journal_t *journal);
+
+// Position of the oldest record still in the journal and the position the
+// next record will be written at
+journal_pos_t journal_begin(const journal_t *journal);
+journal_pos_t journal_end(const journal_t *journal);
+
+// Position `count` records before `pos`, or the oldest record. Decodes the
+// pages from their start, so going back further than a page costs a read of
+// every page on the way.
+journal_pos_t journal_rewind(const journal_t *journal, journal_pos_t pos, uint32_t count);
+
+// Start of the page the session journal_seek_time() finds is in, from the
+// index alone. Reading from there and skipping the sessions before `time`
+// saves decoding that page twice.
+journal_pos_t journal_seek_page(const journal_t *journal, uint32_t time);
+
+// Position of the first session starting at or after `time`. The page is
+// found from the index alone, then its records are decoded up to `time`,
+// at most JOURNAL_PAGE_SIZE / JOURNAL_READ_BLOCK reads. Assumes start times
+// never go back, which the clock floor at boot ensures unless the time is
+// set backwards by hand.
+journal_pos_t journal_seek_time(const journal_t *journal, uint32_t time);
+
+// Index in the flash area of page `seq`, which must be between tail_seq and
+// head_seq
+uint32_t journal_page_index(const journal_t *journal, uint32_t seq);
+
+// Copy `len` bytes at `offset` of page `seq` as they are in flash, header
+// included. ESP_ERR_NOT_FOUND if the journal does not hold that page.
+esp_err_t journal_read_page(const journal_t *journal, uint32_t seq, uint32_t offset, void *dst, size_t len);
+
+// Iterate from `pos`. Positions older than the oldest page start at the
+// oldest record, positions inside a record at the one after it.
+void journal_iter_init(journal_iter_t *it, const journal_t *journal, journal_pos_t pos);
+
+// Returns false at the end of the journal. `pos` (optional) receives the
+// position of the returned record.
+bool journal_iter_next(journal_iter_t *it, session_record_t *rec, journal_pos_t *pos);
+
+// CRC-32 (IEEE 802.3) for the formats built on the journal. Start with 0 and
+// pass the result back in to continue over more data.
+uint32_t journal_crc32(uint32_t crc, const void *data, size_t len);
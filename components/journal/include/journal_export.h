@@ -0,0 +1,34 @@
+#pragma once
+
+// Text export of the session journal, one line per session.
+//
+// CSV starts with a header line, JSON is one object per line (JSON Lines), so
+// a stream cut off anywhere is still usable up to its last complete line.
+// Every line carries the cursor just after its session: exporting again from
+// that cursor continues with the next session.
+//
+//   cursor,start,duration,activity
+//   8220,1700000000,1500,Work
+//
+//   {"cursor":8220,"start":1700000000,"duration":1500,"activity":"Work"}
+
+#include <stddef.h>
+#include "journal.h"
+
+typedef enum {
+    JOURNAL_EXPORT_CSV,
+    JOURNAL_EXPORT_JSON,
+} journal_export_format_t;
+
+// Longest line the functions below produce, including the terminating zero
+#define JOURNAL_EXPORT_LINE_MAX 128
+
+// Returns false for an unknown format name ("csv" or "json")
+bool journal_export_parse_format(const char *name, journal_export_format_t *format);
+
+// Text before the first session, may be empty. Returns the length written.
+size_t journal_export_header(journal_export_format_t format, char *buf, size_t size);
+
+// Line for the session at `pos`. Names longer than fit are cut.
+size_t journal_export_record(journal_export_format_t format, const session_record_t *rec,
+                             journal_pos_t pos, const char *activity, char *buf, size_t size);
@@ -0,0 +1,35 @@
+#pragma once
+
+// A small record kept next to the journal, such as the rollups. It lives in
+// two flash pages used in turn, so a reset while one is being written leaves
+// the previous copy in the other.
+
+#include "journal.h"
+
+#define JOURNAL_META_MAGIC 0x314d5454   // "TTM1"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;       // grows by one for every save
+    uint32_t len;
+    uint32_t crc;       // journal_crc32 of the data
+} journal_meta_header_t;
+
+#define JOURNAL_META_MAX (JOURNAL_PAGE_SIZE - sizeof(journal_meta_header_t))
+
+typedef struct {
+    journal_flash_t flash;  // at least two pages
+    uint32_t seq;           // newest valid copy, 0 if there is none
+    uint32_t page;          // where it is
+    uint32_t len;
+} journal_meta_t;
+
+// Find the newest copy whose CRC matches
+esp_err_t journal_meta_open(journal_meta_t *meta, const journal_flash_t *flash);
+
+// ESP_ERR_NOT_FOUND if there is no valid copy, ESP_ERR_INVALID_SIZE if it
+// has a different length (an older layout)
+esp_err_t journal_meta_load(journal_meta_t *meta, void *data, size_t len);
+
+// Write over the older copy
+esp_err_t journal_meta_save(journal_meta_t *meta, const void *data, size_t len);
@@ -0,0 +1,10 @@
+#pragma once
+
+#include "journal.h"
+
+// journal_flash_t backed by the data partition called `label`, not mapped
+esp_err_t journal_flash_from_partition(const char *label, journal_flash_t *flash);
+
+// Open the journal in the data partition called `label`, mapped for reading
+// if CONFIG_JOURNAL_MMAP_READS is set
+esp_err_t journal_open_partition(journal_t *journal, const char *label);
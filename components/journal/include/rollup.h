@@ -0,0 +1,35 @@
+#pragma once
+
+// Time per activity for the current day, week and month, kept up to date as
+// sessions finish instead of being summed from the journal.
+//
+// Periods are in UTC. Weeks start on Monday. A session that crosses a period
+// boundary only counts for the part inside the period.
+
+#include <stdint.h>
+#include "journal.h"
+
+#define ROLLUP_MAX_ACTIVITIES 8
+
+typedef enum {
+    ROLLUP_DAY,
+    ROLLUP_WEEK,
+    ROLLUP_MONTH,
+    ROLLUP_PERIOD_COUNT
+} rollup_period_t;
+
+typedef struct {
+    uint32_t start[ROLLUP_PERIOD_COUNT];     // unix time each current period began
+    uint32_t end[ROLLUP_PERIOD_COUNT];
+    uint32_t seconds[ROLLUP_PERIOD_COUNT][ROLLUP_MAX_ACTIVITIES];
+} rollup_t;
+
+// Empty periods around `now`
+void rollup_init(rollup_t *rollup, uint32_t now);
+
+// Move to the periods around `now`, clearing those that ended. Cheap when
+// nothing changed, so it can run from a timer.
+void rollup_advance(rollup_t *rollup, uint32_t now);
+
+// Add the parts of a finished session that fall in the current periods
+void rollup_add(rollup_t *rollup, const session_record_t *rec);
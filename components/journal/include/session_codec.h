@@ -0,0 +1,35 @@
+#pragma once
+
+// Compact encoding of a session, as stored in the journal's varint pages.
+//
+//   header    0xC0 | activity, never 0xFF (erased flash) or 0x00
+//   start     varint, seconds since the start of the previous session, or
+//             since the base time of the page for its first session
+//   duration  varint, seconds
+//   crc       low byte of journal_crc32 of the bytes before it
+//
+// Varints are little endian base 128, seven bits per byte with the top bit
+// set on every byte but the last. A typical session, an hour or two after
+// the previous one and lasting less than four and a half hours, takes six
+// bytes against twelve for the fixed record.
+
+#include <stddef.h>
+#include <stdint.h>
+#include "journal.h"
+
+#define SESSION_CODEC_MAX_SIZE 12       // header, two 5-byte varints, CRC
+#define SESSION_CODEC_MAX_ACTIVITY 62
+#define SESSION_CODEC_HEADER 0xC0
+
+// Bytes a varint of `value` takes
+size_t session_varint_size(uint32_t value);
+
+// Encode `rec`, which must not start before `prev_start` and must have an
+// activity of at most SESSION_CODEC_MAX_ACTIVITY. Returns the length written
+// to `out`, which needs room for SESSION_CODEC_MAX_SIZE bytes.
+size_t session_encode(const session_record_t *rec, uint32_t prev_start, uint8_t *out);
+
+// Decode one session from the `len` bytes at `in`. Returns the length it
+// took, or 0 if `in` does not start with a valid session: erased flash, a
+// record torn by a power cut, or one cut short by `len`.
+size_t session_decode(const uint8_t *in, size_t len, uint32_t prev_start, session_record_t *rec);
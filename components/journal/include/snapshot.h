@@ -0,0 +1,54 @@
+#pragma once
+
+// Everything derived from the journal that the device needs at boot: the
+// total time per activity, the rollups and the session still running.
+//
+// A copy is saved with journal_meta every time a session starts, together
+// with the journal position it covers. Restoring reads that copy and only
+// replays the sessions written after it, so boot does not slow down as the
+// history grows. Without a usable copy it falls back to reading the whole
+// journal once, which rebuilds the rollups on the way.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "journal.h"
+#include "journal_meta.h"
+#include "rollup.h"
+
+// Layout of the saved copy, bump it when snapshot_t changes
+#define SNAPSHOT_VERSION 2
+
+#define SNAPSHOT_NOT_RUNNING 0xFF
+
+typedef struct {
+    uint32_t version;
+    journal_pos_t journal_end;  // sessions before this are counted
+    uint32_t totals_s[ROLLUP_MAX_ACTIVITIES];
+    uint32_t running_start;     // running session, if running_activity is set
+    uint8_t running_activity;   // SNAPSHOT_NOT_RUNNING if none
+    rollup_t rollup;
+} snapshot_t;
+
+// Nothing recorded and nothing running
+void snapshot_init(snapshot_t *snap, uint32_t now);
+
+// Count a session appended to the journal. It ends the running one if it
+// is the same session.
+void snapshot_add(snapshot_t *snap, const session_record_t *rec);
+
+// Latest saved copy plus the sessions written after it, or a replay of the
+// whole journal if there is no usable copy. `replayed` (optional) receives
+// the number of sessions read from the journal.
+void snapshot_restore(snapshot_t *snap, journal_meta_t *meta, const journal_t *journal,
+                      uint32_t now, uint32_t *replayed);
+
+// Take the running session from a checkpoint that outlived a reset (see
+// main/rtc_checkpoint.h), which follows every start and stop while the
+// copy is only saved on starts. A checkpoint of a session that started
+// before `last_end`, the end of the newest session in the journal, can
+// only be older than the journal and is ignored. Returns true if the
+// checkpoint was taken.
+bool snapshot_reconcile(snapshot_t *snap, uint8_t activity, uint32_t start, uint32_t last_end);
+
+// Save a copy covering the journal up to its current end
+esp_err_t snapshot_save(snapshot_t *snap, journal_meta_t *meta, const journal_t *journal);
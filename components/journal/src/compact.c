@@ -0,0 +1,100 @@
+#include <string.h>
+#include "compact.h"
+
+#define DAY 86400
+
+// Activities of one day seen so far, in the order their first session started
+#define MAX_GROUPS 8
+
+typedef struct {
+    journal_t *archive;
+    uint32_t after;             // start of the newest archive record
+    bool has_after;
+    session_record_t groups[MAX_GROUPS];
+    int count;
+    uint32_t day;
+    compact_stats_t *stats;
+} compactor_t;
+
+static esp_err_t flush_groups(compactor_t *c)
+{
+    for (int i = 0; i < c->count; i++) {
+        if (c->has_after && c->groups[i].start <= c->after) continue;
+        esp_err_t err = journal_append(c->archive, &c->groups[i]);
+        if (err != ESP_OK) return err;
+        c->stats->records_written++;
+    }
+    c->count = 0;
+    return ESP_OK;
+}
+
+static esp_err_t add_session(compactor_t *c, const session_record_t *rec)
+{
+    uint32_t day = rec->start / DAY;
+    if (c->count > 0 && day != c->day) {
+        esp_err_t err = flush_groups(c);
+        if (err != ESP_OK) return err;
+    }
+    c->day = day;
+
+    for (int i = 0; i < c->count; i++) {
+        if (c->groups[i].activity == rec->activity) {
+            c->groups[i].duration += rec->duration;
+            return ESP_OK;
+        }
+    }
+    if (c->count == MAX_GROUPS) {
+        esp_err_t err = flush_groups(c);
+        if (err != ESP_OK) return err;
+    }
+    c->groups[c->count++] = *rec;
+    return ESP_OK;
+}
+
+esp_err_t compact_oldest_page(journal_t *journal, journal_t *archive, uint32_t before, compact_stats_t *stats)
+{
+    if (journal->head_seq == 0 || journal->tail_seq == journal->head_seq) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    uint32_t seq = journal->tail_seq;
+    journal_pos_t next_page = JOURNAL_POS(seq + 1, 0);
+
+    // The whole page must be old enough, its last session ends the latest
+    journal_iter_t it;
+    session_record_t rec;
+    journal_pos_t pos;
+    journal_iter_init(&it, journal, journal_rewind(journal, next_page, 1));
+    if (journal_iter_next(&it, &rec, &pos) && pos < next_page && rec.start + rec.duration >= before) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    compactor_t c = {
+        .archive = archive,
+        .stats = stats,
+    };
+    if (archive->head_seq != 0) {
+        journal_iter_init(&it, archive, journal_rewind(archive, journal_end(archive), 1));
+        if (journal_iter_next(&it, &rec, NULL)) {
+            c.has_after = true;
+            c.after = rec.start;
+        }
+    }
+
+    // Archive records vary in size, what they took is how far its end moved
+    journal_pos_t archive_end = archive->head_seq != 0 ? journal_end(archive) : JOURNAL_POS(1, 0);
+    journal_iter_init(&it, journal, JOURNAL_POS(seq, JOURNAL_HEADER_SIZE));
+    while (journal_iter_next(&it, &rec, &pos) && pos < next_page) {
+        esp_err_t err = add_session(&c, &rec);
+        if (err != ESP_OK) return err;
+        stats->sessions_merged++;
+    }
+    esp_err_t err = flush_groups(&c);
+    if (err != ESP_OK) return err;
+
+    err = journal_drop_oldest(journal);
+    if (err != ESP_OK) return err;
+    stats->pages_erased++;
+    uint32_t used = journal_end(archive) - archive_end;
+    stats->bytes_reclaimed += used < JOURNAL_PAGE_SIZE ? JOURNAL_PAGE_SIZE - used : 0;
+    return ESP_OK;
+}
@@ -0,0 +1,442 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "journal.h"
+#include "session_codec.h"
+
+_Static_assert(JOURNAL_HEADER_SIZE == 16, "journal page header must be 16 bytes");
+
+#define ERASED 0xFFFFFFFF
+
+static uint32_t page_addr(uint32_t page)
+{
+    return page * JOURNAL_PAGE_SIZE;
+}
+
+// Index in the flash area of the page with sequence number `seq`
+static uint32_t seq_to_page(const journal_t *j, uint32_t seq)
+{
+    return (j->head_page + j->page_count - (j->head_seq - seq) % j->page_count) % j->page_count;
+}
+
+// Start time of the first record of page `seq`, from the in-memory index
+static uint32_t page_time(const journal_t *j, uint32_t seq)
+{
+    return j->page_time[seq_to_page(j, seq)];
+}
+
+// Point `it` at the first record of page `seq`
+static void iter_page(journal_iter_t *it, uint32_t seq)
+{
+    it->pos = JOURNAL_POS(seq, JOURNAL_HEADER_SIZE);
+    it->prev_start = page_time(it->journal, seq);
+}
+
+// The `len` bytes at `offset` of page `seq`: in place if the flash is
+// mapped, else from the block read last if it holds them, else from a new
+// block starting there. NULL if flash fails.
+static const uint8_t *iter_bytes(journal_iter_t *it, uint32_t seq, uint32_t offset, uint32_t len, bool reload)
+{
+    const journal_t *j = it->journal;
+    if (j->flash.mapped) {
+        return j->flash.mapped + page_addr(seq_to_page(j, seq)) + offset;
+    }
+    if (!reload && it->block_seq == seq && offset >= it->block_offset
+        && offset + len <= it->block_offset + it->block_len) {
+        return it->block + (offset - it->block_offset);
+    }
+
+    uint32_t n = JOURNAL_PAGE_SIZE - offset;
+    if (n > JOURNAL_READ_BLOCK) {
+        n = JOURNAL_READ_BLOCK;
+    }
+    it->block_seq = 0;
+    if (j->flash.read(j->flash.ctx, page_addr(seq_to_page(j, seq)) + offset, it->block, n) != ESP_OK) {
+        return NULL;
+    }
+    it->block_seq = seq;
+    it->block_offset = offset;
+    it->block_len = n;
+    return it->block;
+}
+
+// Decode the record at the iterator's position and move past it. `reload`
+// reads flash again instead of trusting the block, which may predate
+// records appended since. False at the end of the page's records.
+static bool iter_step(journal_iter_t *it, session_record_t *rec, bool reload)
+{
+    uint32_t seq = JOURNAL_POS_SEQ(it->pos);
+    uint32_t offset = JOURNAL_POS_OFFSET(it->pos);
+
+    // Past the end of the page before
+    if (offset < JOURNAL_HEADER_SIZE) return false;
+
+    uint32_t len = JOURNAL_PAGE_SIZE - offset;
+    if (len > SESSION_CODEC_MAX_SIZE) {
+        len = SESSION_CODEC_MAX_SIZE;
+    }
+    const uint8_t *p = iter_bytes(it, seq, offset, len, reload);
+    size_t n = p ? session_decode(p, len, it->prev_start, rec) : 0;
+    if (n == 0) return false;
+    it->pos += n;
+    it->prev_start = rec->start;
+    return true;
+}
+
+// End of the newest valid session before the head page, looking back over
+// cleared records
+static void find_last_end(journal_t *j, journal_pos_t pos)
+{
+    while (pos > journal_begin(j)) {
+        pos = journal_rewind(j, pos, 1);
+        journal_iter_t it;
+        session_record_t rec;
+        journal_iter_init(&it, j, pos);
+        if (journal_iter_next(&it, &rec, NULL)) {
+            j->last_end = rec.start + rec.duration;
+            return;
+        }
+    }
+}
+
+// Decode the newest page up to its last record. Records are written in
+// order, so only the one after it can have been torn by a power cut.
+static esp_err_t recover_head(journal_t *j)
+{
+    journal_iter_t it = { .journal = j };
+    session_record_t rec;
+    bool found = false;
+    iter_page(&it, j->head_seq);
+    while (iter_step(&it, &rec, false)) {
+        j->last_end = rec.start + rec.duration;
+        found = true;
+    }
+    j->head_offset = it.pos - JOURNAL_POS(j->head_seq, 0);
+    j->head_start = it.prev_start;
+
+    // The rest of the page must still be erased. If it is not, give the
+    // rest up, the next session opens a new page.
+    if (j->head_offset < JOURNAL_PAGE_SIZE) {
+        uint32_t len = JOURNAL_PAGE_SIZE - j->head_offset;
+        if (len > SESSION_CODEC_MAX_SIZE) {
+            len = SESSION_CODEC_MAX_SIZE;
+        }
+        const uint8_t *p = iter_bytes(&it, j->head_seq, j->head_offset, len, false);
+        if (p == NULL) return ESP_FAIL;
+        for (uint32_t i = 0; i < len; i++) {
+            if (p[i] != 0xFF) {
+                j->head_offset = JOURNAL_PAGE_SIZE;
+                j->torn++;
+                break;
+            }
+        }
+    }
+
+    if (!found) {
+        find_last_end(j, JOURNAL_POS(j->head_seq, JOURNAL_HEADER_SIZE));
+    }
+    return ESP_OK;
+}
+
+void journal_close(journal_t *j)
+{
+    free(j->page_time);
+    j->page_time = NULL;
+}
+
+esp_err_t journal_open(journal_t *j, const journal_flash_t *flash)
+{
+    memset(j, 0, sizeof(*j));
+    j->flash = *flash;
+    j->page_count = flash->size / JOURNAL_PAGE_SIZE;
+    if (j->page_count < 2) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    j->page_time = calloc(j->page_count, sizeof(uint32_t));
+    if (j->page_time == NULL) {
+        journal_close(j);
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Newest and oldest page by sequence number
+    for (uint32_t page = 0; page < j->page_count; page++) {
+        journal_page_header_t hdr;
+        esp_err_t err = j->flash.read(j->flash.ctx, page_addr(page), &hdr, sizeof(hdr));
+        if (err != ESP_OK) {
+            journal_close(j);
+            return err;
+        }
+        // Pages of the fixed record formats of older firmware are not read
+        if (hdr.magic != JOURNAL_PAGE_MAGIC || hdr.format != JOURNAL_FORMAT_VARINT) continue;
+        j->page_time[page] = hdr.base_time;
+
+        if (j->head_seq == 0 || hdr.seq > j->head_seq) {
+            j->head_seq = hdr.seq;
+            j->head_page = page;
+        }
+        if (j->tail_seq == 0 || hdr.seq < j->tail_seq) {
+            j->tail_seq = hdr.seq;
+        }
+    }
+    if (j->head_seq == 0) {
+        return ESP_OK;
+    }
+    // A page whose erase was cut short can keep an old header. The ring
+    // never holds pages that old.
+    if (j->head_seq - j->tail_seq >= j->page_count) {
+        j->tail_seq = j->head_seq - j->page_count + 1;
+    }
+
+    esp_err_t err = recover_head(j);
+    if (err != ESP_OK) {
+        journal_close(j);
+        return err;
+    }
+    return ESP_OK;
+}
+
+esp_err_t journal_format(journal_t *j)
+{
+    esp_err_t err = j->flash.erase(j->flash.ctx, 0, j->page_count * JOURNAL_PAGE_SIZE);
+    if (err != ESP_OK) return err;
+    j->head_seq = 0;
+    j->head_page = 0;
+    j->head_offset = 0;
+    j->tail_seq = 0;
+    j->head_start = 0;
+    j->last_end = 0;
+    return ESP_OK;
+}
+
+// Start the next page, dropping the oldest one if the ring is full
+static esp_err_t open_page(journal_t *j, uint32_t base_time)
+{
+    uint32_t page = j->head_seq == 0 ? 0 : (j->head_page + 1) % j->page_count;
+    uint32_t seq = j->head_seq + 1;
+
+    esp_err_t err = j->flash.erase(j->flash.ctx, page_addr(page), JOURNAL_PAGE_SIZE);
+    if (err != ESP_OK) return err;
+
+    journal_page_header_t hdr = {
+        .magic = JOURNAL_PAGE_MAGIC,
+        .seq = seq,
+        .base_time = base_time,
+        .format = JOURNAL_FORMAT_VARINT,
+    };
+    // Magic last, so a header torn by a power cut is not taken for a page
+    err = j->flash.write(j->flash.ctx, page_addr(page) + sizeof(hdr.magic), &hdr.seq, sizeof(hdr) - sizeof(hdr.magic));
+    if (err != ESP_OK) return err;
+    err = j->flash.write(j->flash.ctx, page_addr(page), &hdr.magic, sizeof(hdr.magic));
+    if (err != ESP_OK) return err;
+
+    if (j->tail_seq == 0) {
+        j->tail_seq = seq;
+    } else if (seq - j->tail_seq >= j->page_count) {
+        j->tail_seq = seq - j->page_count + 1;
+    }
+    j->head_seq = seq;
+    j->head_page = page;
+    j->head_offset = JOURNAL_HEADER_SIZE;
+    j->head_start = base_time;
+    j->page_time[page] = base_time;
+    return ESP_OK;
+}
+
+esp_err_t journal_append(journal_t *j, const session_record_t *rec)
+{
+    if (rec->start == ERASED || rec->activity > SESSION_CODEC_MAX_ACTIVITY) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Only a page with room takes it, and only if the session does not start
+    // before the one it is encoded against
+    uint8_t buf[SESSION_CODEC_MAX_SIZE];
+    size_t len = 0;
+    if (j->head_seq != 0 && rec->start >= j->head_start) {
+        len = session_encode(rec, j->head_start, buf);
+        if (j->head_offset + len > JOURNAL_PAGE_SIZE) {
+            len = 0;
+        }
+    }
+    if (len == 0) {
+        esp_err_t err = open_page(j, rec->start);
+        if (err != ESP_OK) return err;
+        len = session_encode(rec, j->head_start, buf);
+    }
+
+    esp_err_t err = j->flash.write(j->flash.ctx, page_addr(j->head_page) + j->head_offset, buf, len);
+    if (err != ESP_OK) return err;
+
+    j->head_offset += len;
+    j->head_start = rec->start;
+    j->last_end = rec->start + rec->duration;
+    return ESP_OK;
+}
+
+esp_err_t journal_drop_oldest(journal_t *j)
+{
+    if (j->head_seq == 0 || j->tail_seq == j->head_seq) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_err_t err = j->flash.erase(j->flash.ctx, page_addr(seq_to_page(j, j->tail_seq)), JOURNAL_PAGE_SIZE);
+    if (err != ESP_OK) return err;
+    j->tail_seq++;
+    return ESP_OK;
+}
+
+journal_pos_t journal_begin(const journal_t *j)
+{
+    if (j->head_seq == 0) return 0;
+    return JOURNAL_POS(j->tail_seq, JOURNAL_HEADER_SIZE);
+}
+
+journal_pos_t journal_end(const journal_t *j)
+{
+    if (j->head_seq == 0) return 0;
+    return JOURNAL_POS(j->head_seq, j->head_offset);
+}
+
+journal_pos_t journal_rewind(const journal_t *j, journal_pos_t pos, uint32_t count)
+{
+    if (j->head_seq == 0 || pos <= journal_begin(j)) {
+        return journal_begin(j);
+    }
+    if (pos > journal_end(j)) {
+        pos = journal_end(j);
+    }
+    if (count == 0) {
+        return pos;
+    }
+
+    // Count the records of each page before `pos`, newest page first
+    journal_iter_t it = { .journal = j };
+    session_record_t rec;
+    uint32_t seq = JOURNAL_POS_SEQ(pos - 1);
+    for (;;) {
+        uint32_t n = 0;
+        iter_page(&it, seq);
+        while (it.pos < pos && iter_step(&it, &rec, false)) {
+            n++;
+        }
+        if (n >= count) {
+            iter_page(&it, seq);
+            for (uint32_t i = 0; i < n - count; i++) {
+                iter_step(&it, &rec, false);
+            }
+            return it.pos;
+        }
+        if (seq <= j->tail_seq) {
+            return journal_begin(j);
+        }
+        count -= n;
+        seq--;
+        pos = JOURNAL_POS(seq + 1, 0);
+    }
+}
+
+journal_pos_t journal_seek_page(const journal_t *j, uint32_t time)
+{
+    if (j->head_seq == 0 || page_time(j, j->tail_seq) >= time) {
+        return journal_begin(j);
+    }
+
+    // Newest page starting before `time`, only the index is read
+    uint32_t lo = j->tail_seq;
+    uint32_t hi = j->head_seq;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo + 1) / 2;
+        if (page_time(j, mid) < time) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return JOURNAL_POS(lo, JOURNAL_HEADER_SIZE);
+}
+
+journal_pos_t journal_seek_time(const journal_t *j, uint32_t time)
+{
+    journal_pos_t pos = journal_seek_page(j, time);
+    if (j->head_seq == 0 || page_time(j, j->tail_seq) >= time) {
+        return pos;
+    }
+
+    // First record of that page at or after `time`, or the next page
+    uint32_t seq = JOURNAL_POS_SEQ(pos);
+    journal_iter_t it = { .journal = j };
+    session_record_t rec;
+    journal_pos_t limit = seq == j->head_seq ? journal_end(j) : JOURNAL_POS(seq + 1, 0);
+    iter_page(&it, seq);
+    for (journal_pos_t at = it.pos; at < limit; at = it.pos) {
+        if (!iter_step(&it, &rec, false)) break;
+        if (rec.start >= time) return at;
+    }
+    return seq == j->head_seq ? journal_end(j) : JOURNAL_POS(seq + 1, JOURNAL_HEADER_SIZE);
+}
+
+uint32_t journal_page_index(const journal_t *j, uint32_t seq)
+{
+    return seq_to_page(j, seq);
+}
+
+esp_err_t journal_read_page(const journal_t *j, uint32_t seq, uint32_t offset, void *dst, size_t len)
+{
+    if (j->head_seq == 0 || seq < j->tail_seq || seq > j->head_seq || offset + len > JOURNAL_PAGE_SIZE) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    uint32_t addr = page_addr(seq_to_page(j, seq)) + offset;
+    if (j->flash.mapped) {
+        memcpy(dst, j->flash.mapped + addr, len);
+        return ESP_OK;
+    }
+    return j->flash.read(j->flash.ctx, addr, dst, len);
+}
+
+void journal_iter_init(journal_iter_t *it, const journal_t *j, journal_pos_t pos)
+{
+    it->journal = j;
+    it->block_seq = 0;
+    if (pos < journal_begin(j)) {
+        pos = journal_begin(j);
+    }
+    it->pos = pos;
+    it->prev_start = j->head_start;
+    if (j->head_seq == 0 || pos >= journal_end(j)) return;
+
+    // Varint records only decode from the start of their page
+    session_record_t rec;
+    iter_page(it, JOURNAL_POS_SEQ(pos));
+    while (it->pos < pos && iter_step(it, &rec, false)) {
+    }
+    if (it->pos < pos) {
+        iter_page(it, JOURNAL_POS_SEQ(pos) + 1);
+    }
+}
+
+bool journal_iter_next(journal_iter_t *it, session_record_t *rec, journal_pos_t *pos)
+{
+    const journal_t *j = it->journal;
+
+    while (j->head_seq != 0 && it->pos < journal_end(j)) {
+        uint32_t seq = JOURNAL_POS_SEQ(it->pos);
+        uint32_t offset = JOURNAL_POS_OFFSET(it->pos);
+
+        // The page may have been recycled since the iterator was created
+        if (seq < j->tail_seq) {
+            iter_page(it, j->tail_seq);
+            continue;
+        }
+        if (offset <= JOURNAL_HEADER_SIZE) {
+            iter_page(it, seq);
+        }
+
+        journal_pos_t at = it->pos;
+        if (iter_step(it, rec, false) || iter_step(it, rec, true)) {
+            if (pos) *pos = at;
+            return true;
+        }
+        // Unreadable, never written or torn, carry on with the next page
+        iter_page(it, seq + 1);
+    }
+    return false;
+}
@@ -0,0 +1,55 @@
+#include <stdio.h>
+#include <string.h>
+#include "journal_export.h"
+
+// Activity names longer than this are cut, the line must fit JOURNAL_EXPORT_LINE_MAX
+#define NAME_MAX_LEN 40
+
+bool journal_export_parse_format(const char *name, journal_export_format_t *format)
+{
+    if (strcmp(name, "csv") == 0) {
+        *format = JOURNAL_EXPORT_CSV;
+    } else if (strcmp(name, "json") == 0) {
+        *format = JOURNAL_EXPORT_JSON;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+size_t journal_export_header(journal_export_format_t format, char *buf, size_t size)
+{
+    const char *header = format == JOURNAL_EXPORT_CSV ? "cursor,start,duration,activity\n" : "";
+    int n = snprintf(buf, size, "%s", header);
+    return n < 0 ? 0 : (size_t)n < size ? (size_t)n : size - 1;
+}
+
+// Copy the name, dropping the characters that would need quoting
+static void clean_name(char *dst, const char *src)
+{
+    size_t n = 0;
+    for (; *src && n < NAME_MAX_LEN; src++) {
+        if (*src == '"' || *src == '\\' || *src == ',' || (unsigned char)*src < ' ') continue;
+        dst[n++] = *src;
+    }
+    dst[n] = 0;
+}
+
+size_t journal_export_record(journal_export_format_t format, const session_record_t *rec,
+                             journal_pos_t pos, const char *activity, char *buf, size_t size)
+{
+    char name[NAME_MAX_LEN + 1];
+    clean_name(name, activity);
+    // Records vary in size, but any position inside one resumes after it
+    journal_pos_t cursor = pos + 1;
+
+    int n;
+    if (format == JOURNAL_EXPORT_CSV) {
+        n = snprintf(buf, size, "%u,%u,%u,%s\n", (unsigned)cursor, (unsigned)rec->start,
+                     (unsigned)rec->duration, name);
+    } else {
+        n = snprintf(buf, size, "{\"cursor\":%u,\"start\":%u,\"duration\":%u,\"activity\":\"%s\"}\n",
+                     (unsigned)cursor, (unsigned)rec->start, (unsigned)rec->duration, name);
+    }
+    return n < 0 ? 0 : (size_t)n < size ? (size_t)n : size - 1;
+}
@@ -0,0 +1,80 @@
+#include <string.h>
+#include "journal_meta.h"
+
+static uint32_t page_addr(uint32_t page)
+{
+    return page * JOURNAL_PAGE_SIZE;
+}
+
+// CRC of `len` bytes after the header, read in small pieces
+static esp_err_t data_crc(const journal_meta_t *meta, uint32_t page, uint32_t len, uint32_t *crc)
+{
+    uint8_t buf[64];
+    uint32_t addr = page_addr(page) + sizeof(journal_meta_header_t);
+    *crc = 0;
+    while (len > 0) {
+        uint32_t n = len < sizeof(buf) ? len : sizeof(buf);
+        esp_err_t err = meta->flash.read(meta->flash.ctx, addr, buf, n);
+        if (err != ESP_OK) return err;
+        *crc = journal_crc32(*crc, buf, n);
+        addr += n;
+        len -= n;
+    }
+    return ESP_OK;
+}
+
+esp_err_t journal_meta_open(journal_meta_t *meta, const journal_flash_t *flash)
+{
+    memset(meta, 0, sizeof(*meta));
+    meta->flash = *flash;
+    if (flash->size < 2 * JOURNAL_PAGE_SIZE) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    for (uint32_t page = 0; page < 2; page++) {
+        journal_meta_header_t hdr;
+        uint32_t crc;
+        esp_err_t err = meta->flash.read(meta->flash.ctx, page_addr(page), &hdr, sizeof(hdr));
+        if (err != ESP_OK) return err;
+        if (hdr.magic != JOURNAL_META_MAGIC || hdr.len > JOURNAL_META_MAX || hdr.seq <= meta->seq) continue;
+        if (data_crc(meta, page, hdr.len, &crc) != ESP_OK || crc != hdr.crc) continue;
+
+        meta->seq = hdr.seq;
+        meta->page = page;
+        meta->len = hdr.len;
+    }
+    return ESP_OK;
+}
+
+esp_err_t journal_meta_load(journal_meta_t *meta, void *data, size_t len)
+{
+    if (meta->seq == 0) return ESP_ERR_NOT_FOUND;
+    if (meta->len != len) return ESP_ERR_INVALID_SIZE;
+    return meta->flash.read(meta->flash.ctx, page_addr(meta->page) + sizeof(journal_meta_header_t), data, len);
+}
+
+esp_err_t journal_meta_save(journal_meta_t *meta, const void *data, size_t len)
+{
+    if (len > JOURNAL_META_MAX) return ESP_ERR_INVALID_SIZE;
+
+    uint32_t page = meta->seq == 0 ? 0 : 1 - meta->page;
+    esp_err_t err = meta->flash.erase(meta->flash.ctx, page_addr(page), JOURNAL_PAGE_SIZE);
+    if (err != ESP_OK) return err;
+
+    // Data first, the header makes the copy valid
+    err = meta->flash.write(meta->flash.ctx, page_addr(page) + sizeof(journal_meta_header_t), data, len);
+    if (err != ESP_OK) return err;
+    journal_meta_header_t hdr = {
+        .magic = JOURNAL_META_MAGIC,
+        .seq = meta->seq + 1,
+        .len = len,
+        .crc = journal_crc32(0, data, len),
+    };
+    err = meta->flash.write(meta->flash.ctx, page_addr(page), &hdr, sizeof(hdr));
+    if (err != ESP_OK) return err;
+
+    meta->seq = hdr.seq;
+    meta->page = page;
+    meta->len = len;
+    return ESP_OK;
+}
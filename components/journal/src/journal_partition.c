@@ -0,0 +1,86 @@
+#include "sdkconfig.h"
+#include "esp_partition.h"
+#include "esp_log.h"
+#include "journal_partition.h"
+
+#define TAG "journal"
+
+#ifdef CONFIG_JOURNAL_MMAP_READS
+// Mappings are never undone, so reopening a partition (bench journal does)
+// reuses its mapping instead of taking more MMU pages
+#define MAX_MAPPINGS 4
+
+static struct {
+    const esp_partition_t *part;
+    const void *ptr;
+} mappings[MAX_MAPPINGS];
+
+static const uint8_t *map_partition(const esp_partition_t *part)
+{
+    int i = 0;
+    for (; i < MAX_MAPPINGS && mappings[i].part; i++) {
+        if (mappings[i].part == part) return mappings[i].ptr;
+    }
+    if (i == MAX_MAPPINGS) return NULL;
+
+    const void *ptr;
+    esp_partition_mmap_handle_t handle;
+    esp_err_t err = esp_partition_mmap(part, 0, part->size, ESP_PARTITION_MMAP_DATA, &ptr, &handle);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "%s: cannot map (%s), reading through copies", part->label, esp_err_to_name(err));
+        return NULL;
+    }
+    mappings[i].part = part;
+    mappings[i].ptr = ptr;
+    return ptr;
+}
+#endif
+
+static esp_err_t part_read(void *ctx, uint32_t offset, void *dst, size_t len)
+{
+    return esp_partition_read((const esp_partition_t *)ctx, offset, dst, len);
+}
+
+static esp_err_t part_write(void *ctx, uint32_t offset, const void *src, size_t len)
+{
+    return esp_partition_write((const esp_partition_t *)ctx, offset, src, len);
+}
+
+static esp_err_t part_erase(void *ctx, uint32_t offset, size_t len)
+{
+    return esp_partition_erase_range((const esp_partition_t *)ctx, offset, len);
+}
+
+esp_err_t journal_flash_from_partition(const char *label, journal_flash_t *flash)
+{
+    const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+    if (part == NULL) {
+        ESP_LOGE(TAG, "No partition labelled %s", label);
+        return ESP_ERR_NOT_FOUND;
+    }
+    flash->size = part->size;
+    flash->read = part_read;
+    flash->write = part_write;
+    flash->erase = part_erase;
+    flash->ctx = (void *)part;
+    flash->mapped = NULL;
+    return ESP_OK;
+}
+
+esp_err_t journal_open_partition(journal_t *journal, const char *label)
+{
+    journal_flash_t flash;
+    esp_err_t err = journal_flash_from_partition(label, &flash);
+    if (err != ESP_OK) return err;
+#ifdef CONFIG_JOURNAL_MMAP_READS
+    // The flash driver invalidates the cache over what it writes or erases
+    flash.mapped = map_partition(flash.ctx);
+#endif
+
+    err = journal_open(journal, &flash);
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "%s: %u pages, head %u@%u, tail %u%s", label, journal->page_count,
+                 journal->head_seq, journal->head_offset, journal->tail_seq, flash.mapped ? ", mapped" : "");
+    }
+    return err;
+}
@@ -0,0 +1,84 @@
+#include <string.h>
+#include "rollup.h"
+
+#define DAY 86400
+
+// Days since 1970-01-01 of a civil date, and back (proleptic Gregorian)
+static int32_t days_from_civil(int32_t y, uint32_t m, uint32_t d)
+{
+    y -= m <= 2;
+    int32_t era = (y >= 0 ? y : y - 399) / 400;
+    uint32_t yoe = y - era * 400;
+    uint32_t doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + (int32_t)doe - 719468;
+}
+
+static void civil_from_days(int32_t z, int32_t *y, uint32_t *m)
+{
+    z += 719468;
+    int32_t era = (z >= 0 ? z : z - 146096) / 146097;
+    uint32_t doe = z - era * 146097;
+    uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    uint32_t mp = (5 * doy + 2) / 153;
+    *m = mp < 10 ? mp + 3 : mp - 9;
+    *y = (int32_t)yoe + era * 400 + (*m <= 2);
+}
+
+// Unsigned all the way, times stay valid past 2038
+static void period_bounds(rollup_period_t period, uint32_t now, uint32_t *start, uint32_t *end)
+{
+    uint32_t day = now / DAY;
+    switch (period) {
+    case ROLLUP_DAY:
+        *start = day * DAY;
+        *end = *start + DAY;
+        break;
+    case ROLLUP_WEEK:
+        // 1970-01-01 was a Thursday
+        *start = (day - (day + 3) % 7) * DAY;
+        *end = *start + 7 * DAY;
+        break;
+    default: {
+        int32_t y;
+        uint32_t m;
+        civil_from_days(day, &y, &m);
+        *start = (uint32_t)days_from_civil(y, m, 1) * DAY;
+        *end = (uint32_t)(m == 12 ? days_from_civil(y + 1, 1, 1) : days_from_civil(y, m + 1, 1)) * DAY;
+        break;
+    }
+    }
+}
+
+void rollup_init(rollup_t *r, uint32_t now)
+{
+    memset(r, 0, sizeof(*r));
+    for (int p = 0; p < ROLLUP_PERIOD_COUNT; p++) {
+        period_bounds(p, now, &r->start[p], &r->end[p]);
+    }
+}
+
+void rollup_advance(rollup_t *r, uint32_t now)
+{
+    for (int p = 0; p < ROLLUP_PERIOD_COUNT; p++) {
+        if (now >= r->start[p] && now < r->end[p]) continue;
+        period_bounds(p, now, &r->start[p], &r->end[p]);
+        memset(r->seconds[p], 0, sizeof(r->seconds[p]));
+    }
+}
+
+void rollup_add(rollup_t *r, const session_record_t *rec)
+{
+    if (rec->activity >= ROLLUP_MAX_ACTIVITIES) return;
+
+    uint32_t start = rec->start;
+    uint32_t end = rec->start + rec->duration;
+    for (int p = 0; p < ROLLUP_PERIOD_COUNT; p++) {
+        uint32_t from = start > r->start[p] ? start : r->start[p];
+        uint32_t to = end < r->end[p] ? end : r->end[p];
+        if (to > from) {
+            r->seconds[p][rec->activity] += to - from;
+        }
+    }
+}
@@ -0,0 +1,108 @@
+#include <string.h>
+#include "session_codec.h"
+
+size_t session_varint_size(uint32_t value)
+{
+    size_t n = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        n++;
+    }
+    return n;
+}
+
+static size_t put_varint(uint8_t *out, uint32_t value)
+{
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = (uint8_t)value | 0x80;
+        value >>= 7;
+    }
+    out[n++] = (uint8_t)value;
+    return n;
+}
+
+// Returns the length, 0 if the varint runs past `len` or over 32 bits
+static size_t get_varint(const uint8_t *in, size_t len, uint32_t *value)
+{
+    uint32_t v = 0;
+    for (size_t n = 0; n < len && n < 5; n++) {
+        v |= (uint32_t)(in[n] & 0x7F) << (7 * n);
+        if (!(in[n] & 0x80)) {
+            // The fifth byte only has four bits left
+            if (n == 4 && in[n] > 0x0F) return 0;
+            *value = v;
+            return n + 1;
+        }
+    }
+    return 0;
+}
+
+size_t session_encode(const session_record_t *rec, uint32_t prev_start, uint8_t *out)
+{
+    size_t n = 0;
+    out[n++] = SESSION_CODEC_HEADER | rec->activity;
+    n += put_varint(out + n, rec->start - prev_start);
+    n += put_varint(out + n, rec->duration);
+    out[n] = (uint8_t)journal_crc32(0, out, n);
+    return n + 1;
+}
+
+#ifdef SESSION_CODEC_WORD_DECODE
+
+// The low seven bits of each of the bytes of `word`, packed
+static uint32_t varint_bits(uint64_t word)
+{
+    return (word & 0x7F) | (word >> 1 & 0x3F80) | (word >> 2 & 0x1FC000) | (word >> 3 & 0xFE00000);
+}
+
+// Host builds: sessions whose varints end within the first eight bytes, most
+// of them, are taken apart from one 64-bit load without a loop per byte.
+// Needs a little endian CPU that loads from any address. Returns 0 for the
+// others, which then go through the bytewise decoder.
+static size_t decode_word(const uint8_t *in, uint32_t prev_start, session_record_t *rec)
+{
+    uint64_t word;
+    memcpy(&word, in, sizeof(word));
+    // Last byte of each varint, the ones with the top bit clear
+    uint64_t last = ~word & 0x8080808080808000ull;
+    uint64_t last2 = last & (last - 1);
+    if (last2 == 0) return 0;
+    unsigned end1 = __builtin_ctzll(last) / 8;
+    unsigned end2 = __builtin_ctzll(last2) / 8;
+    if (end1 > 4 || end2 - end1 > 4) return 0;
+
+    if (in[end2 + 1] != (uint8_t)journal_crc32(0, in, end2 + 1)) return 0;
+    rec->start = prev_start + varint_bits(word >> 8 & ((1ull << (8 * end1)) - 1));
+    rec->duration = varint_bits(word >> (8 * (end1 + 1)) & ((1ull << (8 * (end2 - end1))) - 1));
+    rec->activity = in[0] & ~SESSION_CODEC_HEADER;
+    return end2 + 2;
+}
+
+#endif
+
+size_t session_decode(const uint8_t *in, size_t len, uint32_t prev_start, session_record_t *rec)
+{
+    if (len < 4 || in[0] < SESSION_CODEC_HEADER || in[0] == 0xFF) return 0;
+#ifdef SESSION_CODEC_WORD_DECODE
+    if (len >= 9) {
+        size_t n = decode_word(in, prev_start, rec);
+        if (n) return n;
+    }
+#endif
+
+    uint32_t delta, duration;
+    size_t n = 1;
+    size_t k = get_varint(in + n, len - n, &delta);
+    if (k == 0) return 0;
+    n += k;
+    k = get_varint(in + n, len - n, &duration);
+    if (k == 0 || n + k >= len) return 0;
+    n += k;
+    if (in[n] != (uint8_t)journal_crc32(0, in, n)) return 0;
+
+    rec->start = prev_start + delta;
+    rec->duration = duration;
+    rec->activity = in[0] & ~SESSION_CODEC_HEADER;
+    return n + 1;
+}
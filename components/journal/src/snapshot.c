@@ -0,0 +1,64 @@
+#include <string.h>
+#include "snapshot.h"
+
+void snapshot_init(snapshot_t *snap, uint32_t now)
+{
+    memset(snap, 0, sizeof(*snap));
+    snap->version = SNAPSHOT_VERSION;
+    snap->running_activity = SNAPSHOT_NOT_RUNNING;
+    rollup_init(&snap->rollup, now);
+}
+
+void snapshot_add(snapshot_t *snap, const session_record_t *rec)
+{
+    if (rec->activity < ROLLUP_MAX_ACTIVITIES) {
+        snap->totals_s[rec->activity] += rec->duration;
+    }
+    rollup_add(&snap->rollup, rec);
+    if (rec->activity == snap->running_activity && rec->start == snap->running_start) {
+        snap->running_activity = SNAPSHOT_NOT_RUNNING;
+    }
+}
+
+void snapshot_restore(snapshot_t *snap, journal_meta_t *meta, const journal_t *journal,
+                      uint32_t now, uint32_t *replayed)
+{
+    journal_pos_t from = journal_begin(journal);
+    if (journal_meta_load(meta, snap, sizeof(*snap)) == ESP_OK && snap->version == SNAPSHOT_VERSION
+        && snap->journal_end <= journal_end(journal)) {
+        // Sessions between the copy and the oldest page were lost to the
+        // ring wrapping, they are already in the totals
+        if (snap->journal_end > from) from = snap->journal_end;
+    } else {
+        snapshot_init(snap, now);
+    }
+
+    journal_iter_t it;
+    session_record_t rec;
+    uint32_t n = 0;
+    journal_iter_init(&it, journal, from);
+    while (journal_iter_next(&it, &rec, NULL)) {
+        snapshot_add(snap, &rec);
+        n++;
+    }
+    snap->journal_end = journal_end(journal);
+    rollup_advance(&snap->rollup, now);
+    if (replayed) *replayed = n;
+}
+
+bool snapshot_reconcile(snapshot_t *snap, uint8_t activity, uint32_t start, uint32_t last_end)
+{
+    if (activity != SNAPSHOT_NOT_RUNNING && (activity >= ROLLUP_MAX_ACTIVITIES || start < last_end)) {
+        return false;
+    }
+    snap->running_activity = activity;
+    snap->running_start = start;
+    return true;
+}
+
+esp_err_t snapshot_save(snapshot_t *snap, journal_meta_t *meta, const journal_t *journal)
+{
+    snap->version = SNAPSHOT_VERSION;
+    snap->journal_end = journal_end(journal);
+    return journal_meta_save(meta, snap, sizeof(*snap));
+}
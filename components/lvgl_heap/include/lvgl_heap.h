@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// LVGL's heap (CONFIG_LV_MEM_CUSTOM) in two pools: a small one in internal
+// RAM for what is touched every frame, and a large one in PSRAM for the
+// widgets and text. Allocations made while LVGL renders, and small ones at
+// any time, go to the internal pool; the rest to PSRAM. A full pool spills
+// into the other. Both are TLSF heaps of their own (multi_heap), so LVGL
+// neither fragments nor is fragmented by the system heap.
+//
+// Included by LVGL itself, so this header does not include lvgl.h.
+void *lvgl_heap_alloc(size_t size);
+void lvgl_heap_free(void *ptr);
+void *lvgl_heap_realloc(void *ptr, size_t size);
+
+// Display driver hooks: render_start_cb and monitor_cb
+void lvgl_heap_render_start(void);
+void lvgl_heap_render_end(void);
+
+typedef enum {
+    LVGL_HEAP_INTERNAL,
+    LVGL_HEAP_PSRAM,
+    LVGL_HEAP_POOLS
+} lvgl_heap_pool_t;
+
+typedef struct {
+    uint32_t size;          // 0 when the pool could not be set up
+    uint32_t used;
+    uint32_t max_used;      // high-water mark since boot
+    uint32_t largest_free;
+    uint32_t frag_pct;      // free space outside the largest free block
+    uint32_t blocks;        // allocated now
+    uint32_t allocs;        // since boot
+    uint32_t spilled;       // meant for this pool, placed in the other as it was full
+    uint32_t failed;        // fit in neither
+} lvgl_heap_stats_t;
+
+void lvgl_heap_stats_get(lvgl_heap_pool_t pool, lvgl_heap_stats_t *stats);
@@ -0,0 +1,154 @@
+#include <stdbool.h>
+#include <string.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "multi_heap.h"
+#include "lvgl_heap.h"
+
+#define TAG "lvgl_heap"
+
+typedef struct {
+    multi_heap_handle_t heap;
+    uintptr_t start, end;
+    uint32_t size;
+    uint32_t allocs;
+    uint32_t spilled;
+    uint32_t failed;
+    // LVGL only allocates from the UI task, the lock is for the statistics,
+    // which walk the pool from other tasks
+    portMUX_TYPE lock;
+} pool_t;
+
+static pool_t pools[LVGL_HEAP_POOLS] = {
+    [LVGL_HEAP_INTERNAL] = { .lock = portMUX_INITIALIZER_UNLOCKED },
+    [LVGL_HEAP_PSRAM] = { .lock = portMUX_INITIALIZER_UNLOCKED },
+};
+static uint8_t internal_mem[CONFIG_LVGL_HEAP_INTERNAL_KB * 1024] __attribute__((aligned(16)));
+static bool ready;
+static bool rendering;
+
+static void pool_init(pool_t *pool, void *mem, size_t size)
+{
+    pool->heap = multi_heap_register(mem, size);
+    if (pool->heap == NULL) return;
+    multi_heap_set_lock(pool->heap, &pool->lock);
+    pool->start = (uintptr_t)mem;
+    pool->end = (uintptr_t)mem + size;
+    pool->size = multi_heap_free_size(pool->heap);
+}
+
+// On LVGL's first allocation, from lv_init()
+static void init(void)
+{
+    ready = true;
+    pool_init(&pools[LVGL_HEAP_INTERNAL], internal_mem, sizeof(internal_mem));
+    size_t psram_size = CONFIG_LVGL_HEAP_PSRAM_KB * 1024;
+    void *psram = heap_caps_malloc(psram_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (psram == NULL) {
+        ESP_LOGE(TAG, "No PSRAM for the LVGL heap, only the internal pool is used");
+        return;
+    }
+    pool_init(&pools[LVGL_HEAP_PSRAM], psram, psram_size);
+}
+
+static lvgl_heap_pool_t pool_for(size_t size)
+{
+    return rendering || size <= CONFIG_LVGL_HEAP_HOT_MAX ? LVGL_HEAP_INTERNAL : LVGL_HEAP_PSRAM;
+}
+
+static pool_t *pool_of(void *ptr)
+{
+    for (int i = 0; i < LVGL_HEAP_POOLS; i++) {
+        if ((uintptr_t)ptr >= pools[i].start && (uintptr_t)ptr < pools[i].end) {
+            return &pools[i];
+        }
+    }
+    return NULL;
+}
+
+static void *pool_alloc(pool_t *pool, size_t size)
+{
+    if (pool->heap == NULL) return NULL;
+    void *ptr = multi_heap_malloc(pool->heap, size);
+    if (ptr != NULL) pool->allocs++;
+    return ptr;
+}
+
+static void *alloc_from(lvgl_heap_pool_t first, size_t size)
+{
+    void *ptr = pool_alloc(&pools[first], size);
+    if (ptr != NULL) return ptr;
+    ptr = pool_alloc(&pools[!first], size);
+    if (ptr != NULL) {
+        pools[first].spilled++;
+    } else {
+        pools[first].failed++;
+    }
+    return ptr;
+}
+
+void *lvgl_heap_alloc(size_t size)
+{
+    if (!ready) init();
+    return alloc_from(pool_for(size), size);
+}
+
+void lvgl_heap_free(void *ptr)
+{
+    pool_t *pool = pool_of(ptr);
+    if (pool != NULL) {
+        multi_heap_free(pool->heap, ptr);
+    }
+}
+
+void *lvgl_heap_realloc(void *ptr, size_t size)
+{
+    pool_t *pool = pool_of(ptr);
+    if (pool == NULL) return lvgl_heap_alloc(size);
+
+    // Grows in place when it stays in its pool, moves when it changes pool
+    // (a string grown past the internal size) or its pool is full
+    lvgl_heap_pool_t want = pool_for(size);
+    if (pool == &pools[want]) {
+        void *grown = multi_heap_realloc(pool->heap, ptr, size);
+        if (grown != NULL) return grown;
+    }
+    void *moved = alloc_from(want, size);
+    if (moved != NULL) {
+        size_t old = multi_heap_get_allocated_size(pool->heap, ptr);
+        memcpy(moved, ptr, old < size ? old : size);
+        multi_heap_free(pool->heap, ptr);
+    }
+    return moved;
+}
+
+void lvgl_heap_render_start(void)
+{
+    rendering = true;
+}
+
+void lvgl_heap_render_end(void)
+{
+    rendering = false;
+}
+
+void lvgl_heap_stats_get(lvgl_heap_pool_t which, lvgl_heap_stats_t *out)
+{
+    pool_t *pool = &pools[which];
+    memset(out, 0, sizeof(*out));
+    if (pool->heap == NULL) return;
+
+    multi_heap_info_t info;
+    multi_heap_get_info(pool->heap, &info);
+    out->size = pool->size;
+    out->used = pool->size - info.total_free_bytes;
+    out->max_used = pool->size - info.minimum_free_bytes;
+    out->largest_free = info.largest_free_block;
+    out->frag_pct = info.total_free_bytes ? 100 - info.largest_free_block * 100 / info.total_free_bytes : 0;
+    out->blocks = info.allocated_blocks;
+    out->allocs = pool->allocs;
+    out->spilled = pool->spilled;
+    out->failed = pool->failed;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+
+// Where an input event came from. Each source has its own latency histogram.
+typedef enum {
+    PERF_INPUT_KNOB,
+    PERF_INPUT_BUTTON,
+    PERF_INPUT_SOURCE_MAX
+} perf_input_source_t;
+
+// Summary of the input-to-photon latency of one input source, in microseconds.
+// The stage averages split the total into: detection until the UI handled the
+// event, handled until LVGL started flushing the frame, and flush start until
+// the last area of that frame was on the panel.
+typedef struct {
+    uint32_t count;
+    uint32_t merged;           // events shown by the same frame as an older one
+    uint32_t min_us;
+    uint32_t max_us;
+    uint32_t p50_us;
+    uint32_t p90_us;
+    uint32_t p99_us;
+    uint32_t avg_dispatch_us;
+    uint32_t avg_render_us;
+    uint32_t avg_flush_us;
+} perf_latency_stats_t;
+
+// Running totals since boot. Readers keep their previous copy and take the
+// difference to get rates over their own interval.
+typedef struct {
+    uint32_t frames;
+    uint64_t render_us;        // render_start_cb until monitor_cb
+    uint64_t flush_us;         // first area handed to the panel until the last one is out
+    uint32_t render_max_us;
+    uint32_t flush_max_us;
+} perf_frame_counters_t;
+
+// Idle time of each core and total elapsed time, from the FreeRTOS run-time
+// stats. Two samples give the CPU load over the time between them.
+typedef struct {
+    uint32_t total;
+    uint32_t idle[portNUM_PROCESSORS];
+} perf_cpu_sample_t;
+
+// Starts the periodic latency report if CONFIG_PERF_LATENCY_REPORT_PERIOD_S is set
+void perf_init(void);
+
+// Display driver hooks: render_start_cb, flush_cb (with lv_disp_flush_is_last()
+// of the area), the flush-complete ISR and monitor_cb.
+void perf_frame_render_start(void);
+void perf_frame_flush(bool last);
+void perf_frame_flush_ready(void);
+void perf_frame_rendered(void);
+
+void perf_frame_counters_get(perf_frame_counters_t *counters);
+
+// Longest frame since the previous call, from render start until its last
+// area was on the panel, in microseconds
+uint32_t perf_frame_max_take(void);
+
+// Called by the UI with the number of input events waiting each time it
+// drains its queue
+void perf_input_queue_sample(uint32_t depth);
+void perf_input_queue_get(uint32_t *depth, uint32_t *max_depth);
+
+// Called by the UI loop on every pass. The longest time between two passes
+// is how long something else kept the UI from running.
+void perf_ui_loop_tick(void);
+
+// Longest time between two passes since the previous call, in microseconds
+uint32_t perf_ui_loop_max_gap_take(void);
+
+// Returns false if the run-time stats are not enabled
+bool perf_cpu_sample(perf_cpu_sample_t *sample);
+
+// Load of `core` in percent between two samples
+uint32_t perf_cpu_load(const perf_cpu_sample_t *prev, const perf_cpu_sample_t *cur, int core);
+
+#ifdef CONFIG_PERF_INPUT_LATENCY
+
+// Called by the UI once it has applied an input event stamped with
+// esp_timer_get_time() at detection, and only if that changed something on
+// screen. The next frame LVGL starts flushing will carry the stamp. A
+// multi-click is stamped at its first press, so the wait for the others
+// counts.
+void perf_input_handled(perf_input_source_t src, int64_t stamp_us);
+
+void perf_latency_get(perf_input_source_t src, perf_latency_stats_t *stats);
+void perf_latency_reset(void);
+
+// Log the percentiles of every input source
+void perf_latency_report(void);
+
+#else
+
+static inline void perf_input_handled(perf_input_source_t src, int64_t stamp_us) {}
+static inline void perf_latency_get(perf_input_source_t src, perf_latency_stats_t *stats) { *stats = (perf_latency_stats_t){0}; }
+static inline void perf_latency_reset(void) {}
+static inline void perf_latency_report(void) {}
+
+#endif
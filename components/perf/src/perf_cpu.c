@@ -0,0 +1,43 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "perf.h"
+
+// Enough for the tasks this application runs, samples are skipped otherwise
+#define MAX_TASKS 32
+
+bool perf_cpu_sample(perf_cpu_sample_t *sample)
+{
+#if defined(CONFIG_FREERTOS_USE_TRACE_FACILITY) && defined(CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS)
+    static TaskStatus_t tasks[MAX_TASKS];
+    TaskHandle_t idle[portNUM_PROCESSORS];
+    uint32_t total = 0;
+
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        idle[core] = xTaskGetIdleTaskHandleForCPU(core);
+        sample->idle[core] = 0;
+    }
+    if (uxTaskGetNumberOfTasks() > MAX_TASKS) return false;
+
+    UBaseType_t n = uxTaskGetSystemState(tasks, MAX_TASKS, &total);
+    if (n == 0) return false;
+    for (UBaseType_t i = 0; i < n; i++) {
+        for (int core = 0; core < portNUM_PROCESSORS; core++) {
+            if (tasks[i].xHandle == idle[core]) {
+                sample->idle[core] = tasks[i].ulRunTimeCounter;
+            }
+        }
+    }
+    sample->total = total;
+    return true;
+#else
+    return false;
+#endif
+}
+
+uint32_t perf_cpu_load(const perf_cpu_sample_t *prev, const perf_cpu_sample_t *cur, int core)
+{
+    uint32_t elapsed = cur->total - prev->total;
+    uint32_t idle = cur->idle[core] - prev->idle[core];
+    if (elapsed == 0 || idle >= elapsed) return 0;
+    return 100 - (uint64_t)idle * 100 / elapsed;
+}
@@ -0,0 +1,144 @@
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "perf.h"
+#include "perf_priv.h"
+
+#define TAG "perf"
+
+static perf_frame_counters_t counters;
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Frame in progress, only touched by the task running LVGL
+static int64_t render_start_us;
+static bool frame_open;
+
+// Set when the last area of a frame is handed to the panel, cleared by the ISR
+static volatile bool last_area_flushing;
+static int64_t flush_start_us;
+
+static uint32_t input_queue_depth;
+static uint32_t input_queue_max_depth;
+
+static uint32_t frame_max_us;
+
+static int64_t ui_loop_last_us;
+static uint32_t ui_loop_max_gap_us;
+
+void perf_frame_render_start(void)
+{
+    render_start_us = esp_timer_get_time();
+}
+
+void perf_frame_flush(bool last)
+{
+    if (!frame_open) {
+        frame_open = true;
+        flush_start_us = esp_timer_get_time();
+#ifdef CONFIG_PERF_INPUT_LATENCY
+        perf_latency_frame_begin(flush_start_us);
+#endif
+    }
+    if (last) {
+        frame_open = false;
+        last_area_flushing = true;
+    }
+}
+
+void perf_frame_flush_ready(void)
+{
+    if (!last_area_flushing) return;
+    last_area_flushing = false;
+
+    int64_t now = esp_timer_get_time();
+    uint32_t flush_us = now - flush_start_us;
+    uint32_t frame_us = now - render_start_us;
+    portENTER_CRITICAL_ISR(&lock);
+    counters.flush_us += flush_us;
+    if (flush_us > counters.flush_max_us) counters.flush_max_us = flush_us;
+    if (frame_us > frame_max_us) frame_max_us = frame_us;
+    portEXIT_CRITICAL_ISR(&lock);
+
+#ifdef CONFIG_PERF_INPUT_LATENCY
+    perf_latency_frame_done(now);
+#endif
+}
+
+void perf_frame_rendered(void)
+{
+    uint32_t render_us = esp_timer_get_time() - render_start_us;
+    portENTER_CRITICAL(&lock);
+    counters.frames++;
+    counters.render_us += render_us;
+    if (render_us > counters.render_max_us) counters.render_max_us = render_us;
+    portEXIT_CRITICAL(&lock);
+}
+
+void perf_frame_counters_get(perf_frame_counters_t *out)
+{
+    portENTER_CRITICAL(&lock);
+    *out = counters;
+    portEXIT_CRITICAL(&lock);
+}
+
+uint32_t perf_frame_max_take(void)
+{
+    portENTER_CRITICAL(&lock);
+    uint32_t us = frame_max_us;
+    frame_max_us = 0;
+    portEXIT_CRITICAL(&lock);
+    return us;
+}
+
+void perf_input_queue_sample(uint32_t depth)
+{
+    input_queue_depth = depth;
+    if (depth > input_queue_max_depth) input_queue_max_depth = depth;
+}
+
+void perf_input_queue_get(uint32_t *depth, uint32_t *max_depth)
+{
+    *depth = input_queue_depth;
+    *max_depth = input_queue_max_depth;
+}
+
+void perf_ui_loop_tick(void)
+{
+    int64_t now = esp_timer_get_time();
+    if (ui_loop_last_us != 0) {
+        uint32_t gap = now - ui_loop_last_us;
+        portENTER_CRITICAL(&lock);
+        if (gap > ui_loop_max_gap_us) ui_loop_max_gap_us = gap;
+        portEXIT_CRITICAL(&lock);
+    }
+    ui_loop_last_us = now;
+}
+
+uint32_t perf_ui_loop_max_gap_take(void)
+{
+    portENTER_CRITICAL(&lock);
+    uint32_t gap = ui_loop_max_gap_us;
+    ui_loop_max_gap_us = 0;
+    portEXIT_CRITICAL(&lock);
+    return gap;
+}
+
+#if defined(CONFIG_PERF_INPUT_LATENCY) && CONFIG_PERF_LATENCY_REPORT_PERIOD_S > 0
+static void report_timer_cb(void *arg)
+{
+    perf_latency_report();
+}
+#endif
+
+void perf_init(void)
+{
+#if defined(CONFIG_PERF_INPUT_LATENCY) && CONFIG_PERF_LATENCY_REPORT_PERIOD_S > 0
+    const esp_timer_create_args_t report_timer_args = {
+        .callback = &report_timer_cb,
+        .name = "perf_report"
+    };
+    esp_timer_handle_t report_timer = NULL;
+    ESP_ERROR_CHECK(esp_timer_create(&report_timer_args, &report_timer));
+    ESP_ERROR_CHECK(esp_timer_start_periodic(report_timer, CONFIG_PERF_LATENCY_REPORT_PERIOD_S * 1000000ULL));
+#endif
+}
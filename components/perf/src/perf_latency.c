@@ -0,0 +1,161 @@
+#include "sdkconfig.h"
+
+#ifdef CONFIG_PERF_INPUT_LATENCY
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "perf.h"
+#include "perf_priv.h"
+
+#define TAG "perf"
+
+// One bucket per millisecond, the last bucket collects everything slower
+#define LATENCY_BUCKETS (CONFIG_PERF_LATENCY_MAX_MS + 1)
+
+static const char *source_names[PERF_INPUT_SOURCE_MAX] = {
+    [PERF_INPUT_KNOB] = "knob",
+    [PERF_INPUT_BUTTON] = "button",
+};
+
+typedef struct {
+    int64_t stamp_us;      // when the input was detected
+    int64_t handled_us;    // when the UI applied it
+    int64_t flush_us;      // when the first area of the frame showing it was flushed
+    bool valid;
+} latency_sample_t;
+
+typedef struct {
+    uint32_t hist[LATENCY_BUCKETS];
+    uint32_t count;
+    uint32_t merged;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint64_t dispatch_sum_us;
+    uint64_t render_sum_us;
+    uint64_t flush_sum_us;
+} latency_hist_t;
+
+// Handled but not yet on a frame. Only touched by the task running LVGL.
+static latency_sample_t pending[PERF_INPUT_SOURCE_MAX];
+
+// Claimed by the frame being flushed, completed from the flush ISR
+static latency_sample_t inflight[PERF_INPUT_SOURCE_MAX];
+static latency_hist_t hists[PERF_INPUT_SOURCE_MAX];
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+void perf_input_handled(perf_input_source_t src, int64_t stamp_us)
+{
+    latency_sample_t *p = &pending[src];
+
+    // Several events shown by the same frame are measured from the oldest one
+    if (p->valid) {
+        portENTER_CRITICAL(&lock);
+        hists[src].merged++;
+        portEXIT_CRITICAL(&lock);
+        return;
+    }
+    p->stamp_us = stamp_us;
+    p->handled_us = esp_timer_get_time();
+    p->valid = true;
+}
+
+void perf_latency_frame_begin(int64_t now_us)
+{
+    portENTER_CRITICAL(&lock);
+    for (int i = 0; i < PERF_INPUT_SOURCE_MAX; i++) {
+        if (pending[i].valid) {
+            inflight[i] = pending[i];
+            inflight[i].flush_us = now_us;
+            pending[i].valid = false;
+        }
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+static void record(latency_hist_t *h, const latency_sample_t *s, int64_t done_us)
+{
+    uint32_t total_us = done_us - s->stamp_us;
+    uint32_t bucket = total_us / 1000;
+    if (bucket >= LATENCY_BUCKETS) {
+        bucket = LATENCY_BUCKETS - 1;
+    }
+    h->hist[bucket]++;
+    if (h->count == 0 || total_us < h->min_us) h->min_us = total_us;
+    if (total_us > h->max_us) h->max_us = total_us;
+    h->count++;
+    h->dispatch_sum_us += s->handled_us - s->stamp_us;
+    h->render_sum_us += s->flush_us - s->handled_us;
+    h->flush_sum_us += done_us - s->flush_us;
+}
+
+void perf_latency_frame_done(int64_t now_us)
+{
+    portENTER_CRITICAL_ISR(&lock);
+    for (int i = 0; i < PERF_INPUT_SOURCE_MAX; i++) {
+        if (inflight[i].valid) {
+            record(&hists[i], &inflight[i], now_us);
+            inflight[i].valid = false;
+        }
+    }
+    portEXIT_CRITICAL_ISR(&lock);
+}
+
+// Upper edge of the bucket holding the pct-th percentile
+static uint32_t percentile(const latency_hist_t *h, uint32_t pct)
+{
+    uint32_t rank = (h->count * pct + 99) / 100;
+    uint32_t seen = 0;
+    for (int b = 0; b < LATENCY_BUCKETS - 1; b++) {
+        seen += h->hist[b];
+        if (seen >= rank) {
+            uint32_t edge = (b + 1) * 1000;
+            return edge < h->max_us ? edge : h->max_us;
+        }
+    }
+    return h->max_us;
+}
+
+void perf_latency_get(perf_input_source_t src, perf_latency_stats_t *stats)
+{
+    const latency_hist_t *h = &hists[src];
+    memset(stats, 0, sizeof(*stats));
+
+    portENTER_CRITICAL(&lock);
+    stats->count = h->count;
+    stats->merged = h->merged;
+    if (h->count > 0) {
+        stats->min_us = h->min_us;
+        stats->max_us = h->max_us;
+        stats->p50_us = percentile(h, 50);
+        stats->p90_us = percentile(h, 90);
+        stats->p99_us = percentile(h, 99);
+        stats->avg_dispatch_us = h->dispatch_sum_us / h->count;
+        stats->avg_render_us = h->render_sum_us / h->count;
+        stats->avg_flush_us = h->flush_sum_us / h->count;
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+void perf_latency_reset(void)
+{
+    portENTER_CRITICAL(&lock);
+    memset(hists, 0, sizeof(hists));
+    portEXIT_CRITICAL(&lock);
+}
+
+void perf_latency_report(void)
+{
+    for (int i = 0; i < PERF_INPUT_SOURCE_MAX; i++) {
+        perf_latency_stats_t s;
+        perf_latency_get(i, &s);
+        if (s.count == 0) continue;
+        ESP_LOGI(TAG, "%s latency n=%u p50=%ums p90=%ums p99=%ums max=%ums (dispatch %uus, render %uus, flush %uus avg, %u merged)",
+                 source_names[i], s.count,
+                 s.p50_us / 1000, s.p90_us / 1000, s.p99_us / 1000, s.max_us / 1000,
+                 s.avg_dispatch_us, s.avg_render_us, s.avg_flush_us, s.merged);
+    }
+}
+
+#endif
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stdint.h>
+
+// Hooks from the frame tracking into the latency histograms. begin is called
+// from the LVGL task when a frame starts flushing, done from the flush ISR once
+// its last area is on the panel.
+void perf_latency_frame_begin(int64_t now_us);
+void perf_latency_frame_done(int64_t now_us);
@@ -0,0 +1,111 @@
+#pragma once
+
+// Wire format of the sync protocol between the device and the companion app.
+//
+// Every frame is COBS encoded and followed by a zero byte, so a receiver
+// that loses bytes or sees console text picks up again at the next zero.
+// Decoded, a frame is
+//
+//   type u8 | seq u8 | payload | crc32 u32
+//
+// with all integers little endian and the CRC (journal_crc32) over type, seq
+// and payload. Frames that fail the CRC are dropped and recovered by
+// retransmission.
+//
+//   HELLO  app -> device   cursor u32: send the sessions after this cursor
+//   DATA   device -> app   cursor u32 after the last session, count u8,
+//                          count * (start u32, duration u32, activity u8)
+//   END    device -> app   cursor u32, all sessions sent
+//   ACK    app -> device   seq is the last DATA or END frame received in order
+//
+// The device numbers DATA and END frames from 0 and keeps up to a window of
+// them unacknowledged. Without progress for a while it goes back to the
+// oldest unacknowledged frame and sends again from there (go-back-N).
+//
+// An app that keeps a copy of the journal pages (a mirror) can sync those
+// instead of sessions, and then only moves the pages that changed:
+//
+//   HAVE   app -> device   count u8, count * (page seq u32, hash u32)
+//   MIRROR app -> device   send the pages whose hash differs
+//   PAGE   device -> app   position u32 (JOURNAL_POS of the first byte),
+//                          up to SYNC_PAGE_CHUNK bytes of the page
+//   END    device -> app   tail seq u32, head seq u32, all pages sent
+//
+// The hash of a page is journal_crc32 over all of its JOURNAL_PAGE_SIZE
+// bytes. A page seq is never reused and only the page being appended to
+// changes, so after a first full copy a resync sends the HAVE list, one
+// page or less and an END. HAVE frames are not acknowledged, a lost one
+// only costs its pages being sent again. PAGE frames carry a page up to its
+// last written byte, the mirror fills the rest with 0xFF as erased flash
+// reads, and the chunk at offset 0 tells it to clear its old copy. PAGE
+// and END frames are numbered and acknowledged like DATA.
+//
+// This file and the sources of the component only depend on journal.h, the
+// host tools use them as they are.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "journal.h"
+
+#define SYNC_HELLO 'H'
+#define SYNC_DATA  'D'
+#define SYNC_END   'E'
+#define SYNC_ACK   'A'
+#define SYNC_HAVE   'V'
+#define SYNC_MIRROR 'M'
+#define SYNC_PAGE   'P'
+
+#define SYNC_RECORD_SIZE 9
+#define SYNC_RECORDS_PER_FRAME 24
+#define SYNC_HAVE_PER_FRAME 24
+#define SYNC_PAGE_CHUNK 216
+
+// Largest decoded frame and largest encoded one, delimiter included
+#define SYNC_FRAME_MAX (2 + 5 + SYNC_RECORDS_PER_FRAME * SYNC_RECORD_SIZE + 4)
+#define SYNC_WIRE_MAX (SYNC_FRAME_MAX + SYNC_FRAME_MAX / 254 + 2)
+
+// Encode `len` bytes into `out` (at least SYNC_WIRE_MAX), zero delimiter
+// included. Returns the encoded length.
+size_t sync_cobs_encode(const uint8_t *in, size_t len, uint8_t *out);
+
+// Decode in place, returns the decoded length or 0 if the data is not valid COBS
+size_t sync_cobs_decode(uint8_t *buf, size_t len);
+
+// Build and encode a frame, returns its length on the wire
+size_t sync_frame_build(uint8_t type, uint8_t seq, const uint8_t *payload, size_t len, uint8_t *out);
+
+// Decoded frame, `payload` points into the receiver buffer
+typedef struct {
+    uint8_t type;
+    uint8_t seq;
+    const uint8_t *payload;
+    size_t len;
+} sync_frame_t;
+
+// Collects bytes until a frame delimiter
+typedef struct {
+    uint8_t buf[SYNC_WIRE_MAX];
+    size_t len;
+    bool overflow;
+    uint32_t bad_frames;    // dropped for length, COBS or CRC errors
+} sync_rx_t;
+
+void sync_rx_init(sync_rx_t *rx);
+
+// Feed one byte. Returns true with `frame` filled when it completed a valid
+// frame, which stays valid until the next call.
+bool sync_rx_push(sync_rx_t *rx, uint8_t byte, sync_frame_t *frame);
+
+static inline void sync_put32(uint8_t *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static inline uint32_t sync_get32(const uint8_t *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+// Device side of the sync protocol, independent of the transport. The caller
+// feeds received bytes and the time, the sender writes frames through `io`.
+// Sent frames are not kept: on a retransmission the sessions or page chunks
+// are read again from their position, so memory use does not depend on the
+// window size.
+
+#include "sync_proto.h"
+
+typedef struct {
+    // Copy up to `max` sessions from `*pos` on and advance it
+    int (*read)(void *ctx, journal_pos_t *pos, session_record_t *recs, int max);
+    void (*write)(void *ctx, const uint8_t *data, size_t len);
+    // Mirror sync, NULL without it: the oldest and newest page (both 0 for an
+    // empty journal), and a copy of `len` bytes at `offset` of page `seq`,
+    // false if the journal does not hold that page
+    void (*pages)(void *ctx, uint32_t *tail, uint32_t *head);
+    bool (*read_page)(void *ctx, uint32_t seq, uint32_t offset, uint8_t *dst, size_t len);
+    void *ctx;
+} sync_io_t;
+
+#define SYNC_WINDOW_MAX 32
+
+// Pages the app can report as up to date, one bit each. Page seq N uses bit
+// N % SYNC_MIRROR_PAGES, a journal holding more pages is always sent whole.
+// The sessions partition has 1024.
+#define SYNC_MIRROR_PAGES 1024
+
+typedef enum {
+    SYNC_WAIT_HELLO,
+    SYNC_SENDING,
+    SYNC_DONE,
+    SYNC_FAILED,
+} sync_state_t;
+
+typedef struct {
+    sync_io_t io;
+    sync_rx_t rx;
+    sync_state_t state;
+    uint32_t window;
+    uint32_t retransmit_ms;
+    uint32_t timeout_ms;
+
+    // Frames base_seq .. next_seq - 1 are unacknowledged; start[] holds the
+    // cursor each of them was read from
+    uint8_t base_seq;
+    uint8_t next_seq;
+    journal_pos_t start[SYNC_WINDOW_MAX];
+    journal_pos_t next_pos;
+    bool end_sent;
+    bool mirror;                // sending pages rather than sessions
+    uint32_t used_seq;          // page whose written length is in `used`
+    uint32_t used;
+    uint8_t have[SYNC_MIRROR_PAGES / 8];    // pages whose hash matched the app's
+    bool go_back;               // the app reported a gap
+    bool went_back;             // already resent since the last progress
+    uint32_t progress_ms;       // last time a frame was acknowledged
+    uint32_t activity_ms;       // last time anything was received
+
+    // Statistics
+    uint32_t records;
+    uint32_t pages;
+    uint32_t frames;
+    uint32_t retransmits;
+    uint32_t bytes;
+} sync_sender_t;
+
+// `window` frames in flight (at most SYNC_WINDOW_MAX), go back after
+// `retransmit_ms` without progress, fail after `timeout_ms` without hearing
+// from the app
+void sync_sender_init(sync_sender_t *s, const sync_io_t *io, uint32_t window,
+                      uint32_t retransmit_ms, uint32_t timeout_ms, uint32_t now_ms);
+
+void sync_sender_input(sync_sender_t *s, const uint8_t *data, size_t len, uint32_t now_ms);
+
+// Send what the window allows and handle timeouts. Returns the state.
+sync_state_t sync_sender_poll(sync_sender_t *s, uint32_t now_ms);
@@ -0,0 +1,91 @@
+#include <string.h>
+#include "sync_proto.h"
+
+size_t sync_cobs_encode(const uint8_t *in, size_t len, uint8_t *out)
+{
+    size_t code_at = 0;
+    size_t o = 1;
+    uint8_t code = 1;
+
+    for (size_t i = 0; i < len; i++) {
+        if (in[i] != 0) {
+            out[o++] = in[i];
+            code++;
+        }
+        if (in[i] == 0 || code == 0xff) {
+            out[code_at] = code;
+            code_at = o++;
+            code = 1;
+        }
+    }
+    out[code_at] = code;
+    out[o++] = 0;
+    return o;
+}
+
+size_t sync_cobs_decode(uint8_t *buf, size_t len)
+{
+    size_t i = 0;
+    size_t o = 0;
+
+    while (i < len) {
+        uint8_t code = buf[i++];
+        if (code == 0 || i + code - 1 > len) return 0;
+        for (uint8_t k = 1; k < code; k++) {
+            buf[o++] = buf[i++];
+        }
+        // A group shorter than 0xff stands for a zero, except at the very end
+        if (code != 0xff && i < len) {
+            buf[o++] = 0;
+        }
+    }
+    return o;
+}
+
+size_t sync_frame_build(uint8_t type, uint8_t seq, const uint8_t *payload, size_t len, uint8_t *out)
+{
+    uint8_t frame[SYNC_FRAME_MAX];
+    if (len > SYNC_FRAME_MAX - 6) return 0;
+
+    frame[0] = type;
+    frame[1] = seq;
+    memcpy(frame + 2, payload, len);
+    sync_put32(frame + 2 + len, journal_crc32(0, frame, 2 + len));
+    return sync_cobs_encode(frame, len + 6, out);
+}
+
+void sync_rx_init(sync_rx_t *rx)
+{
+    rx->len = 0;
+    rx->overflow = false;
+    rx->bad_frames = 0;
+}
+
+bool sync_rx_push(sync_rx_t *rx, uint8_t byte, sync_frame_t *frame)
+{
+    if (byte != 0) {
+        if (rx->len < sizeof(rx->buf)) {
+            rx->buf[rx->len++] = byte;
+        } else {
+            rx->overflow = true;
+        }
+        return false;
+    }
+
+    size_t len = rx->len;
+    bool overflow = rx->overflow;
+    rx->len = 0;
+    rx->overflow = false;
+    if (len == 0) return false;
+
+    len = overflow ? 0 : sync_cobs_decode(rx->buf, len);
+    if (len < 6 || sync_get32(rx->buf + len - 4) != journal_crc32(0, rx->buf, len - 4)) {
+        rx->bad_frames++;
+        return false;
+    }
+    frame->type = rx->buf[0];
+    frame->seq = rx->buf[1];
+    frame->payload = rx->buf + 2;
+    frame->len = len - 6;
+    return true;
+}
@@ -0,0 +1,235 @@
+#include <string.h>
+#include "sync_sender.h"
+
+void sync_sender_init(sync_sender_t *s, const sync_io_t *io, uint32_t window,
+                      uint32_t retransmit_ms, uint32_t timeout_ms, uint32_t now_ms)
+{
+    memset(s, 0, sizeof(*s));
+    s->io = *io;
+    sync_rx_init(&s->rx);
+    s->state = SYNC_WAIT_HELLO;
+    s->window = window < 1 ? 1 : window > SYNC_WINDOW_MAX ? SYNC_WINDOW_MAX : window;
+    s->retransmit_ms = retransmit_ms;
+    s->timeout_ms = timeout_ms;
+    s->activity_ms = now_ms;
+}
+
+// Hash of page `seq` (see sync_proto.h) and its length up to the last byte
+// that is not erased. False if the journal does not hold the page.
+static bool scan_page(sync_sender_t *s, uint32_t seq, uint32_t *hash, uint32_t *used)
+{
+    uint8_t buf[256];
+    uint32_t crc = 0;
+    *used = 0;
+    for (uint32_t offset = 0; offset < JOURNAL_PAGE_SIZE; offset += sizeof(buf)) {
+        if (!s->io.read_page(s->io.ctx, seq, offset, buf, sizeof(buf))) return false;
+        crc = journal_crc32(crc, buf, sizeof(buf));
+        for (uint32_t i = sizeof(buf); i-- > 0;) {
+            if (buf[i] != 0xFF) {
+                *used = offset + i + 1;
+                break;
+            }
+        }
+    }
+    *hash = crc;
+    return true;
+}
+
+static bool have_page(const sync_sender_t *s, uint32_t seq)
+{
+    uint32_t bit = seq % SYNC_MIRROR_PAGES;
+    return s->have[bit / 8] & 1 << bit % 8;
+}
+
+// Mark the pages of a HAVE frame whose hash matches ours
+static void handle_have(sync_sender_t *s, const sync_frame_t *frame)
+{
+    if (frame->len < 1 || frame->len != 1 + (size_t)frame->payload[0] * 8) return;
+    uint32_t tail, head;
+    s->io.pages(s->io.ctx, &tail, &head);
+    if (head - tail >= SYNC_MIRROR_PAGES) return;
+
+    const uint8_t *p = frame->payload + 1;
+    for (int i = 0; i < frame->payload[0]; i++, p += 8) {
+        uint32_t seq = sync_get32(p);
+        uint32_t hash, used;
+        if (head == 0 || seq < tail || seq > head || !scan_page(s, seq, &hash, &used)) continue;
+        if (hash == sync_get32(p + 4)) {
+            uint32_t bit = seq % SYNC_MIRROR_PAGES;
+            s->have[bit / 8] |= 1 << bit % 8;
+        }
+    }
+}
+
+static void restart(sync_sender_t *s, journal_pos_t pos, bool mirror, uint32_t now_ms)
+{
+    s->state = SYNC_SENDING;
+    s->mirror = mirror;
+    s->next_pos = pos;
+    s->base_seq = 0;
+    s->next_seq = 0;
+    s->end_sent = false;
+    s->go_back = false;
+    s->went_back = false;
+    s->used_seq = 0;
+    s->progress_ms = now_ms;
+}
+
+static void handle_frame(sync_sender_t *s, const sync_frame_t *frame, uint32_t now_ms)
+{
+    s->activity_ms = now_ms;
+
+    // Also a restart if the app lost track
+    if (frame->type == SYNC_HELLO && frame->len >= 4) {
+        restart(s, sync_get32(frame->payload), false, now_ms);
+        return;
+    }
+    if (frame->type == SYNC_MIRROR && s->io.read_page) {
+        restart(s, 0, true, now_ms);
+        return;
+    }
+    if (frame->type == SYNC_HAVE && s->io.read_page) {
+        handle_have(s, frame);
+        return;
+    }
+    if (frame->type == SYNC_ACK && s->state == SYNC_SENDING) {
+        // Cumulative: everything up to and including frame->seq arrived
+        uint8_t outstanding = s->next_seq - s->base_seq;
+        uint8_t ahead = frame->seq - s->base_seq;
+        if (ahead >= outstanding) {
+            // A repeat of the last acknowledgement means a frame after it
+            // was lost: resend without waiting for the timeout, once
+            if (frame->seq == (uint8_t)(s->base_seq - 1) && outstanding > 0 && !s->went_back) {
+                s->go_back = true;
+            }
+            return;
+        }
+        s->base_seq += ahead + 1;
+        s->went_back = false;
+        s->progress_ms = now_ms;
+        if (s->end_sent && s->base_seq == s->next_seq) {
+            s->state = SYNC_DONE;
+        }
+    }
+}
+
+void sync_sender_input(sync_sender_t *s, const uint8_t *data, size_t len, uint32_t now_ms)
+{
+    sync_frame_t frame;
+    for (size_t i = 0; i < len; i++) {
+        if (sync_rx_push(&s->rx, data[i], &frame)) {
+            handle_frame(s, &frame, now_ms);
+        }
+    }
+}
+
+static void send_frame(sync_sender_t *s, uint8_t type, const uint8_t *payload, size_t len, journal_pos_t start)
+{
+    uint8_t wire[SYNC_WIRE_MAX];
+    size_t n = sync_frame_build(type, s->next_seq, payload, len, wire);
+    s->start[s->next_seq % SYNC_WINDOW_MAX] = start;
+    s->next_seq++;
+    s->frames++;
+    s->bytes += n;
+    s->io.write(s->io.ctx, wire, n);
+}
+
+// Read the next sessions into a DATA frame, or send END when there are none
+static void send_next(sync_sender_t *s)
+{
+    session_record_t recs[SYNC_RECORDS_PER_FRAME];
+    uint8_t payload[5 + SYNC_RECORDS_PER_FRAME * SYNC_RECORD_SIZE];
+    journal_pos_t start = s->next_pos;
+
+    int n = s->io.read(s->io.ctx, &s->next_pos, recs, SYNC_RECORDS_PER_FRAME);
+    sync_put32(payload, s->next_pos);
+    if (n <= 0) {
+        send_frame(s, SYNC_END, payload, 4, start);
+        s->end_sent = true;
+        return;
+    }
+
+    payload[4] = n;
+    uint8_t *p = payload + 5;
+    for (int i = 0; i < n; i++, p += SYNC_RECORD_SIZE) {
+        sync_put32(p, recs[i].start);
+        sync_put32(p + 4, recs[i].duration);
+        p[8] = recs[i].activity;
+    }
+    send_frame(s, SYNC_DATA, payload, p - payload, start);
+    s->records += n;
+}
+
+// Send the next chunk of a page the app lacks, or END after the newest page
+static void send_next_page(sync_sender_t *s)
+{
+    uint8_t payload[4 + SYNC_PAGE_CHUNK];
+    uint32_t tail, head;
+    s->io.pages(s->io.ctx, &tail, &head);
+
+    uint32_t seq = JOURNAL_POS_SEQ(s->next_pos);
+    uint32_t offset = JOURNAL_POS_OFFSET(s->next_pos);
+    if (seq < tail) {
+        seq = tail;
+        offset = 0;
+    }
+    for (; head != 0 && seq <= head; seq++, offset = 0) {
+        if (offset == 0 && head - tail < SYNC_MIRROR_PAGES && have_page(s, seq)) continue;
+        // The newest page grows while we send it, what comes after this
+        // length goes with the next sync
+        if (offset == 0 || s->used_seq != seq) {
+            uint32_t hash;
+            if (!scan_page(s, seq, &hash, &s->used)) continue;
+            s->used_seq = seq;
+        }
+        if (offset >= s->used) continue;
+
+        uint32_t len = s->used - offset < SYNC_PAGE_CHUNK ? s->used - offset : SYNC_PAGE_CHUNK;
+        if (!s->io.read_page(s->io.ctx, seq, offset, payload + 4, len)) continue;
+        sync_put32(payload, JOURNAL_POS(seq, offset));
+        s->next_pos = JOURNAL_POS(seq, offset + len);
+        s->pages += offset == 0;
+        send_frame(s, SYNC_PAGE, payload, 4 + len, JOURNAL_POS(seq, offset));
+        return;
+    }
+
+    sync_put32(payload, tail);
+    sync_put32(payload + 4, head);
+    s->next_pos = JOURNAL_POS(seq, 0);
+    send_frame(s, SYNC_END, payload, 8, s->next_pos);
+    s->end_sent = true;
+}
+
+sync_state_t sync_sender_poll(sync_sender_t *s, uint32_t now_ms)
+{
+    if (s->state == SYNC_DONE || s->state == SYNC_FAILED) {
+        return s->state;
+    }
+    if (now_ms - s->activity_ms > s->timeout_ms) {
+        s->state = SYNC_FAILED;
+        return s->state;
+    }
+    if (s->state != SYNC_SENDING) {
+        return s->state;
+    }
+
+    // Go back to the oldest frame the app has not acknowledged
+    if (s->base_seq != s->next_seq && (s->go_back || now_ms - s->progress_ms > s->retransmit_ms)) {
+        s->retransmits += (uint8_t)(s->next_seq - s->base_seq);
+        s->next_pos = s->start[s->base_seq % SYNC_WINDOW_MAX];
+        s->next_seq = s->base_seq;
+        s->end_sent = false;
+        s->went_back = s->go_back;
+        s->go_back = false;
+        s->progress_ms = now_ms;
+    }
+
+    while (!s->end_sent && (uint8_t)(s->next_seq - s->base_seq) < s->window) {
+        if (s->mirror) {
+            send_next_page(s);
+        } else {
+            send_next(s);
+        }
+    }
+    return s->state;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdint.h>
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "tracelog_wire.h"
+
+// Log statements for hot paths. TRACE_LOGI(tag, fmt, ...) takes the same
+// arguments as ESP_LOGI but, with CONFIG_TRACELOG_ENABLE, formats nothing on
+// the device: the call site and up to three 32-bit arguments go into a
+// lock-free ring that a low priority task drains to the console.
+//
+// Arguments are stored raw, so %s only works for strings that live in the
+// application image (string literals and const tables).
+
+#ifdef CONFIG_TRACELOG_ENABLE
+
+// Per call site, in flash. The decoder reads it back from the ELF.
+typedef struct {
+    const char *tag;
+    const char *fmt;
+    uint32_t level;
+} tracelog_site_t;
+
+// Starts the drain task. Records written before this are kept in the ring.
+void tracelog_init(void);
+
+// Safe from any task or ISR
+void tracelog_write(const tracelog_site_t *site, uint32_t a0, uint32_t a1, uint32_t a2);
+
+// Records lost because the drain task fell behind
+uint32_t tracelog_dropped(void);
+
+// Keep the drain task off the console, for a binary protocol on the same
+// port. Pausing waits for a drain in progress to finish. Records keep going
+// into the ring meanwhile, the oldest are dropped if it fills. Pause and
+// resume from the same task.
+void tracelog_pause(void);
+void tracelog_resume(void);
+
+#define TRACE_ARG(x) ((uint32_t)(uintptr_t)(x))
+#define TRACE_W0(s) tracelog_write((s), 0, 0, 0)
+#define TRACE_W1(s, a) tracelog_write((s), TRACE_ARG(a), 0, 0)
+#define TRACE_W2(s, a, b) tracelog_write((s), TRACE_ARG(a), TRACE_ARG(b), 0)
+#define TRACE_W3(s, a, b, c) tracelog_write((s), TRACE_ARG(a), TRACE_ARG(b), TRACE_ARG(c))
+#define TRACE_PICK(_0, _1, _2, _3, name, ...) name
+
+#define TRACE_LOG_SITE(lvl, tag, fmt, ...) do {                                        \
+        static const tracelog_site_t _tl_site = { (tag), (fmt), (lvl) };               \
+        TRACE_PICK(_, ##__VA_ARGS__, TRACE_W3, TRACE_W2, TRACE_W1, TRACE_W0)(&_tl_site, ##__VA_ARGS__); \
+    } while (0)
+
+#define TRACE_LOGE(tag, fmt, ...) TRACE_LOG_SITE('E', tag, fmt, ##__VA_ARGS__)
+#define TRACE_LOGW(tag, fmt, ...) TRACE_LOG_SITE('W', tag, fmt, ##__VA_ARGS__)
+#define TRACE_LOGI(tag, fmt, ...) TRACE_LOG_SITE('I', tag, fmt, ##__VA_ARGS__)
+
+#else
+
+static inline void tracelog_init(void) {}
+static inline uint32_t tracelog_dropped(void) { return 0; }
+static inline void tracelog_pause(void) {}
+static inline void tracelog_resume(void) {}
+
+#define TRACE_LOGE(tag, fmt, ...) ESP_LOGE(tag, fmt, ##__VA_ARGS__)
+#define TRACE_LOGW(tag, fmt, ...) ESP_LOGW(tag, fmt, ##__VA_ARGS__)
+#define TRACE_LOGI(tag, fmt, ...) ESP_LOGI(tag, fmt, ##__VA_ARGS__)
+
+#endif
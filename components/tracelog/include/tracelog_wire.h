@@ -0,0 +1,28 @@
+#pragma once
+
+// Wire format of the binary trace log, shared by the firmware and the host
+// decoder. Keep this header free of ESP-IDF includes.
+
+#include <stdint.h>
+
+#define TRACELOG_MAX_ARGS 3
+
+// Every drained record is written to the console as one line: this prefix,
+// the record in base64 and a newline. Anything else on the console is plain
+// text and is passed through by the decoder.
+#define TRACELOG_LINE_PREFIX "\x1eT"
+#define TRACELOG_LINE_PREFIX_LEN 2
+
+// A record as stored in the ring and sent on the wire, little endian.
+// `site` is the target address of the tracelog_site_t of the call site,
+// which the decoder looks up in the ELF to find the tag and format string.
+// `seq` counts records written since boot so gaps show dropped records.
+typedef struct {
+    uint32_t seq;
+    uint32_t site;
+    uint32_t timestamp_us;     // low 32 bits of esp_timer_get_time()
+    uint32_t args[TRACELOG_MAX_ARGS];
+} tracelog_record_t;
+
+#define TRACELOG_RECORD_SIZE 24
+#define TRACELOG_SITE_SIZE 12  // tag pointer, format pointer, level, on the 32-bit target
@@ -0,0 +1,157 @@
+#include "sdkconfig.h"
+
+#ifdef CONFIG_TRACELOG_ENABLE
+
+#include <stdio.h>
+#include <stdatomic.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "tracelog.h"
+
+#define TAG "tracelog"
+
+#define RING_MASK (CONFIG_TRACELOG_RING_ENTRIES - 1)
+
+_Static_assert((CONFIG_TRACELOG_RING_ENTRIES & RING_MASK) == 0, "CONFIG_TRACELOG_RING_ENTRIES must be a power of two");
+_Static_assert(sizeof(tracelog_record_t) == TRACELOG_RECORD_SIZE, "tracelog_record_t does not match the wire format");
+
+// `commit` is 0 while a writer fills the slot and seq + 1 once it is complete,
+// which lets the reader detect slots that are unfinished or were overwritten
+// while it copied them.
+typedef struct {
+    _Atomic uint32_t commit;
+    tracelog_record_t rec;
+} slot_t;
+
+static slot_t ring[CONFIG_TRACELOG_RING_ENTRIES];
+static _Atomic uint32_t head;
+static uint32_t tail;
+static _Atomic uint32_t dropped;
+// Held by the drain task while it writes, and by tracelog_pause()
+static SemaphoreHandle_t drain_lock;
+
+void tracelog_write(const tracelog_site_t *site, uint32_t a0, uint32_t a1, uint32_t a2)
+{
+    uint32_t seq = atomic_fetch_add_explicit(&head, 1, memory_order_relaxed);
+    slot_t *slot = &ring[seq & RING_MASK];
+
+    atomic_store_explicit(&slot->commit, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    slot->rec.seq = seq;
+    slot->rec.site = (uint32_t)(uintptr_t)site;
+    slot->rec.timestamp_us = (uint32_t)esp_timer_get_time();
+    slot->rec.args[0] = a0;
+    slot->rec.args[1] = a1;
+    slot->rec.args[2] = a2;
+    atomic_store_explicit(&slot->commit, seq + 1, memory_order_release);
+}
+
+uint32_t tracelog_dropped(void)
+{
+    return atomic_load_explicit(&dropped, memory_order_relaxed);
+}
+
+static const char b64_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// TRACELOG_RECORD_SIZE is a multiple of 3, so no padding is ever needed
+static void emit(const tracelog_record_t *rec)
+{
+    const uint8_t *in = (const uint8_t *)rec;
+    char line[TRACELOG_LINE_PREFIX_LEN + TRACELOG_RECORD_SIZE / 3 * 4 + 1];
+    char *out = line;
+
+    memcpy(out, TRACELOG_LINE_PREFIX, TRACELOG_LINE_PREFIX_LEN);
+    out += TRACELOG_LINE_PREFIX_LEN;
+    for (int i = 0; i < TRACELOG_RECORD_SIZE; i += 3) {
+        uint32_t v = in[i] << 16 | in[i + 1] << 8 | in[i + 2];
+        *out++ = b64_chars[(v >> 18) & 0x3f];
+        *out++ = b64_chars[(v >> 12) & 0x3f];
+        *out++ = b64_chars[(v >> 6) & 0x3f];
+        *out++ = b64_chars[v & 0x3f];
+    }
+    *out++ = '\n';
+    fwrite(line, 1, out - line, stdout);
+}
+
+// Single consumer. Returns the number of records written to the console.
+static int drain(void)
+{
+    int n = 0;
+    uint32_t lost = 0;
+
+    for (;;) {
+        uint32_t h = atomic_load_explicit(&head, memory_order_acquire);
+        if (tail == h) break;
+
+        // Lapped by the writers, skip what was overwritten
+        if (h - tail > CONFIG_TRACELOG_RING_ENTRIES) {
+            lost += h - CONFIG_TRACELOG_RING_ENTRIES - tail;
+            tail = h - CONFIG_TRACELOG_RING_ENTRIES;
+        }
+
+        slot_t *slot = &ring[tail & RING_MASK];
+        uint32_t c = atomic_load_explicit(&slot->commit, memory_order_acquire);
+        if (c != tail + 1) {
+            if ((int32_t)(c - (tail + 1)) > 0) {
+                // A newer record already took this slot
+                lost++;
+                tail++;
+                continue;
+            }
+            // Still being written, pick it up on the next pass
+            break;
+        }
+
+        tracelog_record_t rec = slot->rec;
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->commit, memory_order_relaxed) != c) {
+            lost++;
+            tail++;
+            continue;
+        }
+        emit(&rec);
+        tail++;
+        n++;
+    }
+
+    if (lost) {
+        atomic_fetch_add_explicit(&dropped, lost, memory_order_relaxed);
+        ESP_LOGW(TAG, "%u records dropped", lost);
+    }
+    if (n) {
+        fflush(stdout);
+    }
+    return n;
+}
+
+static void drain_task(void *arg)
+{
+    for (;;) {
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_TRACELOG_DRAIN_PERIOD_MS));
+        xSemaphoreTake(drain_lock, portMAX_DELAY);
+        drain();
+        xSemaphoreGive(drain_lock);
+    }
+}
+
+void tracelog_pause(void)
+{
+    if (drain_lock) xSemaphoreTake(drain_lock, portMAX_DELAY);
+}
+
+void tracelog_resume(void)
+{
+    if (drain_lock) xSemaphoreGive(drain_lock);
+}
+
+void tracelog_init(void)
+{
+    drain_lock = xSemaphoreCreateMutex();
+    xTaskCreate(drain_task, "tracelog", 3072, NULL, CONFIG_TRACELOG_TASK_PRIORITY, NULL);
+}
+
+#endif
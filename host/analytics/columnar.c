@@ -0,0 +1,322 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "columnar.h"
+
+_Static_assert(sizeof(columnar_header_t) == 16, "columnar header must be 16 bytes");
+_Static_assert(sizeof(columnar_block_t) == 40, "columnar block entry must be 40 bytes");
+
+#define PADDING 8
+#define NO_ACTIVITY 0xFF
+
+static unsigned bits_for(uint32_t value)
+{
+    return value ? 32 - __builtin_clz(value) : 0;
+}
+
+static size_t packed_size(uint32_t count, unsigned bits)
+{
+    return ((size_t)count * bits + 7) / 8;
+}
+
+// Append `count` values of `bits` bits to `out`, lowest bit first. Returns
+// the bytes written.
+static size_t pack(uint8_t *out, const uint32_t *values, uint32_t count, unsigned bits)
+{
+    uint64_t acc = 0;
+    unsigned fill = 0;
+    size_t n = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        acc |= (uint64_t)values[i] << fill;
+        fill += bits;
+        while (fill >= 8) {
+            out[n++] = (uint8_t)acc;
+            acc >>= 8;
+            fill -= 8;
+        }
+    }
+    if (fill) {
+        out[n++] = (uint8_t)acc;
+    }
+    return n;
+}
+
+static void unpack(const uint8_t *in, uint32_t count, unsigned bits, uint32_t *out)
+{
+    uint64_t mask = (1ull << bits) - 1;
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t bit = (uint64_t)i * bits;
+        uint64_t word;
+        memcpy(&word, in + bit / 8, sizeof(word));
+        out[i] = word >> (bit % 8) & mask;
+    }
+}
+
+static void unpack8(const uint8_t *in, uint32_t count, unsigned bits, uint8_t *out)
+{
+    uint64_t mask = (1ull << bits) - 1;
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t bit = (uint64_t)i * bits;
+        uint64_t word;
+        memcpy(&word, in + bit / 8, sizeof(word));
+        out[i] = word >> (bit % 8) & mask;
+    }
+}
+
+typedef struct {
+    columnar_block_t *blocks;
+    uint32_t block_count;
+    uint32_t block_capacity;
+    uint32_t session_count;
+    // Packed data of the blocks so far, the directory only comes at the end
+    uint8_t *data;
+    size_t data_size;
+    size_t data_capacity;
+    // Sessions of the block being filled
+    uint32_t count;
+    uint32_t start[COLUMNAR_BLOCK_SIZE];
+    uint32_t duration[COLUMNAR_BLOCK_SIZE];
+    uint32_t activity[COLUMNAR_BLOCK_SIZE];
+} writer_t;
+
+static int flush_block(writer_t *w)
+{
+    if (w->count == 0) return 0;
+    if (w->block_count == w->block_capacity) {
+        w->block_capacity = w->block_capacity ? 2 * w->block_capacity : 64;
+        columnar_block_t *blocks = realloc(w->blocks, w->block_capacity * sizeof(*blocks));
+        if (blocks == NULL) return -1;
+        w->blocks = blocks;
+    }
+    // Room for the largest block and the padding
+    size_t need = w->data_size + 3 * COLUMNAR_BLOCK_SIZE * sizeof(uint32_t) + PADDING;
+    if (need > w->data_capacity) {
+        w->data_capacity = need > 2 * w->data_capacity ? need : 2 * w->data_capacity;
+        uint8_t *data = realloc(w->data, w->data_capacity);
+        if (data == NULL) return -1;
+        w->data = data;
+    }
+
+    columnar_block_t *b = &w->blocks[w->block_count++];
+    memset(b, 0, sizeof(*b));
+    b->offset = w->data_size;
+    b->count = w->count;
+    b->start_min = w->start[0];
+    b->start_max = w->start[w->count - 1];
+    b->duration_min = UINT32_MAX;
+    uint32_t max_delta = 0, max_activity = 0;
+    for (uint32_t i = 0; i < w->count; i++) {
+        if (w->duration[i] < b->duration_min) b->duration_min = w->duration[i];
+        if (w->duration[i] > b->duration_max) b->duration_max = w->duration[i];
+        if (w->activity[i] > max_activity) max_activity = w->activity[i];
+        if (w->activity[i] < 64) b->activities |= 1ull << w->activity[i];
+    }
+    // Deltas and offsets replace the values, from the back for the deltas
+    for (uint32_t i = w->count; i-- > 0;) {
+        w->start[i] -= i ? w->start[i - 1] : b->start_min;
+        if (w->start[i] > max_delta) max_delta = w->start[i];
+        w->duration[i] -= b->duration_min;
+    }
+    b->start_bits = bits_for(max_delta);
+    b->duration_bits = bits_for(b->duration_max - b->duration_min);
+    b->activity_bits = bits_for(max_activity);
+
+    uint8_t *out = w->data + w->data_size;
+    size_t n = pack(out, w->start, w->count, b->start_bits);
+    n += pack(out + n, w->duration, w->count, b->duration_bits);
+    n += pack(out + n, w->activity, w->count, b->activity_bits);
+    w->data_size += n;
+    w->session_count += w->count;
+    w->count = 0;
+    return 0;
+}
+
+int columnar_write(const journal_t *journal, const char *path)
+{
+    writer_t *w = calloc(1, sizeof(*w));
+    if (w == NULL) return -1;
+
+    journal_iter_t it;
+    session_record_t rec;
+    int err = 0;
+    journal_iter_init(&it, journal, journal_begin(journal));
+    while (err == 0 && journal_iter_next(&it, &rec, NULL)) {
+        if (w->count == COLUMNAR_BLOCK_SIZE || (w->count > 0 && rec.start < w->start[w->count - 1])) {
+            err = flush_block(w);
+        }
+        w->start[w->count] = rec.start;
+        w->duration[w->count] = rec.duration;
+        w->activity[w->count] = rec.activity;
+        w->count++;
+    }
+    if (err == 0) err = flush_block(w);
+    if (err != 0) {
+        fprintf(stderr, "%s: out of memory\n", path);
+    } else {
+        columnar_header_t header = {
+            .magic = COLUMNAR_MAGIC,
+            .block_size = COLUMNAR_BLOCK_SIZE,
+            .block_count = w->block_count,
+            .session_count = w->session_count,
+        };
+        uint32_t head = sizeof(header) + w->block_count * sizeof(columnar_block_t);
+        for (uint32_t b = 0; b < w->block_count; b++) {
+            w->blocks[b].offset += head;
+        }
+        // An empty log has no data and no padding either
+        size_t data_size = 0;
+        if (w->data) {
+            memset(w->data + w->data_size, 0, PADDING);
+            data_size = w->data_size + PADDING;
+        }
+        FILE *f = fopen(path, "wb");
+        if (f == NULL || fwrite(&header, sizeof(header), 1, f) != 1
+            || fwrite(w->blocks, sizeof(columnar_block_t), w->block_count, f) != w->block_count
+            || fwrite(w->data, 1, data_size, f) != data_size) {
+            perror(path);
+            err = -1;
+        }
+        if (f && fclose(f) != 0 && err == 0) {
+            perror(path);
+            err = -1;
+        }
+    }
+    free(w->data);
+    free(w->blocks);
+    free(w);
+    return err;
+}
+
+int columnar_open(columnar_t *c, const char *path)
+{
+    memset(c, 0, sizeof(*c));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(columnar_header_t)) {
+        fprintf(stderr, "%s: not a columnar file\n", path);
+        close(fd);
+        return -1;
+    }
+    c->size = st.st_size;
+    void *data = mmap(NULL, c->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror(path);
+        return -1;
+    }
+    c->data = data;
+    c->header = data;
+    c->blocks = (const columnar_block_t *)(c->data + sizeof(columnar_header_t));
+
+    const columnar_header_t *h = c->header;
+    bool ok = h->magic == COLUMNAR_MAGIC && h->block_size == COLUMNAR_BLOCK_SIZE
+              && sizeof(*h) + (uint64_t)h->block_count * sizeof(columnar_block_t) <= c->size;
+    for (uint32_t b = 0; ok && b < h->block_count; b++) {
+        const columnar_block_t *blk = &c->blocks[b];
+        size_t len = packed_size(blk->count, blk->start_bits) + packed_size(blk->count, blk->duration_bits)
+                   + packed_size(blk->count, blk->activity_bits);
+        ok = blk->count <= COLUMNAR_BLOCK_SIZE && blk->start_bits <= 32 && blk->duration_bits <= 32
+             && blk->activity_bits <= 8 && blk->offset + (uint64_t)len + PADDING <= c->size;
+    }
+    if (!ok) {
+        fprintf(stderr, "%s: not a columnar file\n", path);
+        columnar_close(c);
+        return -1;
+    }
+    return 0;
+}
+
+void columnar_close(columnar_t *c)
+{
+    munmap((void *)c->data, c->size);
+    c->data = NULL;
+}
+
+// Durations are left as offsets from duration_min
+static void read_columns(const columnar_block_t *blk, const uint8_t *in, uint32_t *start, uint32_t *duration,
+                         uint8_t *activity)
+{
+    size_t start_len = packed_size(blk->count, blk->start_bits);
+    size_t duration_len = packed_size(blk->count, blk->duration_bits);
+    if (start) {
+        unpack(in, blk->count, blk->start_bits, start);
+        uint32_t t = blk->start_min;
+        for (uint32_t i = 0; i < blk->count; i++) {
+            t += start[i];
+            start[i] = t;
+        }
+    }
+    unpack(in + start_len, blk->count, blk->duration_bits, duration);
+    unpack8(in + start_len + duration_len, blk->count, blk->activity_bits, activity);
+    for (uint32_t i = blk->count; i < COLUMNAR_BLOCK_SIZE; i++) {
+        duration[i] = 0;
+        activity[i] = NO_ACTIVITY;
+    }
+}
+
+uint32_t columnar_read_block(const columnar_t *c, uint32_t b, uint32_t *start, uint32_t *duration,
+                             uint8_t *activity)
+{
+    const columnar_block_t *blk = &c->blocks[b];
+    read_columns(blk, c->data + blk->offset, start, duration, activity);
+    for (uint32_t i = 0; i < blk->count; i++) {
+        duration[i] += blk->duration_min;
+    }
+    return blk->count;
+}
+
+// Sessions of `activity` and the sum of their durations over a whole block.
+// No branches and a fixed length, so this vectorises.
+static void sum_activity(const uint8_t *activity, const uint32_t *duration, uint8_t a, uint64_t *sessions,
+                         uint64_t *seconds)
+{
+    uint32_t n = 0;
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < COLUMNAR_BLOCK_SIZE; i++) {
+        uint32_t match = activity[i] == a;
+        n += match;
+        sum += duration[i] & -match;
+    }
+    *sessions = n;
+    *seconds = sum;
+}
+
+void columnar_sum(const columnar_t *c, const journal_view_filter_t *f, journal_view_totals_t *totals)
+{
+    memset(totals, 0, sizeof(*totals));
+    uint32_t to = f->to ? f->to : UINT32_MAX;
+    uint64_t activities = f->activities ? f->activities : UINT64_MAX;
+    uint32_t start[COLUMNAR_BLOCK_SIZE], duration[COLUMNAR_BLOCK_SIZE];
+    uint8_t activity[COLUMNAR_BLOCK_SIZE];
+
+    for (uint32_t b = 0; b < c->header->block_count; b++) {
+        const columnar_block_t *blk = &c->blocks[b];
+        uint64_t present = blk->activities & activities;
+        if (present == 0 || blk->start_max < f->from || blk->start_min >= to) continue;
+
+        // Blocks only partly in the time range drop the sessions outside
+        bool whole = blk->start_min >= f->from && blk->start_max < to;
+        read_columns(blk, c->data + blk->offset, whole ? NULL : start, duration, activity);
+        if (!whole) {
+            for (uint32_t i = 0; i < blk->count; i++) {
+                activity[i] = start[i] >= f->from && start[i] < to ? activity[i] : NO_ACTIVITY;
+            }
+        }
+
+        for (; present; present &= present - 1) {
+            uint8_t a = __builtin_ctzll(present);
+            uint64_t sessions, seconds;
+            sum_activity(activity, duration, a, &sessions, &seconds);
+            totals->sessions[a] += sessions;
+            totals->seconds[a] += seconds + sessions * blk->duration_min;
+        }
+    }
+}
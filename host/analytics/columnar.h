@@ -0,0 +1,80 @@
+#pragma once
+
+// Columnar copy of the session log, for bulk reporting on the PC.
+//
+// Sessions are cut into blocks of COLUMNAR_BLOCK_SIZE. A block keeps its
+// start times, durations and activities in three separate bit-packed
+// arrays, and a directory after the file header holds statistics for each
+// block: the range of its start times and durations and the set of its
+// activities. Filters skip the blocks these rule out without touching their
+// data. The others are unpacked whole and summed in loops over plain
+// arrays, which the compiler vectorises.
+//
+// Layout, little endian:
+//
+//   columnar_header_t
+//   columnar_block_t     header.block_count of them
+//   block data           starts, durations, activities of each block
+//
+// In a block, a start is stored as the difference to the start before it
+// (the first one to start_min), a duration as the difference to
+// duration_min and an activity as it is, each array in the fewest bits that
+// hold its largest value. Start times never go back within a block, the
+// writer begins a new one instead. The data ends with 8 bytes of padding so
+// that unpacking can always load a 64-bit word.
+//
+//   journal_tool columnar sessions.bin sessions.ttc
+
+#include <stdint.h>
+#include <stddef.h>
+#include "journal.h"
+#include "journal_view.h"
+
+#define COLUMNAR_MAGIC 0x43545454    // "TTTC"
+#define COLUMNAR_BLOCK_SIZE 4096
+
+typedef struct {
+    uint32_t magic;
+    uint32_t block_size;
+    uint32_t block_count;
+    uint32_t session_count;
+} columnar_header_t;
+
+typedef struct {
+    uint32_t offset;         // of the block data, from the start of the file
+    uint32_t count;
+    uint32_t start_min;
+    uint32_t start_max;
+    uint32_t duration_min;
+    uint32_t duration_max;
+    uint64_t activities;     // bit per activity below 64
+    uint8_t start_bits;
+    uint8_t duration_bits;
+    uint8_t activity_bits;
+    uint8_t reserved[5];
+} columnar_block_t;
+
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+    const columnar_header_t *header;
+    const columnar_block_t *blocks;
+} columnar_t;
+
+// Write the sessions of `journal` to a new columnar file. Returns 0 or -1,
+// reporting errors on stderr.
+int columnar_write(const journal_t *journal, const char *path);
+
+// Map a columnar file. Returns 0 or -1, reporting errors on stderr.
+int columnar_open(columnar_t *columnar, const char *path);
+void columnar_close(columnar_t *columnar);
+
+// Unpack block `b` into arrays of COLUMNAR_BLOCK_SIZE entries. Entries past
+// the block's sessions get a duration of 0 and activity 0xFF. Returns the
+// number of sessions.
+uint32_t columnar_read_block(const columnar_t *columnar, uint32_t b, uint32_t *start, uint32_t *duration,
+                             uint8_t *activity);
+
+// Same as journal_view_sum(), without assuming that start times never go
+// back: every block whose statistics allow a match is read.
+void columnar_sum(const columnar_t *columnar, const journal_view_filter_t *filter, journal_view_totals_t *totals);
@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "journal_view.h"
+#include "session_codec.h"
+
+static esp_err_t view_read(void *ctx, uint32_t offset, void *dst, size_t len)
+{
+    const journal_view_t *view = ctx;
+    if (offset + (uint64_t)len > view->size) return ESP_ERR_INVALID_SIZE;
+    memcpy(dst, view->data + offset, len);
+    return ESP_OK;
+}
+
+static esp_err_t view_write(void *ctx, uint32_t offset, const void *src, size_t len)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+static esp_err_t view_erase(void *ctx, uint32_t offset, size_t len)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+int journal_view_open(journal_view_t *view, const char *path)
+{
+    memset(view, 0, sizeof(*view));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < 2 * JOURNAL_PAGE_SIZE || st.st_size > UINT32_MAX) {
+        fprintf(stderr, "%s: not a partition image\n", path);
+        close(fd);
+        return -1;
+    }
+    view->size = st.st_size;
+    void *data = mmap(NULL, view->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror(path);
+        return -1;
+    }
+    view->data = data;
+
+    journal_flash_t flash = {
+        .size = view->size,
+        .read = view_read,
+        .write = view_write,
+        .erase = view_erase,
+        .ctx = view,
+        .mapped = view->data,
+    };
+    esp_err_t err = journal_open(&view->journal, &flash);
+    if (err != ESP_OK) {
+        fprintf(stderr, "%s: cannot open journal: error 0x%x\n", path, err);
+        munmap(data, view->size);
+        return -1;
+    }
+    return 0;
+}
+
+void journal_view_close(journal_view_t *view)
+{
+    journal_close(&view->journal);
+    munmap((void *)view->data, view->size);
+    view->data = NULL;
+}
+
+static bool filter_match(const journal_view_filter_t *f, const session_record_t *rec)
+{
+    if (rec->start < f->from) return false;
+    if (f->activities == 0) return true;
+    return rec->activity < 64 && (f->activities >> rec->activity & 1);
+}
+
+// Position to start reading from for `f`, the filter skips the sessions
+// before `from` in the first page
+static journal_pos_t filter_begin(const journal_t *j, const journal_view_filter_t *f)
+{
+    return journal_seek_page(j, f->from);
+}
+
+void journal_view_iter_init(journal_view_iter_t *it, const journal_view_t *view, const journal_view_filter_t *filter)
+{
+    it->filter = *filter;
+    journal_iter_init(&it->it, &view->journal, filter_begin(&view->journal, filter));
+}
+
+bool journal_view_next(journal_view_iter_t *it, session_record_t *rec)
+{
+    while (journal_iter_next(&it->it, rec, NULL)) {
+        if (it->filter.to && rec->start >= it->filter.to) return false;
+        if (filter_match(&it->filter, rec)) return true;
+    }
+    return false;
+}
+
+static void add(journal_view_totals_t *totals, const session_record_t *rec)
+{
+    if (rec->activity >= JOURNAL_VIEW_ACTIVITIES) return;
+    totals->sessions[rec->activity]++;
+    totals->seconds[rec->activity] += rec->duration;
+}
+
+// Sum page `seq`, which holds fixed records, through an iterator. Returns
+// false once past the end of the filter.
+static bool sum_fixed_page(const journal_t *j, uint32_t seq, const journal_view_filter_t *f,
+                           journal_view_totals_t *totals)
+{
+    journal_iter_t it;
+    session_record_t rec;
+    journal_pos_t pos;
+    journal_iter_init(&it, j, JOURNAL_POS(seq, JOURNAL_HEADER_SIZE));
+    while (journal_iter_next(&it, &rec, &pos) && JOURNAL_POS_SEQ(pos) == seq) {
+        if (f->to && rec.start >= f->to) return false;
+        if (filter_match(f, &rec)) add(totals, &rec);
+    }
+    return true;
+}
+
+// Sum varint page `seq` by decoding it in one go, as the iterator would
+// record by record. Returns false once past the end of the filter.
+static bool sum_varint_page(const journal_t *j, uint32_t seq, const uint8_t *page, const journal_view_filter_t *f,
+                            journal_view_totals_t *totals)
+{
+    const journal_page_header_t *hdr = (const journal_page_header_t *)page;
+    uint32_t to = f->to ? f->to : UINT32_MAX;
+    uint64_t activities = f->activities ? f->activities : UINT64_MAX;
+    uint32_t end = seq == j->head_seq ? j->head_offset : JOURNAL_PAGE_SIZE;
+    uint32_t prev_start = hdr->base_time;
+    session_record_t rec;
+    for (uint32_t offset = JOURNAL_HEADER_SIZE; offset < end;) {
+        uint32_t len = end - offset < SESSION_CODEC_MAX_SIZE ? end - offset : SESSION_CODEC_MAX_SIZE;
+        size_t n = session_decode(page + offset, len, prev_start, &rec);
+        if (n == 0) break;
+        offset += n;
+        prev_start = rec.start;
+        if (rec.start >= to) return false;
+        // Without branches, whether a session matches is as good as random.
+        // Varint activities are below 64.
+        uint64_t match = (activities >> rec.activity & 1) & (rec.start >= f->from);
+        totals->sessions[rec.activity] += match;
+        totals->seconds[rec.activity] += rec.duration & -match;
+    }
+    return true;
+}
+
+void journal_view_sum(const journal_view_t *view, const journal_view_filter_t *filter, journal_view_totals_t *totals)
+{
+    const journal_t *j = &view->journal;
+    memset(totals, 0, sizeof(*totals));
+    if (j->head_seq == 0) return;
+
+    // The first page is read from its start, the filter skips what comes
+    // before `from`
+    for (uint32_t seq = JOURNAL_POS_SEQ(filter_begin(j, filter)); seq <= j->head_seq; seq++) {
+        const uint8_t *page = view->data + (size_t)journal_page_index(j, seq) * JOURNAL_PAGE_SIZE;
+        const journal_page_header_t *hdr = (const journal_page_header_t *)page;
+        if (hdr->magic != JOURNAL_PAGE_MAGIC || hdr->seq != seq) continue;
+        bool more = hdr->format == JOURNAL_FORMAT_VARINT ? sum_varint_page(j, seq, page, filter, totals)
+                                                         : sum_fixed_page(j, seq, filter, totals);
+        if (!more) break;
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+// Read-only access to images of the sessions and archive partitions, for
+// analytics on the PC without going through the text export.
+//
+// The image is mapped with mmap(2) and read by the firmware's own journal and
+// session codec, so the host always reads exactly what the device writes.
+// Sessions are decoded where they lie in the mapping: nothing is copied out
+// or loaded up front, opening only reads the page headers.
+//
+//   journal_view_t view;
+//   journal_view_open(&view, "sessions.bin");
+//   journal_view_filter_t week = { .from = monday, .to = monday + 7 * 86400 };
+//   journal_view_totals_t totals;
+//   journal_view_sum(&view, &week, &totals);
+//   journal_view_close(&view);
+//
+// Time ranges are found through the journal's time index, which assumes
+// start times never go back (see journal_seek_time()).
+
+#include <stdint.h>
+#include <stddef.h>
+#include "journal.h"
+
+typedef struct {
+    journal_t journal;
+    const uint8_t *data;
+    size_t size;
+} journal_view_t;
+
+// Sessions starting in [from, to) with one of `activities`. All zeros
+// selects everything.
+typedef struct {
+    uint32_t from;
+    uint32_t to;             // 0 for no end
+    uint64_t activities;     // bit per activity, 0 for all
+} journal_view_filter_t;
+
+// Activities journal_view_sum() counts. Varint records cannot hold more,
+// higher ones only occur in the fixed records of old firmware.
+#define JOURNAL_VIEW_ACTIVITIES 64
+
+typedef struct {
+    uint64_t sessions[JOURNAL_VIEW_ACTIVITIES];
+    uint64_t seconds[JOURNAL_VIEW_ACTIVITIES];
+} journal_view_totals_t;
+
+typedef struct {
+    journal_iter_t it;
+    journal_view_filter_t filter;
+} journal_view_iter_t;
+
+// Map the image at `path` and open the journal in it, reporting errors on
+// stderr. Returns 0 or -1.
+int journal_view_open(journal_view_t *view, const char *path);
+void journal_view_close(journal_view_t *view);
+
+// Sessions matching `filter`, oldest first
+void journal_view_iter_init(journal_view_iter_t *it, const journal_view_t *view, const journal_view_filter_t *filter);
+bool journal_view_next(journal_view_iter_t *it, session_record_t *rec);
+
+// Number of sessions and their time per activity. Decodes whole pages at a
+// time rather than going through an iterator, two to three times faster.
+void journal_view_sum(const journal_view_t *view, const journal_view_filter_t *filter, journal_view_totals_t *totals);
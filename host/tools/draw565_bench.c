@@ -0,0 +1,224 @@
+// Compares the draw565 fill kernels with LVGL's own fills.
+//
+//   draw565_bench [milliseconds per measurement]
+//
+// LVGL is built for the host with the color settings of the firmware's
+// sdkconfig (16-bit, swapped, LV_COLOR_MIX_ROUND_OFS 128), and its fills are
+// run through lv_draw_sw_blend_basic() as the renderer calls them. Every
+// kernel gets the same destination and mask, must leave exactly the same
+// pixels, and is timed on a full screen, a label background and a heatmap
+// cell, at an odd x so rows do not start on a word boundary.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "lvgl.h"
+#include "src/draw/sw/lv_draw_sw.h"
+#include "draw565.h"
+
+#define BUF_W 320
+#define BUF_H 170
+
+typedef enum { OP_FILL, OP_OPA, OP_MASK, OP_MASK_OPA, OP_NOISE } op_t;
+
+static const char *const op_names[] = { "fill", "opa 128", "mask", "mask opa 128", "noise mask opa 200" };
+
+typedef struct {
+    const char *name;
+    int x, y, w, h;
+} area_t;
+
+static const area_t areas[] = {
+    { "320x170", 0, 0, 320, 170 },
+    { "140x80", 91, 45, 140, 80 },
+    { "11x11", 25, 13, 11, 11 },
+};
+
+static const draw565_kernels_t *const kernels[] = { &draw565_vector };
+#define KERNEL_COUNT (sizeof(kernels) / sizeof(kernels[0]))
+
+static lv_color_t start[BUF_W * BUF_H];
+static lv_color_t expect[BUF_W * BUF_H];
+static lv_color_t buf[BUF_W * BUF_H];
+static uint8_t mask[BUF_W * BUF_H];
+static lv_draw_ctx_t *draw_ctx;
+static lv_area_t buf_area = { 0, 0, BUF_W - 1, BUF_H - 1 };
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static uint32_t bench_rand(uint32_t *state)
+{
+    *state = *state * 1664525 + 1013904223;
+    return *state >> 8;
+}
+
+// An antialiased disc over the area: mostly all out or all in, like the
+// masks of rounded rectangles and arcs
+static void disc_mask(const area_t *a)
+{
+    float cx = (a->w - 1) / 2.0f, cy = (a->h - 1) / 2.0f;
+    float r = (a->w < a->h ? a->w : a->h) / 2.0f;
+    for (int y = 0; y < a->h; y++) {
+        for (int x = 0; x < a->w; x++) {
+            float dx = x - cx, dy = y - cy;
+            float d = r - __builtin_sqrtf(dx * dx + dy * dy);
+            mask[y * a->w + x] = d <= 0 ? 0 : d >= 1 ? 255 : (uint8_t)(d * 255);
+        }
+    }
+}
+
+static void noise_mask(const area_t *a, uint32_t *seed)
+{
+    for (int i = 0; i < a->w * a->h; i++) {
+        mask[i] = bench_rand(seed);
+    }
+}
+
+static void stock(op_t op, const area_t *a)
+{
+    lv_area_t area = { a->x, a->y, a->x + a->w - 1, a->y + a->h - 1 };
+    lv_draw_sw_blend_dsc_t dsc;
+    memset(&dsc, 0, sizeof(dsc));
+    dsc.blend_area = &area;
+    dsc.color = lv_color_hex(0x39D353);
+    dsc.opa = op == OP_OPA || op == OP_MASK_OPA ? 128 : op == OP_NOISE ? 200 : LV_OPA_COVER;
+    dsc.blend_mode = LV_BLEND_MODE_NORMAL;
+    if (op >= OP_MASK) {
+        dsc.mask_buf = mask;
+        dsc.mask_area = &area;
+        dsc.mask_res = LV_DRAW_MASK_RES_CHANGED;
+    }
+    draw_ctx->buf = buf;
+    lv_draw_sw_blend_basic(draw_ctx, &dsc);
+}
+
+static void kernel(const draw565_kernels_t *k, op_t op, const area_t *a)
+{
+    uint16_t *dst = (uint16_t *)buf + a->y * BUF_W + a->x;
+    uint16_t color = lv_color_hex(0x39D353).full;
+    switch (op) {
+    case OP_FILL:
+        k->fill(dst, BUF_W, a->w, a->h, color);
+        break;
+    case OP_OPA:
+        k->fill_opa(dst, BUF_W, a->w, a->h, color, 128);
+        break;
+    case OP_MASK:
+        k->fill_mask(dst, BUF_W, a->w, a->h, color, 255, mask, a->w);
+        break;
+    case OP_MASK_OPA:
+        k->fill_mask(dst, BUF_W, a->w, a->h, color, 128, mask, a->w);
+        break;
+    case OP_NOISE:
+        k->fill_mask(dst, BUF_W, a->w, a->h, color, 200, mask, a->w);
+        break;
+    }
+}
+
+// Average time of one fill in microseconds, the buffer is reset before each
+static double measure(const draw565_kernels_t *k, op_t op, const area_t *a, double budget_us)
+{
+    double total = 0;
+    int runs = 0;
+    while (total < budget_us || runs < 3) {
+        memcpy(buf, start, sizeof(buf));
+        double t0 = now_us();
+        if (k) {
+            kernel(k, op, a);
+        } else {
+            stock(op, a);
+        }
+        total += now_us() - t0;
+        runs++;
+    }
+    return total / runs;
+}
+
+static void init_lvgl(void)
+{
+    static lv_disp_draw_buf_t draw_buf;
+    static lv_disp_drv_t drv;
+    lv_init();
+    lv_disp_draw_buf_init(&draw_buf, buf, NULL, BUF_W * BUF_H);
+    lv_disp_drv_init(&drv);
+    drv.hor_res = BUF_W;
+    drv.ver_res = BUF_H;
+    drv.draw_buf = &draw_buf;
+    lv_disp_t *disp = lv_disp_drv_register(&drv);
+    // lv_draw_sw_blend_basic() looks at the driver being refreshed
+    _lv_refr_set_disp_refreshing(disp);
+    draw_ctx = drv.draw_ctx;
+    draw_ctx->buf_area = &buf_area;
+    draw_ctx->clip_area = &buf_area;
+}
+
+// draw565_mix() against lv_color_mix() for every background and opacity,
+// with a handful of foregrounds
+static int check_mix(void)
+{
+    uint32_t seed = 7;
+    for (int i = 0; i < 16; i++) {
+        lv_color_t fg = { .full = i == 0 ? 0x0000 : i == 1 ? 0xFFFF : bench_rand(&seed) };
+        for (uint32_t bg = 0; bg <= 0xFFFF; bg++) {
+            for (uint32_t a = 0; a <= 255; a++) {
+                lv_color_t b = { .full = bg };
+                uint16_t want = lv_color_mix(fg, b, a).full;
+                if (draw565_mix(fg.full, bg, a) != want) {
+                    printf("mix differs: fg %04x bg %04x opa %u\n", fg.full, bg, a);
+                    return 1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    double budget_us = (argc > 1 ? atof(argv[1]) : 50) * 1000;
+    init_lvgl();
+    int failed = check_mix();
+
+    uint32_t seed = 1;
+    for (int i = 0; i < BUF_W * BUF_H; i++) {
+        start[i].full = bench_rand(&seed);
+    }
+
+    printf("%-20s %-8s %9s", "", "", "stock");
+    for (size_t k = 0; k < KERNEL_COUNT; k++) {
+        printf(" %9s %6s", kernels[k]->name, "");
+    }
+    printf("\n");
+    for (op_t op = OP_FILL; op <= OP_NOISE; op++) {
+        for (size_t ai = 0; ai < sizeof(areas) / sizeof(areas[0]); ai++) {
+            const area_t *a = &areas[ai];
+            if (op == OP_NOISE) {
+                noise_mask(a, &seed);
+            } else {
+                disc_mask(a);
+            }
+            memcpy(buf, start, sizeof(buf));
+            stock(op, a);
+            memcpy(expect, buf, sizeof(buf));
+
+            double stock_us = measure(NULL, op, a, budget_us);
+            printf("%-20s %-8s %7.2fus", op_names[op], a->name, stock_us);
+            for (size_t k = 0; k < KERNEL_COUNT; k++) {
+                memcpy(buf, start, sizeof(buf));
+                kernel(kernels[k], op, a);
+                bool same = memcmp(buf, expect, sizeof(buf)) == 0;
+                failed |= !same;
+                double us = measure(kernels[k], op, a, budget_us);
+                printf(" %7.2fus %5.1fx%s", us, stock_us / us, same ? "" : "!");
+            }
+            printf("\n");
+        }
+    }
+    printf("%s\n", failed ? "MISMATCH: a kernel left other pixels than LVGL (marked !)" : "all kernels match LVGL");
+    return failed;
+}
@@ -0,0 +1,489 @@
+// Merges the session logs of many trackers, one per person, into one.
+//
+//   fleet_merge [-j threads] [-s] [person=]sessions.bin ...
+//   fleet_merge --bench [devices]
+//
+// Inputs are images of the sessions partition (esptool.py read_flash, see
+// journal_tool.c). The person is the file name up to its first dot unless
+// given before an '='. Several images of the same person, say dumps taken a
+// month apart, are merged and sessions found in more than one are counted
+// once.
+//
+// By default the output is the time and number of sessions per day (UTC, by
+// the day the session starts), person and activity:
+//
+//   day,person,activity,sessions,seconds
+//   2024-03-01,alice,0,3,7260
+//
+// With -s it is every session instead, oldest first:
+//
+//   start,duration,activity,person
+//
+// The history is cut into runs of whole days, which a pool of threads merge
+// independently: each one walks every image from the start of its run,
+// found through the journal's time index, with a heap holding the next
+// session of each image. Images are mapped, not loaded, so memory grows
+// with the number of images and threads, not with the length of the
+// history. Finished runs are written in order, and threads wait rather than
+// get more than a few runs ahead of the output.
+//
+// --bench synthesises a year of sessions for each of [devices] trackers
+// (1000 by default), a tenth of them with a second, older dump, and times
+// the merge with one to eight threads.
+
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "journal_view.h"
+#include "journal_image.h"
+#include "rollup.h"
+
+#define DAY 86400
+// Runs per thread, so threads that drew short runs find more work
+#define RUNS_PER_THREAD 4
+// Runs finished but not written yet, per thread
+#define AHEAD_PER_THREAD 2
+
+typedef struct {
+    journal_view_t view;
+    uint32_t person;
+} source_t;
+
+typedef struct {
+    char *text;
+    size_t len;
+    bool done;
+} run_out_t;
+
+typedef struct {
+    source_t *sources;
+    uint32_t source_count;
+    char **persons;          // sorted
+    uint32_t person_count;
+    bool sessions;           // -s
+
+    uint32_t first_day;
+    uint32_t run_days;
+    uint32_t run_count;
+
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    uint32_t next_run;       // next one for a thread to take
+    uint32_t written;        // runs written so far
+    uint32_t ahead;          // how far threads may get ahead of `written`
+    run_out_t *out;
+} fleet_t;
+
+typedef struct {
+    journal_view_iter_t it;
+    session_record_t rec;
+    uint32_t person;
+} cursor_t;
+
+// Heap entry. The start and person are copied in, so most comparisons do
+// not have to look at the cursor.
+typedef struct {
+    uint64_t key;            // start, then person
+    cursor_t *cursor;
+} entry_t;
+
+static entry_t entry(cursor_t *c)
+{
+    return (entry_t) { .key = (uint64_t)c->rec.start << 32 | c->person, .cursor = c };
+}
+
+// Heap order: start, then person, then the rest so that the same session
+// from two dumps comes out twice in a row
+static bool before(entry_t a, entry_t b)
+{
+    if (a.key != b.key) return a.key < b.key;
+    if (a.cursor->rec.activity != b.cursor->rec.activity) return a.cursor->rec.activity < b.cursor->rec.activity;
+    return a.cursor->rec.duration < b.cursor->rec.duration;
+}
+
+static void sift_down(entry_t *heap, uint32_t n, uint32_t i)
+{
+    entry_t e = heap[i];
+    for (;;) {
+        uint32_t child = 2 * i + 1;
+        if (child >= n) break;
+        if (child + 1 < n && before(heap[child + 1], heap[child])) child++;
+        if (!before(heap[child], e)) break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = e;
+}
+
+static void print_day(FILE *out, uint32_t day)
+{
+    time_t t = (time_t)day * DAY;
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    fprintf(out, "%04d-%02d-%02d", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday);
+}
+
+// Merge run `r` into `out`. Returns the number of sessions after removing
+// duplicates.
+static uint64_t merge_run(const fleet_t *f, uint32_t r, FILE *out, cursor_t *cursors, entry_t *heap,
+                          uint32_t (*totals)[2])
+{
+    uint32_t day0 = f->first_day + r * f->run_days;
+    uint64_t to = (uint64_t)(day0 + f->run_days) * DAY;
+    journal_view_filter_t filter = { .from = day0 * DAY, .to = to > UINT32_MAX ? 0 : to };
+
+    uint32_t n = 0;
+    for (uint32_t s = 0; s < f->source_count; s++) {
+        cursor_t *c = &cursors[s];
+        c->person = f->sources[s].person;
+        journal_view_iter_init(&c->it, &f->sources[s].view, &filter);
+        if (journal_view_next(&c->it, &c->rec)) {
+            heap[n++] = entry(c);
+        }
+    }
+    for (uint32_t i = n / 2; i-- > 0;) {
+        sift_down(heap, n, i);
+    }
+
+    size_t cells = (size_t)f->run_days * f->person_count * ROLLUP_MAX_ACTIVITIES;
+    if (!f->sessions) memset(totals, 0, cells * sizeof(*totals));
+    uint64_t count = 0;
+    cursor_t last = { .person = UINT32_MAX };
+    while (n > 0) {
+        cursor_t *c = heap[0].cursor;
+        if (c->person != last.person || c->rec.start != last.rec.start || c->rec.activity != last.rec.activity
+            || c->rec.duration != last.rec.duration) {
+            last.person = c->person;
+            last.rec = c->rec;
+            count++;
+            if (f->sessions) {
+                fprintf(out, "%u,%u,%u,%s\n", c->rec.start, c->rec.duration, c->rec.activity, f->persons[c->person]);
+            } else if (c->rec.activity < ROLLUP_MAX_ACTIVITIES) {
+                size_t day = c->rec.start / DAY - day0;
+                uint32_t *cell = totals[(day * f->person_count + c->person) * ROLLUP_MAX_ACTIVITIES + c->rec.activity];
+                cell[0]++;
+                cell[1] += c->rec.duration;
+            }
+        }
+        if (journal_view_next(&c->it, &c->rec)) {
+            heap[0] = entry(c);
+        } else {
+            heap[0] = heap[--n];
+        }
+        if (n > 0) sift_down(heap, n, 0);
+    }
+
+    if (!f->sessions) {
+        for (size_t i = 0; i < cells; i++) {
+            if (totals[i][0] == 0) continue;
+            uint32_t activity = i % ROLLUP_MAX_ACTIVITIES;
+            uint32_t person = i / ROLLUP_MAX_ACTIVITIES % f->person_count;
+            print_day(out, day0 + i / ROLLUP_MAX_ACTIVITIES / f->person_count);
+            fprintf(out, ",%s,%u,%u,%u\n", f->persons[person], activity, totals[i][0], totals[i][1]);
+        }
+    }
+    return count;
+}
+
+static void *merge_thread(void *arg)
+{
+    fleet_t *f = arg;
+    cursor_t *cursors = malloc(f->source_count * sizeof(*cursors));
+    entry_t *heap = malloc(f->source_count * sizeof(*heap));
+    uint32_t (*totals)[2] = malloc((size_t)f->run_days * f->person_count * ROLLUP_MAX_ACTIVITIES * sizeof(*totals));
+    if (!cursors || !heap || !totals) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    pthread_mutex_lock(&f->lock);
+    for (;;) {
+        while (f->next_run < f->run_count && f->next_run >= f->written + f->ahead) {
+            pthread_cond_wait(&f->changed, &f->lock);
+        }
+        if (f->next_run >= f->run_count) break;
+        uint32_t r = f->next_run++;
+        pthread_mutex_unlock(&f->lock);
+
+        run_out_t out = { 0 };
+        FILE *stream = open_memstream(&out.text, &out.len);
+        if (stream == NULL) {
+            perror("open_memstream");
+            exit(1);
+        }
+        merge_run(f, r, stream, cursors, heap, totals);
+        fclose(stream);
+
+        pthread_mutex_lock(&f->lock);
+        out.done = true;
+        f->out[r] = out;
+        pthread_cond_broadcast(&f->changed);
+    }
+    pthread_mutex_unlock(&f->lock);
+    free(cursors);
+    free(heap);
+    free(totals);
+    return NULL;
+}
+
+// Merge everything into `out` with `threads` threads
+static int merge(fleet_t *f, int threads, FILE *out)
+{
+    // Days the images cover
+    uint32_t first = UINT32_MAX, last = 0;
+    for (uint32_t s = 0; s < f->source_count; s++) {
+        const journal_t *j = &f->sources[s].view.journal;
+        if (j->head_seq == 0) continue;
+        journal_iter_t it;
+        session_record_t rec;
+        journal_iter_init(&it, j, journal_begin(j));
+        if (journal_iter_next(&it, &rec, NULL) && rec.start < first) first = rec.start;
+        if (j->last_end > last) last = j->last_end;
+    }
+    fprintf(out, f->sessions ? "start,duration,activity,person\n" : "day,person,activity,sessions,seconds\n");
+    if (first > last) return 0;
+
+    f->first_day = first / DAY;
+    uint32_t days = last / DAY - f->first_day + 1;
+    f->run_days = (days + threads * RUNS_PER_THREAD - 1) / (threads * RUNS_PER_THREAD);
+    f->run_count = (days + f->run_days - 1) / f->run_days;
+    f->next_run = 0;
+    f->written = 0;
+    f->ahead = threads * AHEAD_PER_THREAD;
+    f->out = calloc(f->run_count, sizeof(*f->out));
+    pthread_t *tids = malloc(threads * sizeof(*tids));
+    if (f->out == NULL || tids == NULL) return -1;
+    pthread_mutex_init(&f->lock, NULL);
+    pthread_cond_init(&f->changed, NULL);
+    for (int t = 0; t < threads; t++) {
+        pthread_create(&tids[t], NULL, merge_thread, f);
+    }
+
+    for (uint32_t r = 0; r < f->run_count; r++) {
+        pthread_mutex_lock(&f->lock);
+        while (!f->out[r].done) {
+            pthread_cond_wait(&f->changed, &f->lock);
+        }
+        pthread_mutex_unlock(&f->lock);
+        fwrite(f->out[r].text, 1, f->out[r].len, out);
+        free(f->out[r].text);
+        pthread_mutex_lock(&f->lock);
+        f->written++;
+        pthread_cond_broadcast(&f->changed);
+        pthread_mutex_unlock(&f->lock);
+    }
+
+    for (int t = 0; t < threads; t++) {
+        pthread_join(tids[t], NULL);
+    }
+    pthread_mutex_destroy(&f->lock);
+    pthread_cond_destroy(&f->changed);
+    free(tids);
+    free(f->out);
+    return 0;
+}
+
+static int compare_names(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// Open the images named by `args`, "[person=]path" each
+static int open_fleet(fleet_t *f, char **args, int count)
+{
+    f->sources = calloc(count, sizeof(*f->sources));
+    f->persons = calloc(count, sizeof(*f->persons));
+    char **names = calloc(count, sizeof(*names));
+    if (!f->sources || !f->persons || !names) return -1;
+
+    for (int i = 0; i < count; i++) {
+        const char *path = args[i];
+        char *eq = strchr(args[i], '=');
+        if (eq) {
+            names[i] = strndup(args[i], eq - args[i]);
+            path = eq + 1;
+        } else {
+            const char *base = strrchr(path, '/');
+            base = base ? base + 1 : path;
+            names[i] = strndup(base, strcspn(base, "."));
+        }
+        if (journal_view_open(&f->sources[i].view, path) != 0) return -1;
+    }
+    f->source_count = count;
+
+    memcpy(f->persons, names, count * sizeof(*names));
+    qsort(f->persons, count, sizeof(*f->persons), compare_names);
+    f->person_count = 0;
+    for (int i = 0; i < count; i++) {
+        if (f->person_count == 0 || strcmp(f->persons[f->person_count - 1], f->persons[i]) != 0) {
+            f->persons[f->person_count++] = f->persons[i];
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        char **p = bsearch(&names[i], f->persons, f->person_count, sizeof(*f->persons), compare_names);
+        f->sources[i].person = p - f->persons;
+    }
+    // Only one copy of each name is kept
+    for (int i = 0; i < count; i++) {
+        if (names[i] != f->persons[f->sources[i].person]) free(names[i]);
+    }
+    free(names);
+    return 0;
+}
+
+static void close_fleet(fleet_t *f)
+{
+    for (uint32_t s = 0; s < f->source_count; s++) {
+        journal_view_close(&f->sources[s].view);
+    }
+    for (uint32_t p = 0; p < f->person_count; p++) {
+        free(f->persons[p]);
+    }
+    free(f->sources);
+    free(f->persons);
+}
+
+// Small LCG, so the same arguments always give the same history
+static uint32_t synth_rand(uint32_t *state)
+{
+    *state = *state * 1103515245 + 12345;
+    return *state >> 8;
+}
+
+#define SYNTH_FIRST_DAY 1704067200    // 2024-01-01
+#define SYNTH_IMAGE_SIZE (64 * 1024)
+
+// A year of working days for tracker `device`, two to eight sessions a day
+// from about 8:00, or only the first `days` of it. Returns the number of
+// sessions.
+static int synth_device(const char *path, uint32_t device, uint32_t days)
+{
+    image_t img;
+    journal_t journal;
+    if (image_create(&img, SYNTH_IMAGE_SIZE) != 0 || image_open_journal(&img, &journal) != 0) return -1;
+    uint32_t seed = device + 1;
+    int count = 0;
+    for (uint32_t d = 0; d < days; d++) {
+        uint32_t t = SYNTH_FIRST_DAY + d * DAY + 8 * 3600 + synth_rand(&seed) % 3600;
+        uint32_t sessions = 2 + synth_rand(&seed) % 7;
+        for (uint32_t s = 0; s < sessions; s++) {
+            session_record_t rec = {
+                .start = t,
+                .duration = 300 + synth_rand(&seed) % 5400,
+                .activity = synth_rand(&seed) % 5,
+            };
+            if (journal_append(&journal, &rec) != ESP_OK) return -1;
+            t += rec.duration + synth_rand(&seed) % 1800;
+            count++;
+        }
+    }
+    journal_close(&journal);
+    int err = image_save(&img, path);
+    free(img.data);
+    return err == 0 ? count : -1;
+}
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int bench(uint32_t devices)
+{
+    char dir[] = "/tmp/fleet_XXXXXX";
+    if (mkdtemp(dir) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    uint32_t dumps = devices + devices / 10;
+    char **args = calloc(dumps, sizeof(*args));
+    uint64_t sessions = 0;
+    for (uint32_t d = 0; d < dumps; d++) {
+        // The second dumps come first, from earlier in the year
+        uint32_t device = d < devices / 10 ? d : d - devices / 10;
+        args[d] = malloc(strlen(dir) + 32);
+        sprintf(args[d], "%s/dev%u.%u.bin", dir, device, d);
+        int n = synth_device(args[d], device, d < devices / 10 ? 180 : 365);
+        if (n < 0) return 1;
+        if (d >= devices / 10) sessions += n;
+    }
+    fprintf(stderr, "%u trackers, %u images, %llu sessions\n", devices, dumps, (unsigned long long)sessions);
+
+    fleet_t f = { 0 };
+    if (open_fleet(&f, args, dumps) != 0) return 1;
+    FILE *null = fopen("/dev/null", "w");
+    fprintf(stderr, "threads  sessions: s  totals: s\n");
+    for (int threads = 1; threads <= 8; threads *= 2) {
+        double us[2];
+        for (int s = 0; s < 2; s++) {
+            f.sessions = s == 0;
+            double t0 = now_us();
+            if (merge(&f, threads, null) != 0) return 1;
+            us[s] = now_us() - t0;
+        }
+        fprintf(stderr, "%7d  %11.3f  %9.3f\n", threads, us[0] / 1e6, us[1] / 1e6);
+    }
+
+    // Every session once, the older dumps add nothing
+    char *text;
+    size_t len;
+    FILE *out = open_memstream(&text, &len);
+    f.sessions = true;
+    merge(&f, 4, out);
+    fclose(out);
+    uint64_t lines = 0;
+    for (size_t i = 0; i < len; i++) {
+        lines += text[i] == '\n';
+    }
+    free(text);
+    fclose(null);
+    close_fleet(&f);
+    for (uint32_t d = 0; d < dumps; d++) {
+        unlink(args[d]);
+        free(args[d]);
+    }
+    free(args);
+    rmdir(dir);
+    if (lines - 1 != sessions) {
+        fprintf(stderr, "merged %llu sessions, expected %llu\n", (unsigned long long)lines - 1,
+                (unsigned long long)sessions);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc >= 2 && strcmp(argv[1], "--bench") == 0) {
+        return bench(argc > 2 ? strtoul(argv[2], NULL, 0) : 1000);
+    }
+
+    fleet_t f = { 0 };
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        if (strcmp(argv[i], "-s") == 0) {
+            f.sessions = true;
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            threads = strtol(argv[++i], NULL, 0);
+        } else {
+            break;
+        }
+    }
+    if (i >= argc || threads < 1) {
+        fprintf(stderr, "usage: %s [-j threads] [-s] [person=]sessions.bin ... | --bench [devices]\n", argv[0]);
+        return 2;
+    }
+    if (open_fleet(&f, argv + i, argc - i) != 0) return 1;
+    int err = merge(&f, threads, stdout);
+    close_fleet(&f);
+    return err == 0 ? 0 : 1;
+}
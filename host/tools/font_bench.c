@@ -0,0 +1,174 @@
+// Compares the UI's subset fonts with the full Montserrat they are cut from.
+//
+//   font_bench [milliseconds per measurement]
+//
+// Every character the subset was cut for (ui_fonts_chars, from
+// font_subset.py) is drawn in a label on a host display of the panel's size,
+// alone and next to every other one so the kerning is covered too, once with
+// the full font and once with the subset, and both must leave exactly the
+// same pixels. Then setting all the characters as one text and redrawing the
+// label is timed with each. The flash the fonts take is reported by
+// font_subset.py when it generates them.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "lvgl.h"
+#include "ui_fonts.h"
+
+#define DISP_W 320
+#define DISP_H 170
+
+// Where each character of ui_fonts_chars starts, and the end
+#define MAX_CHARS 256
+static uint32_t char_at[MAX_CHARS + 1];
+static uint32_t char_count;
+
+typedef struct {
+    const char *name;
+    const lv_font_t *full;
+    const lv_font_t *subset;
+} font_pair_t;
+
+static const font_pair_t fonts[] = {
+    { "18", &lv_font_montserrat_18, &ui_font_18 },
+    { "14", &lv_font_montserrat_14, &ui_font_14 },
+};
+
+static lv_color_t draw_buf_pixels[DISP_W * DISP_H];
+static lv_color_t frame[DISP_W * DISP_H];
+static lv_color_t expect[DISP_W * DISP_H];
+static lv_disp_t *disp;
+static lv_obj_t *label;
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void flush_cb(lv_disp_drv_t *drv, const lv_area_t *area, lv_color_t *px)
+{
+    lv_coord_t w = lv_area_get_width(area);
+    for (lv_coord_t y = area->y1; y <= area->y2; y++, px += w) {
+        memcpy(&frame[y * DISP_W + area->x1], px, w * sizeof(lv_color_t));
+    }
+    lv_disp_flush_ready(drv);
+}
+
+static void draw(const lv_font_t *font, const char *text)
+{
+    lv_obj_set_style_text_font(label, font, LV_PART_MAIN);
+    lv_label_set_text(label, text);
+    lv_refr_now(disp);
+}
+
+// Whether `text` leaves the same pixels in both fonts
+static bool same_pixels(const font_pair_t *pair, const char *text)
+{
+    draw(pair->full, text);
+    memcpy(expect, frame, sizeof(frame));
+    draw(pair->subset, text);
+    if (memcmp(expect, frame, sizeof(frame)) == 0) return true;
+    printf("montserrat %s: \"%s\" differs from the full font\n", pair->name, text);
+    return false;
+}
+
+// Character i, or i and j, as a string
+static const char *chars(uint32_t i, uint32_t j, char *buf)
+{
+    size_t n = char_at[i + 1] - char_at[i];
+    memcpy(buf, &ui_fonts_chars[char_at[i]], n);
+    if (j < char_count) {
+        size_t m = char_at[j + 1] - char_at[j];
+        memcpy(buf + n, &ui_fonts_chars[char_at[j]], m);
+        n += m;
+    }
+    buf[n] = '\0';
+    return buf;
+}
+
+// Microseconds to set and draw all the characters once
+static double time_font(const lv_font_t *font, double ms)
+{
+    uint32_t rounds = 0;
+    double t0 = now_us(), t;
+    lv_obj_set_style_text_font(label, font, LV_PART_MAIN);
+    do {
+        lv_label_set_text(label, ui_fonts_chars);
+        lv_refr_now(disp);
+        rounds++;
+    } while ((t = now_us() - t0) < ms * 1000);
+    return t / rounds;
+}
+
+int main(int argc, char **argv)
+{
+    double ms = argc > 1 ? atof(argv[1]) : 300;
+
+    lv_init();
+    for (uint32_t at = 0; ui_fonts_chars[at] != '\0' && char_count < MAX_CHARS; char_count++) {
+        char_at[char_count] = at;
+        _lv_txt_encoded_next(ui_fonts_chars, &at);
+        char_at[char_count + 1] = at;
+    }
+
+    static lv_disp_draw_buf_t draw_buf;
+    lv_disp_draw_buf_init(&draw_buf, draw_buf_pixels, NULL, DISP_W * DISP_H);
+    static lv_disp_drv_t drv;
+    lv_disp_drv_init(&drv);
+    drv.hor_res = DISP_W;
+    drv.ver_res = DISP_H;
+    drv.flush_cb = flush_cb;
+    drv.draw_buf = &draw_buf;
+    disp = lv_disp_drv_register(&drv);
+    lv_disp_set_theme(disp, NULL);
+
+    lv_obj_t *scr = lv_disp_get_scr_act(disp);
+    lv_obj_set_style_bg_color(scr, lv_color_hex(0x000000), LV_PART_MAIN);
+    lv_obj_set_style_bg_opa(scr, LV_OPA_COVER, LV_PART_MAIN);
+    label = lv_label_create(scr);
+    lv_obj_set_size(label, DISP_W - 20, LV_SIZE_CONTENT);
+    lv_obj_set_style_text_color(label, lv_color_hex(0xFFFFFF), LV_PART_MAIN);
+    lv_obj_align(label, LV_ALIGN_CENTER, 0, 0);
+
+    int failed = 0;
+    char buf[16];
+    for (size_t f = 0; f < sizeof(fonts) / sizeof(fonts[0]); f++) {
+        uint32_t differ = 0;
+        for (uint32_t i = 0; i < char_count; i++) {
+            differ += !same_pixels(&fonts[f], chars(i, char_count, buf));
+            for (uint32_t j = 0; j < char_count; j++) {
+                differ += !same_pixels(&fonts[f], chars(i, j, buf));
+            }
+        }
+        differ += !same_pixels(&fonts[f], ui_fonts_chars);
+        if (differ) failed = 1;
+        printf("montserrat %s: %u characters, alone and in %u pairs, %u differ from the full font\n",
+               fonts[f].name, char_count, char_count * char_count, differ);
+
+        // Alternately, keeping the best of each, as the host is noisy
+        double full = 1e9, subset = 1e9;
+        for (int r = 0; r < 5; r++) {
+            double t = time_font(fonts[f].full, ms / 5);
+            if (t < full) full = t;
+            t = time_font(fonts[f].subset, ms / 5);
+            if (t < subset) subset = t;
+        }
+        printf("montserrat %s: all characters in %.1f us with the full font, %.1f us with the subset (%.2fx)\n",
+               fonts[f].name, full, subset, full / subset);
+    }
+
+    // A letter the UI never shows comes from the fallback, not as a gap
+    ui_fonts_stats_t before, after;
+    ui_fonts_stats_get(&before);
+    draw(&ui_font_18, "Zurich");
+    ui_fonts_stats_get(&after);
+    printf("\"Zurich\" in the subset: %u glyph lookups from the fallback, last U+%04X\n",
+           after.misses - before.misses, after.last_miss);
+    if (after.misses == before.misses) {
+        failed = 1;
+    }
+    return failed;
+}
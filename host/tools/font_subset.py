@@ -0,0 +1,267 @@
+#!/usr/bin/env python3
+"""Cut LVGL's built-in Montserrat fonts down to the glyphs the UI shows.
+
+Reads the lv_font_montserrat_*.c sources LVGL generated with lv_font_conv,
+keeps the glyphs of every string literal in the given UI sources (plus the
+digits, which the UI formats at run time) and writes one C file with the
+subset fonts. Glyph bitmaps, metrics and kerning are copied as they are, so a
+kept glyph draws exactly like in the full font; anything else falls through to
+the fallback font at run time. The characters every subset kept go into the
+same file as ui_fonts_chars, for font_bench to draw.
+
+    font_subset.py -o ui_fonts_data.c --source time_tracker.c ... \\
+        --font ui_font_18=lv_font_montserrat_18.c --font ui_font_14=...
+"""
+import argparse
+import os
+import re
+import sys
+
+ALWAYS = " 0123456789-"
+
+
+def c_strings(path):
+    """The text of the string literals in a C file, minus log messages and
+    printf conversions (those print digits, added separately)"""
+    text = re.sub(r"/\*.*?\*/", "", open(path, encoding="utf-8").read(), flags=re.S)
+    out = []
+    for line in text.splitlines():
+        line = re.sub(r"//.*", "", line)
+        if line.lstrip().startswith("#include") or re.search(r"\b(ESP_LOG\w|TRACE_LOG\w|printf)\s*\(", line):
+            continue
+        for lit in re.findall(r'"((?:\\.|[^"\\])*)"', line):
+            raw = bytes(lit, "utf-8").decode("unicode_escape").encode("latin-1").decode("utf-8")
+            out.append(re.sub(r"%[-+ #0]*\d*(?:\.\d+)?(?:hh|h|ll|l|z)?[a-zA-Z%]",
+                              lambda m: "%" if m.group() == "%%" else "", raw))
+    return "".join(out)
+
+
+def array(src, name):
+    m = re.search(r"\b%s\[\]\s*=\s*\{(.*?)\};" % name, src, re.S)
+    if not m:
+        sys.exit("font_subset: no %s[] in the font" % name)
+    body = re.sub(r"/\*.*?\*/", "", m.group(1), flags=re.S)
+    return [int(v, 0) for v in re.findall(r"-?(?:0x[0-9a-fA-F]+|\d+)", body)]
+
+
+def field(src, name):
+    m = re.search(r"\.%s\s*=\s*(-?\d+)" % name, src)
+    if not m:
+        sys.exit("font_subset: no .%s in the font" % name)
+    return int(m.group(1))
+
+
+class Font:
+    def __init__(self, path):
+        src = open(path, encoding="utf-8").read()
+        self.path = path
+        self.bitmap = array(src, "glyph_bitmap")
+        self.dsc = [tuple(int(v) for v in g) for g in re.findall(
+            r"\{\.bitmap_index = (\d+), \.adv_w = (\d+), \.box_w = (\d+), \.box_h = (\d+), "
+            r"\.ofs_x = (-?\d+), \.ofs_y = (-?\d+)\}", src)]
+        for name in ("bpp", "kern_scale", "line_height", "base_line", "underline_position",
+                     "underline_thickness", "left_class_cnt", "right_class_cnt"):
+            setattr(self, name, field(src, name))
+        if field(src, "bitmap_format") != 0 or field(src, "kern_classes") != 1:
+            sys.exit("font_subset: %s is compressed or has no kerning classes" % path)
+        self.kern_left = array(src, "kern_left_class_mapping")
+        self.kern_right = array(src, "kern_right_class_mapping")
+        self.kern_values = array(src, "kern_class_values")
+
+        # Code point to glyph id, from the two cmap types lv_font_conv uses
+        # for these fonts
+        self.gid = {}
+        self.cmap_bytes = 0
+        for cmap in re.findall(r"\{\s*(\.range_start.*?)\}", src, re.S):
+            get = lambda k: re.search(r"\.%s = (\w+)" % k, cmap).group(1)
+            start, length, gid = int(get("range_start")), int(get("range_length")), int(get("glyph_id_start"))
+            kind = get("type")
+            self.cmap_bytes += 20
+            if kind == "LV_FONT_FMT_TXT_CMAP_FORMAT0_TINY":
+                for i in range(length):
+                    self.gid[start + i] = gid + i
+            elif kind == "LV_FONT_FMT_TXT_CMAP_SPARSE_TINY":
+                rcps = array(src, get("unicode_list"))
+                self.cmap_bytes += 2 * len(rcps)
+                for i, rcp in enumerate(rcps):
+                    self.gid[start + rcp] = gid + i
+            else:
+                sys.exit("font_subset: %s has an unsupported cmap %s" % (path, kind))
+
+    def glyph_bitmap(self, gid):
+        _, _, w, h, _, _ = self.dsc[gid]
+        start = self.dsc[gid][0]
+        return self.bitmap[start:start + (w * h * self.bpp + 7) // 8]
+
+    def size(self):
+        """Bytes in flash of the tables lv_font_fmt_txt reads"""
+        return (len(self.bitmap) + 8 * len(self.dsc) + self.cmap_bytes
+                + len(self.kern_left) + len(self.kern_right) + len(self.kern_values))
+
+
+def rows(values, per_row=16):
+    return ",\n".join("    " + ", ".join(values[i:i + per_row]) for i in range(0, len(values), per_row))
+
+
+def subset(font, name, chars, fallback):
+    """C source of `font` cut down to `chars`, and its size in bytes"""
+    letters = sorted(c for c in {ord(c) for c in chars} if c in font.gid)
+    old = [0] + [font.gid[c] for c in letters]      # new glyph id -> old, 0 stays reserved
+
+    bitmap, dsc = [], ["    {.bitmap_index = 0, .adv_w = 0, .box_w = 0, .box_h = 0, .ofs_x = 0, .ofs_y = 0}"]
+    for g in old[1:]:
+        _, adv, w, h, x, y = font.dsc[g]
+        dsc.append("    {.bitmap_index = %d, .adv_w = %d, .box_w = %d, .box_h = %d, .ofs_x = %d, .ofs_y = %d}"
+                   % (len(bitmap), adv, w, h, x, y))
+        bitmap += font.glyph_bitmap(g)
+
+    # The ASCII letters through a direct table (id 0 where a letter was
+    # dropped), the rest through a sorted list
+    ascii_letters = [c for c in letters if c < 0x80]
+    other = [c for c in letters if c >= 0x80]
+    cmaps, tables, cmap_bytes = [], [], 0
+    if ascii_letters:
+        lo, hi = ascii_letters[0], ascii_letters[-1]
+        # One more 0: lv_font_fmt_txt reads the entry at range_length too
+        ofs = [0] * (hi - lo + 2)
+        for i, c in enumerate(ascii_letters):
+            ofs[c - lo] = i + 1
+        tables.append("static const uint8_t %s_ascii_ofs[] = {\n%s\n};\n" % (name, rows([str(v) for v in ofs])))
+        cmaps.append("    {\n        .range_start = %d, .range_length = %d, .glyph_id_start = 0,\n"
+                     "        .unicode_list = NULL, .glyph_id_ofs_list = %s_ascii_ofs, .list_length = %d,"
+                     " .type = LV_FONT_FMT_TXT_CMAP_FORMAT0_FULL\n    }" % (lo, hi - lo + 1, name, hi - lo + 1))
+        cmap_bytes += 20 + len(ofs)
+    if other:
+        tables.append("static const uint16_t %s_unicode_list[] = {\n%s\n};\n"
+                      % (name, rows(["0x%x" % (c - other[0]) for c in other], 8)))
+        cmaps.append("    {\n        .range_start = %d, .range_length = %d, .glyph_id_start = %d,\n"
+                     "        .unicode_list = %s_unicode_list, .glyph_id_ofs_list = NULL, .list_length = %d,"
+                     " .type = LV_FONT_FMT_TXT_CMAP_SPARSE_TINY\n    }"
+                     % (other[0], other[-1] - other[0] + 1, len(ascii_letters) + 1, name, len(other)))
+        cmap_bytes += 20 + 2 * len(other)
+
+    # Only the kerning classes of the kept glyphs, renumbered
+    def classes(mapping):
+        used = sorted({mapping[g] for g in old[1:]} - {0})
+        renum = {c: i + 1 for i, c in enumerate(used)}
+        return [0] + [renum.get(mapping[g], 0) for g in old[1:]], used
+    left, left_used = classes(font.kern_left)
+    right, right_used = classes(font.kern_right)
+    values = [font.kern_values[(l - 1) * font.right_class_cnt + (r - 1)] for l in left_used for r in right_used]
+    if not values:
+        values, left_used, right_used = [0], [0], [0]
+
+    size = len(bitmap) + 8 * len(dsc) + cmap_bytes + len(left) + len(right) + len(values)
+    shown = "".join(chr(c) for c in letters).replace("*/", "* /")
+    src = """
+/* %(name)s: %(count)d glyphs of %(font)s, %(size)d bytes instead of %(full)d
+ * %(shown)s
+ */
+static LV_ATTRIBUTE_LARGE_CONST const uint8_t %(name)s_bitmap[] = {
+%(bitmap)s
+};
+
+static const lv_font_fmt_txt_glyph_dsc_t %(name)s_glyph_dsc[] = {
+%(dsc)s
+};
+
+%(tables)s
+static const lv_font_fmt_txt_cmap_t %(name)s_cmaps[] = {
+%(cmaps)s
+};
+
+static const uint8_t %(name)s_kern_left[] = {
+%(left)s
+};
+
+static const uint8_t %(name)s_kern_right[] = {
+%(right)s
+};
+
+static const int8_t %(name)s_kern_values[] = {
+%(values)s
+};
+
+static const lv_font_fmt_txt_kern_classes_t %(name)s_kern = {
+    .class_pair_values = %(name)s_kern_values,
+    .left_class_mapping = %(name)s_kern_left,
+    .right_class_mapping = %(name)s_kern_right,
+    .left_class_cnt = %(left_cnt)d,
+    .right_class_cnt = %(right_cnt)d,
+};
+
+static lv_font_fmt_txt_glyph_cache_t %(name)s_cache;
+static const lv_font_fmt_txt_dsc_t %(name)s_dsc = {
+    .glyph_bitmap = %(name)s_bitmap,
+    .glyph_dsc = %(name)s_glyph_dsc,
+    .cmaps = %(name)s_cmaps,
+    .kern_dsc = &%(name)s_kern,
+    .kern_scale = %(kern_scale)d,
+    .cmap_num = %(cmap_num)d,
+    .bpp = %(bpp)d,
+    .kern_classes = 1,
+    .bitmap_format = 0,
+    .cache = &%(name)s_cache,
+};
+
+const lv_font_t %(name)s = {
+    .get_glyph_dsc = ui_fonts_get_glyph_dsc,
+    .get_glyph_bitmap = lv_font_get_bitmap_fmt_txt,
+    .line_height = %(line_height)d,
+    .base_line = %(base_line)d,
+    .subpx = LV_FONT_SUBPX_NONE,
+    .underline_position = %(underline_position)d,
+    .underline_thickness = %(underline_thickness)d,
+    .dsc = &%(name)s_dsc,
+    .fallback = %(fallback)s,
+};
+""" % dict(name=name, count=len(letters), font=os.path.basename(font.path), size=size, full=font.size(),
+           shown=shown, bitmap=rows(["0x%02x" % b for b in bitmap]) or "    0", dsc=",\n".join(dsc),
+           tables="\n".join(tables), cmaps=",\n".join(cmaps), left=rows([str(v) for v in left]),
+           right=rows([str(v) for v in right]), values=rows([str(v) for v in values]),
+           left_cnt=len(left_used), right_cnt=len(right_used), kern_scale=font.kern_scale,
+           cmap_num=len(cmaps), bpp=font.bpp, line_height=font.line_height, base_line=font.base_line,
+           underline_position=font.underline_position, underline_thickness=font.underline_thickness,
+           fallback="&" + fallback if fallback else "NULL")
+    missing = sorted({c for c in chars if ord(c) not in font.gid})
+    return src, size, missing
+
+
+def c_string(text):
+    """`text` as a C string literal, UTF-8 with octal escapes"""
+    return '"%s"' % "".join(chr(b) if 0x20 <= b < 0x7f and chr(b) not in '"\\?' else "\\%03o" % b
+                            for b in text.encode("utf-8"))
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("-o", "--output", required=True)
+    ap.add_argument("--font", action="append", required=True, metavar="NAME=FONT.c")
+    ap.add_argument("--source", action="append", default=[], metavar="FILE.c",
+                    help="UI source whose string literals are shown")
+    ap.add_argument("--chars", default="", help="more characters to keep")
+    ap.add_argument("--fallback", default="lv_font_unscii_8",
+                    help="font for the glyphs left out, empty for none")
+    args = ap.parse_args()
+
+    chars = ALWAYS + args.chars + "".join(c_strings(p) for p in args.source)
+    chars = "".join(sorted(set(c for c in chars if c >= " ")))
+    out = ['/* Generated by host/tools/font_subset.py, do not edit */\n#include "lvgl.h"\n#include "ui_fonts.h"\n']
+    kept = chars
+    for spec in args.font:
+        name, path = spec.split("=", 1)
+        font = Font(path)
+        src, size, missing = subset(font, name, chars, args.fallback)
+        out.append(src)
+        kept = "".join(c for c in kept if c not in missing)
+        print("font_subset: %s %d of %d glyphs, %d bytes instead of %d%s"
+              % (name, len(chars) - len(missing), len(font.dsc) - 1, size, font.size(),
+                 ", not in the font: " + repr("".join(missing)) if missing else ""))
+
+    out.append("\nconst char ui_fonts_chars[] = %s;\n" % c_string(kept))
+    with open(args.output, "w", encoding="utf-8") as f:
+        f.write("".join(out))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,270 @@
+// Power cut test for the journal: cuts the power at every byte of a run of
+// appends, then opens the journal again and checks what survived.
+//
+//   journal_faults
+//
+// The journal starts full with a few records of room left in its last page,
+// so the run wraps around the ring to the first page, recycling it, fills it
+// and goes on into the second. A cut lands between two bytes of a write, and
+// the byte being programmed when it hits gets only some of its bits. An erase
+// takes several steps of the budget, and one cut in between leaves the page
+// partly erased and partly old: such a cut is tried once with the start of
+// the page erased and once with its end. Every append that returned before
+// the cut must be readable afterwards, nothing else may show up, and the
+// journal must take new records again.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "journal.h"
+#include "journal_image.h"
+
+#define PAGES 4
+// Records the run writes into the second page, after the wrap
+#define RUN_PAST_WRAP 5
+// Records take at least four bytes
+#define MAX_RECORDS (PAGES * JOURNAL_PAGE_SIZE / 4)
+// Budget an erase takes, one step per 256 bytes of a page
+#define ERASE_STEPS 16
+
+// Flash that loses power after `budget` bytes have been written, an erase
+// counting ERASE_STEPS
+typedef struct {
+    journal_flash_t inner;
+    image_t *img;
+    int64_t budget;
+    bool erase_from_end;    // a cut erase has cleared the end of its range, not the start
+    bool cut_in_erase;      // the power went in the middle of an erase
+    uint32_t reads;
+} faulty_t;
+
+static esp_err_t faulty_read(void *ctx, uint32_t offset, void *dst, size_t len)
+{
+    faulty_t *f = ctx;
+    f->reads++;
+    return f->inner.read(f->inner.ctx, offset, dst, len);
+}
+
+static esp_err_t faulty_write(void *ctx, uint32_t offset, const void *src, size_t len)
+{
+    faulty_t *f = ctx;
+    if (f->budget >= (int64_t)len) {
+        f->budget -= len;
+        return f->inner.write(f->inner.ctx, offset, src, len);
+    }
+    if (f->budget > 0) {
+        f->inner.write(f->inner.ctx, offset, src, f->budget);
+    }
+    if (f->budget >= 0 && (size_t)f->budget < len) {
+        // Half programmed: only the low bits of the byte took
+        uint8_t partial = ((const uint8_t *)src)[f->budget] | 0xF0;
+        f->inner.write(f->inner.ctx, offset + f->budget, &partial, 1);
+    }
+    f->budget = -1;
+    return ESP_FAIL;
+}
+
+static esp_err_t faulty_erase(void *ctx, uint32_t offset, size_t len)
+{
+    faulty_t *f = ctx;
+    if (f->budget >= ERASE_STEPS) {
+        f->budget -= ERASE_STEPS;
+        return f->inner.erase(f->inner.ctx, offset, len);
+    }
+    if (f->budget > 0) {
+        // The steps done are erased, the rest still holds the old data
+        size_t done = len / ERASE_STEPS * f->budget;
+        memset(f->img->data + (f->erase_from_end ? offset + len - done : offset), 0xFF, done);
+        f->cut_in_erase = true;
+    }
+    f->budget = -1;
+    return ESP_FAIL;
+}
+
+static int open_faulty(image_t *img, faulty_t *f, int64_t budget, journal_t *journal)
+{
+    image_flash(img, &f->inner);
+    f->img = img;
+    f->budget = budget;
+    f->cut_in_erase = false;
+    f->reads = 0;
+    journal_flash_t flash = {
+        .size = img->size,
+        .read = faulty_read,
+        .write = faulty_write,
+        .erase = faulty_erase,
+        .ctx = f,
+    };
+    return journal_open(journal, &flash) == ESP_OK ? 0 : -1;
+}
+
+static session_record_t record(uint32_t i)
+{
+    return (session_record_t) {
+        .start = 1577836800 + i * 3600,
+        .duration = 600 + i % 1800,
+        .activity = i % 5,
+    };
+}
+
+static int read_all(const journal_t *journal, session_record_t *out)
+{
+    journal_iter_t it;
+    int n = 0;
+    journal_iter_init(&it, journal, journal_begin(journal));
+    while (n < MAX_RECORDS && journal_iter_next(&it, &out[n], NULL)) {
+        n++;
+    }
+    return n;
+}
+
+static bool same(const session_record_t *a, const session_record_t *b)
+{
+    return a->start == b->start && a->duration == b->duration && a->activity == b->activity;
+}
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+typedef struct {
+    uint32_t cuts, erase_cuts, failures, lost, garbage, torn;
+    uint32_t max_reads;
+    double max_us;
+} results_t;
+
+static image_t base, img;
+static uint32_t prefill, run;
+static bool *present;
+static session_record_t got[MAX_RECORDS], want[MAX_RECORDS];
+
+// Run the appends from `base` with the power cut after `cut` bytes, then
+// check what the journal holds. Returns whether the cut landed in an erase.
+static bool check_cut(int64_t cut, bool erase_from_end, results_t *res)
+{
+    faulty_t f = { .erase_from_end = erase_from_end };
+    journal_t journal;
+    memcpy(img.data, base.data, base.size);
+    if (open_faulty(&img, &f, cut, &journal) != 0) exit(1);
+    uint32_t acked = 0;
+    while (acked < run) {
+        session_record_t rec = record(prefill + acked);
+        if (journal_append(&journal, &rec) != ESP_OK) break;
+        acked++;
+    }
+    journal_close(&journal);
+    bool in_erase = f.cut_in_erase;
+    res->cuts++;
+    if (in_erase) res->erase_cuts++;
+
+    // Power back on
+    double t0 = now_us();
+    if (open_faulty(&img, &f, INT64_MAX, &journal) != 0) {
+        fprintf(stderr, "cut at byte %lld: journal does not open\n", (long long)cut);
+        res->failures++;
+        return in_erase;
+    }
+    double us = now_us() - t0;
+    if (us > res->max_us) res->max_us = us;
+    if (f.reads > res->max_reads) res->max_reads = f.reads;
+    res->torn += journal.torn;
+
+    // What a journal that never lost power holds once the append that
+    // was cut has completed. That append may have recycled the oldest
+    // page already, and its own record may or may not have made it.
+    uint32_t appended = acked < run ? acked + 1 : acked;
+    image_t ref_img;
+    journal_t ref;
+    if (image_create(&ref_img, base.size) != 0) exit(1);
+    memcpy(ref_img.data, base.data, base.size);
+    if (image_open_journal(&ref_img, &ref) != 0) exit(1);
+    for (uint32_t i = 0; i < appended; i++) {
+        session_record_t rec = record(prefill + i);
+        journal_append(&ref, &rec);
+    }
+    int n_want = read_all(&ref, want);
+    journal_close(&ref);
+    free(ref_img.data);
+
+    // Sessions are told apart by their start, one per hour
+    memset(present, 0, prefill + run);
+    int n_got = read_all(&journal, got);
+    for (int g = 0; g < n_got; g++) {
+        uint32_t i = (got[g].start - record(0).start) / 3600;
+        session_record_t expected = record(i < prefill + appended ? i : 0);
+        if (i < prefill + appended && same(&got[g], &expected) && (g == 0 || got[g].start > got[g - 1].start)) {
+            present[i] = true;
+        } else {
+            res->garbage++;
+        }
+    }
+    for (int w = 0; w < n_want; w++) {
+        uint32_t i = (want[w].start - record(0).start) / 3600;
+        if (i < prefill + acked && !present[i]) res->lost++;
+    }
+
+    // And it carries on
+    session_record_t next = record(prefill + run);
+    next.start = journal.last_end + 60;
+    bool resumed = journal_append(&journal, &next) == ESP_OK;
+    journal_close(&journal);
+    if (resumed && image_open_journal(&img, &journal) == 0) {
+        int n = read_all(&journal, got);
+        resumed = n > 0 && same(&got[n - 1], &next);
+        journal_close(&journal);
+    }
+    if (!resumed) {
+        fprintf(stderr, "cut at byte %lld%s: appending after recovery failed\n", (long long)cut,
+                erase_from_end ? " (end of the erase done)" : "");
+        res->failures++;
+    }
+    return in_erase;
+}
+
+int main(int argc, char **argv)
+{
+    journal_t journal;
+    if (image_create(&base, PAGES * JOURNAL_PAGE_SIZE) != 0 || image_open_journal(&base, &journal) != 0) return 1;
+    // Until the ring has wrapped once, and its last page has room for about
+    // five more sessions
+    while (journal.head_seq <= PAGES || journal.head_page != PAGES - 1
+           || JOURNAL_PAGE_SIZE - journal.head_offset > 5 * 6) {
+        session_record_t rec = record(prefill++);
+        if (journal_append(&journal, &rec) != ESP_OK) return 1;
+    }
+    journal_close(&journal);
+
+    // The run: around the ring into the first page, through it and a few
+    // records into the second. Bytes it writes, erases counted as
+    // ERASE_STEPS.
+    faulty_t f;
+    img = (image_t) { .data = malloc(base.size), .size = base.size };
+    memcpy(img.data, base.data, base.size);
+    if (open_faulty(&img, &f, INT64_MAX, &journal) != 0) return 1;
+    for (uint32_t past_wrap = 0; past_wrap < RUN_PAST_WRAP; run++) {
+        session_record_t rec = record(prefill + run);
+        if (journal_append(&journal, &rec) != ESP_OK) return 1;
+        if (journal.head_page == 1) past_wrap++;
+    }
+    journal_close(&journal);
+    int64_t run_bytes = INT64_MAX - f.budget;
+    present = malloc(prefill + run);
+
+    results_t res = { 0 };
+    for (int64_t cut = 0; cut <= run_bytes; cut++) {
+        if (check_cut(cut, false, &res)) {
+            check_cut(cut, true, &res);
+        }
+    }
+
+    printf("%u sessions, %u cuts over %lld bytes (%u in erases): %u acked sessions lost, %u garbage sessions, "
+           "%u torn records skipped, %u failures\n",
+           run, res.cuts, (long long)run_bytes, res.erase_cuts, res.lost, res.garbage, res.torn, res.failures);
+    printf("recovery: at most %u reads, %.0f us (%u pages)\n", res.max_reads, res.max_us, PAGES);
+    return res.lost || res.garbage || res.failures ? 1 : 0;
+}
@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "journal_image.h"
+
+static esp_err_t image_read(void *ctx, uint32_t offset, void *dst, size_t len)
+{
+    image_t *img = ctx;
+    if (offset + (uint64_t)len > img->size) return ESP_ERR_INVALID_SIZE;
+    memcpy(dst, img->data + offset, len);
+    img->reads++;
+    return ESP_OK;
+}
+
+// Like NOR flash, writes can only clear bits
+static esp_err_t image_write(void *ctx, uint32_t offset, const void *src, size_t len)
+{
+    image_t *img = ctx;
+    if (offset + (uint64_t)len > img->size) return ESP_ERR_INVALID_SIZE;
+    for (size_t i = 0; i < len; i++) {
+        img->data[offset + i] &= ((const uint8_t *)src)[i];
+    }
+    return ESP_OK;
+}
+
+static esp_err_t image_erase(void *ctx, uint32_t offset, size_t len)
+{
+    image_t *img = ctx;
+    if (offset % JOURNAL_PAGE_SIZE || len % JOURNAL_PAGE_SIZE || offset + (uint64_t)len > img->size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(img->data + offset, 0xFF, len);
+    return ESP_OK;
+}
+
+int image_load(image_t *img, const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    img->size = ftell(f);
+    img->reads = 0;
+    fseek(f, 0, SEEK_SET);
+    img->data = malloc(img->size);
+    if (!img->data || fread(img->data, 1, img->size, f) != img->size) {
+        fprintf(stderr, "%s: read failed\n", path);
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    return 0;
+}
+
+int image_create(image_t *img, uint32_t size)
+{
+    img->size = size;
+    img->reads = 0;
+    img->data = malloc(size);
+    if (!img->data) return -1;
+    memset(img->data, 0xFF, size);
+    return 0;
+}
+
+int image_save(const image_t *img, const char *path)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f || fwrite(img->data, 1, img->size, f) != img->size) {
+        perror(path);
+        if (f) fclose(f);
+        return -1;
+    }
+    return fclose(f);
+}
+
+void image_flash(image_t *img, journal_flash_t *flash)
+{
+    *flash = (journal_flash_t) {
+        .size = img->size,
+        .read = image_read,
+        .write = image_write,
+        .erase = image_erase,
+        .ctx = img,
+    };
+}
+
+int image_open_journal(image_t *img, journal_t *journal)
+{
+    journal_flash_t flash;
+    image_flash(img, &flash);
+    esp_err_t err = journal_open(journal, &flash);
+    if (err != ESP_OK) {
+        fprintf(stderr, "cannot open journal: error 0x%x\n", err);
+        return -1;
+    }
+    return 0;
+}
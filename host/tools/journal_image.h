@@ -0,0 +1,25 @@
+#pragma once
+
+// A copy of the sessions partition in memory, for the host tools
+
+#include <stdint.h>
+#include "journal.h"
+
+typedef struct {
+    uint8_t *data;
+    uint32_t size;
+    uint32_t reads;     // read calls, what a query costs on the device
+} image_t;
+
+int image_load(image_t *img, const char *path);
+
+// Blank (erased) image of `size` bytes
+int image_create(image_t *img, uint32_t size);
+
+int image_save(const image_t *img, const char *path);
+
+// Flash callbacks over the image
+void image_flash(image_t *img, journal_flash_t *flash);
+
+// Open the journal in the image, reporting errors on stderr
+int image_open_journal(image_t *img, journal_t *journal);
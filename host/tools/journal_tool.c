@@ -0,0 +1,1295 @@
+// Works on images of the sessions partition.
+//
+//   esptool.py read_flash 0x310000 0x400000 sessions.bin
+//   journal_tool export sessions.bin csv [cursor] > sessions.csv
+//   journal_tool synth sessions.bin <years>
+//   journal_tool compact sessions.bin archive.bin <days>
+//   journal_tool columnar sessions.bin sessions.ttc
+//   journal_tool check-export [years]
+//   journal_tool check-rollup
+//   journal_tool check-reconcile
+//   journal_tool check-compact
+//   journal_tool bench-seek
+//   journal_tool bench-boot
+//   journal_tool bench-codec
+//   journal_tool bench-read
+//   journal_tool bench-view [millions]
+//   journal_tool bench-columnar [millions]
+//
+// synth writes a reproducible synthetic history, a few sessions a day, to try
+// the tools and the firmware on (esptool.py write_flash) with a long history.
+// compact merges the sessions older than <days> into the archive image, as
+// the device does in the background. columnar converts an image to the
+// columnar format of host/analytics/columnar.h.
+// check-export exports a synthetic history from an image the ring has wrapped
+// around and compares it with the sessions written, then resumes from the
+// cursors of the lines and checks it continues exactly after them. It exits
+// non-zero on a mismatch, ctest runs it.
+// check-rollup compares the day, week and month rollups with the C library's
+// calendar up to 2105, and with sessions that cross their boundaries summed
+// directly. ctest runs it too.
+// check-reconcile restores the running session after a reset from the saved
+// copy, the journal and the RTC checkpoint as the firmware does, for the
+// checkpoint lost at power on, stopped, older than the journal and newer
+// than the copy. ctest runs it too.
+// check-compact runs the retention on a synthetic history, once cut short
+// between a page's archive records and its erase, and checks the journal
+// keeps the newest sessions unchanged and the archive the time per day and
+// activity of the others. ctest runs it too.
+// bench-seek compares finding a day through the time index with scanning the
+// log, on synthetic histories of up to ten years. bench-boot compares restoring
+// the totals from a snapshot with replaying the whole log, for up to a million
+// sessions. bench-codec measures the varint record encoding on a few kinds of
+// synthetic history: size per session and encode/decode speed. bench-read
+// compares reading through read() copies with reading a mapped image in place.
+// bench-view sums the time per activity of a large image (100 million
+// sessions by default) mapped through the host analytics library.
+// bench-columnar runs the same sums and a few filtered ones on the columnar
+// format, the image and its CSV export (10 million sessions by default).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "journal.h"
+#include "journal_export.h"
+#include "compact.h"
+#include "snapshot.h"
+#include "session_codec.h"
+#include "journal_image.h"
+#include "journal_view.h"
+#include "columnar.h"
+
+#define DEFAULT_IMAGE_SIZE (4 * 1024 * 1024)
+#define DEFAULT_ARCHIVE_SIZE (256 * 1024)
+
+// Same order as labels[] in main/time_tracker.c
+static const char *const activity_names[] = { "Work", "Study", "Exercise", "Reading", "Break" };
+#define ACTIVITY_COUNT (sizeof(activity_names) / sizeof(activity_names[0]))
+
+static const char *activity_name(uint8_t activity)
+{
+    return activity < ACTIVITY_COUNT ? activity_names[activity] : "?";
+}
+
+static void export_lines(const journal_t *journal, journal_export_format_t format, journal_pos_t from, FILE *out)
+{
+    char line[JOURNAL_EXPORT_LINE_MAX];
+    size_t len = journal_export_header(format, line, sizeof(line));
+    fwrite(line, 1, len, out);
+
+    journal_iter_t it;
+    session_record_t rec;
+    journal_pos_t pos;
+    journal_iter_init(&it, journal, from);
+    while (journal_iter_next(&it, &rec, &pos)) {
+        len = journal_export_record(format, &rec, pos, activity_name(rec.activity), line, sizeof(line));
+        fwrite(line, 1, len, out);
+    }
+}
+
+static int cmd_export(int argc, char **argv)
+{
+    journal_export_format_t format;
+    if (argc < 4 || !journal_export_parse_format(argv[3], &format)) {
+        fprintf(stderr, "usage: %s export <image> csv|json [cursor]\n", argv[0]);
+        return 2;
+    }
+    image_t img;
+    journal_t journal;
+    if (image_load(&img, argv[2]) != 0 || image_open_journal(&img, &journal) != 0) return 1;
+    export_lines(&journal, format, argc > 4 ? strtoul(argv[4], NULL, 0) : 0, stdout);
+    return 0;
+}
+
+// Small LCG, so the same arguments always give the same history
+static uint32_t synth_rand(uint32_t *state)
+{
+    *state = *state * 1103515245 + 12345;
+    return *state >> 8;
+}
+
+#define SYNTH_FIRST_DAY 1577836800    // 2020-01-01
+
+// Days starting at 8:00 UTC from SYNTH_FIRST_DAY, two to eight sessions each.
+// Returns the number of sessions or -1.
+static int synth_history(journal_t *journal, uint32_t years)
+{
+    uint32_t seed = 1;
+    uint32_t day = SYNTH_FIRST_DAY + 8 * 3600;
+    int count = 0;
+    for (uint32_t d = 0; d < years * 365; d++, day += 86400) {
+        uint32_t t = day + synth_rand(&seed) % 3600;
+        uint32_t sessions = 2 + synth_rand(&seed) % 7;
+        for (uint32_t s = 0; s < sessions; s++) {
+            session_record_t rec = {
+                .start = t,
+                .duration = 300 + synth_rand(&seed) % 5400,
+                .activity = synth_rand(&seed) % ACTIVITY_COUNT,
+            };
+            esp_err_t err = journal_append(journal, &rec);
+            if (err != ESP_OK) {
+                fprintf(stderr, "append failed: error 0x%x\n", err);
+                return -1;
+            }
+            t += rec.duration + synth_rand(&seed) % 1800;
+            count++;
+        }
+    }
+    return count;
+}
+
+static int cmd_synth(int argc, char **argv)
+{
+    if (argc < 4) {
+        fprintf(stderr, "usage: %s synth <image> <years> [size_kb]\n", argv[0]);
+        return 2;
+    }
+    image_t img;
+    journal_t journal;
+    if (image_create(&img, argc > 4 ? strtoul(argv[4], NULL, 0) * 1024 : DEFAULT_IMAGE_SIZE) != 0
+        || image_open_journal(&img, &journal) != 0) {
+        return 1;
+    }
+    int count = synth_history(&journal, strtoul(argv[3], NULL, 0));
+    if (count < 0) return 1;
+    fprintf(stderr, "%d sessions, %u pages, oldest page %u\n", count, journal.head_seq, journal.tail_seq);
+    return image_save(&img, argv[2]) == 0 ? 0 : 1;
+}
+
+static void add_totals(const journal_t *journal, uint64_t totals[ACTIVITY_COUNT])
+{
+    journal_iter_t it;
+    session_record_t rec;
+    journal_iter_init(&it, journal, journal_begin(journal));
+    while (journal_iter_next(&it, &rec, NULL)) {
+        if (rec.activity < ACTIVITY_COUNT) totals[rec.activity] += rec.duration;
+    }
+}
+
+// The export of `journal` from `from` on, in memory. Free the result.
+static char *export_text(const journal_t *journal, journal_export_format_t format, journal_pos_t from, size_t *len)
+{
+    char *text = NULL;
+    FILE *out = open_memstream(&text, len);
+    if (out == NULL) exit(1);
+    export_lines(journal, format, from, out);
+    fclose(out);
+    return text;
+}
+
+// One exported line, false if it does not parse
+static bool parse_line(journal_export_format_t format, const char *line, uint32_t *cursor,
+                       session_record_t *rec, char *name)
+{
+    unsigned c, s, d;
+    int n = format == JOURNAL_EXPORT_CSV
+            ? sscanf(line, "%u,%u,%u,%31[^\n]", &c, &s, &d, name)
+            : sscanf(line, "{\"cursor\":%u,\"start\":%u,\"duration\":%u,\"activity\":\"%31[^\"]", &c, &s, &d, name);
+    *cursor = c;
+    rec->start = s;
+    rec->duration = d;
+    return n == 4;
+}
+
+#define CHECK_EXPORT_IMAGE_SIZE (64 * 1024)
+// Resume from every this many lines, and from the last one
+#define CHECK_EXPORT_RESUME_STEP 97
+
+// Compares the export of one format with `all`, whose newest sessions the
+// journal holds. Returns the number of mismatches.
+static int check_export_format(const journal_t *journal, journal_export_format_t format,
+                               const session_record_t *all, int n_all)
+{
+    const char *fmt_name = format == JOURNAL_EXPORT_CSV ? "csv" : "json";
+    size_t len;
+    char *text = export_text(journal, format, 0, &len);
+    char header[JOURNAL_EXPORT_LINE_MAX];
+    size_t header_len = journal_export_header(format, header, sizeof(header));
+
+    // Line starts, and the end
+    int n = 0;
+    for (size_t i = header_len; i < len; i++) {
+        if (text[i] == '\n') n++;
+    }
+    size_t *line_at = malloc((n + 1) * sizeof(size_t));
+    uint32_t *cursors = malloc(n * sizeof(uint32_t));
+    line_at[0] = header_len;
+    for (int l = 0, i = header_len; l < n; i++) {
+        if (text[i] == '\n') line_at[++l] = i + 1;
+    }
+
+    int bad = 0;
+    if (n == 0 || n >= n_all) {
+        fprintf(stderr, "%s: %d sessions exported of %d written, the ring should have dropped some\n",
+                fmt_name, n, n_all);
+        bad++;
+    }
+    for (int l = 0; l < n && !bad; l++) {
+        session_record_t rec, want = all[n_all - n + l];
+        char name[32];
+        if (!parse_line(format, &text[line_at[l]], &cursors[l], &rec, name)
+            || rec.start != want.start || rec.duration != want.duration
+            || strcmp(name, activity_name(want.activity)) != 0 || (l > 0 && cursors[l] <= cursors[l - 1])) {
+            fprintf(stderr, "%s: line %d is %.*s", fmt_name, l + 1, (int)(line_at[l + 1] - line_at[l]),
+                    &text[line_at[l]]);
+            bad++;
+        }
+    }
+
+    // Resuming gives the header and exactly the lines after the cursor's
+    int resumes = 0;
+    for (int step = 0; step <= n / CHECK_EXPORT_RESUME_STEP + 1 && !bad; step++) {
+        int l = step * CHECK_EXPORT_RESUME_STEP < n ? step * CHECK_EXPORT_RESUME_STEP : n - 1;
+        size_t rlen;
+        char *rest = export_text(journal, format, cursors[l], &rlen);
+        size_t want_len = len - line_at[l + 1];
+        if (rlen != header_len + want_len || memcmp(rest + header_len, &text[line_at[l + 1]], want_len) != 0) {
+            fprintf(stderr, "%s: resuming from cursor %u (line %d) does not continue after it\n",
+                    fmt_name, cursors[l], l + 1);
+            bad++;
+        }
+        free(rest);
+        resumes++;
+    }
+
+    printf("%s: %d sessions, %zu bytes, resumed from %d cursors, %d mismatches\n", fmt_name, n, len, resumes, bad);
+    free(cursors);
+    free(line_at);
+    free(text);
+    return bad;
+}
+
+static int cmd_check_export(int argc, char **argv)
+{
+    uint32_t years = argc > 2 ? strtoul(argv[2], NULL, 0) : 10;
+
+    // Every session, from an image large enough to keep them all
+    image_t full_img;
+    journal_t full;
+    if (image_create(&full_img, DEFAULT_IMAGE_SIZE) != 0 || image_open_journal(&full_img, &full) != 0) return 1;
+    int count = synth_history(&full, years);
+    if (count < 0) return 1;
+    session_record_t *all = malloc(count * sizeof(session_record_t));
+    journal_iter_t it;
+    int n_all = 0;
+    journal_iter_init(&it, &full, journal_begin(&full));
+    while (n_all < count && journal_iter_next(&it, &all[n_all], NULL)) {
+        n_all++;
+    }
+    if (n_all != count || full.tail_seq != 1) {
+        fprintf(stderr, "the full image reads back %d of %d sessions\n", n_all, count);
+        return 1;
+    }
+
+    // The same history in an image the ring has wrapped around
+    image_t img;
+    journal_t journal;
+    if (image_create(&img, CHECK_EXPORT_IMAGE_SIZE) != 0 || image_open_journal(&img, &journal) != 0) return 1;
+    if (synth_history(&journal, years) != count) return 1;
+    printf("%u years, %d sessions, pages %u to %u in %u\n", years, count, journal.tail_seq, journal.head_seq,
+           journal.page_count);
+
+    int bad = check_export_format(&journal, JOURNAL_EXPORT_CSV, all, n_all)
+              + check_export_format(&journal, JOURNAL_EXPORT_JSON, all, n_all);
+    free(all);
+    return bad ? 1 : 0;
+}
+
+// check-rollup: the periods of every day from 2020 to the end of 2105, the
+// last month that fits in uint32_t time, and runs of sessions across a leap
+// February, 2^31 seconds and the February of 2100, which is not leap
+#define CHECK_ROLLUP_FIRST_DAY 18262    // 2020-01-01
+#define CHECK_ROLLUP_LAST_DAY 49673     // 2106-01-01
+#define CHECK_ROLLUP_RUN_DAYS 80
+#define CHECK_ROLLUP_MAX_SESSIONS 4096
+
+static const char *const period_names[ROLLUP_PERIOD_COUNT] = { "day", "week", "month" };
+
+// The periods around `now` from the C library's calendar
+static void reference_bounds(rollup_period_t period, uint32_t now, uint32_t *start, uint32_t *end)
+{
+    time_t t = now;
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    tm.tm_hour = tm.tm_min = tm.tm_sec = 0;
+    if (period == ROLLUP_WEEK) {
+        tm.tm_mday -= (tm.tm_wday + 6) % 7;     // back to Monday
+    } else if (period == ROLLUP_MONTH) {
+        tm.tm_mday = 1;
+    }
+    *start = timegm(&tm);
+    if (period == ROLLUP_DAY) {
+        tm.tm_mday += 1;
+    } else if (period == ROLLUP_WEEK) {
+        tm.tm_mday += 7;
+    } else {
+        tm.tm_mon += 1;
+    }
+    *end = timegm(&tm);
+}
+
+static int check_bounds(const rollup_t *r, uint32_t now)
+{
+    int bad = 0;
+    for (int p = 0; p < ROLLUP_PERIOD_COUNT; p++) {
+        uint32_t start, end;
+        reference_bounds(p, now, &start, &end);
+        if (r->start[p] != start || r->end[p] != end) {
+            if (bad == 0) {
+                fprintf(stderr, "%u: %s is %u to %u, not %u to %u\n", now, period_names[p], r->start[p], r->end[p],
+                        start, end);
+            }
+            bad++;
+        }
+    }
+    return bad;
+}
+
+// Sessions of up to two days finishing one after another from `first_day`,
+// each added as the device adds them, the rollup compared with the sessions
+// summed over the reference periods after each one
+static int check_rollup_run(uint32_t first_day, uint32_t *seed, uint32_t *sessions)
+{
+    static session_record_t recs[CHECK_ROLLUP_MAX_SESSIONS];
+    uint32_t t = first_day * 86400;
+    uint32_t last = t + CHECK_ROLLUP_RUN_DAYS * 86400;
+    rollup_t r;
+    rollup_init(&r, t);
+    int n = 0, oldest = 0, bad = 0;
+    while (t < last && n < CHECK_ROLLUP_MAX_SESSIONS) {
+        session_record_t *rec = &recs[n++];
+        rec->start = t;
+        rec->duration = synth_rand(seed) % 4 == 0 ? synth_rand(seed) % (2 * 86400) : 300 + synth_rand(seed) % 7200;
+        rec->activity = synth_rand(seed) % ROLLUP_MAX_ACTIVITIES;
+        uint32_t now = rec->start + rec->duration;
+        rollup_advance(&r, now);
+        rollup_add(&r, rec);
+        t = now + synth_rand(seed) % 20000;
+
+        bad += check_bounds(&r, now);
+        uint32_t from = UINT32_MAX;
+        for (int p = 0; p < ROLLUP_PERIOD_COUNT; p++) {
+            uint32_t start, end;
+            reference_bounds(p, now, &start, &end);
+            if (start < from) from = start;
+            uint64_t want[ROLLUP_MAX_ACTIVITIES] = {0};
+            for (int i = oldest; i < n; i++) {
+                uint32_t s = recs[i].start > start ? recs[i].start : start;
+                uint32_t e = recs[i].start + recs[i].duration < end ? recs[i].start + recs[i].duration : end;
+                if (e > s) want[recs[i].activity] += e - s;
+            }
+            for (int a = 0; a < ROLLUP_MAX_ACTIVITIES; a++) {
+                if (r.seconds[p][a] != want[a]) {
+                    if (bad == 0) {
+                        fprintf(stderr, "%u: %s has %u s of activity %d, not %llu\n", now, period_names[p],
+                                r.seconds[p][a], a, (unsigned long long)want[a]);
+                    }
+                    bad++;
+                }
+            }
+        }
+        // Sessions ended before every current period are done with
+        while (recs[oldest].start + recs[oldest].duration <= from) {
+            oldest++;
+        }
+    }
+    *sessions += n;
+    return bad;
+}
+
+static int cmd_check_rollup(int argc, char **argv)
+{
+    int bad = 0;
+    uint32_t times = 0;
+    static const uint32_t offsets[] = { 0, 1, 43200, 86399 };
+    for (uint32_t day = CHECK_ROLLUP_FIRST_DAY; day < CHECK_ROLLUP_LAST_DAY; day++) {
+        for (size_t i = 0; i < sizeof(offsets) / sizeof(offsets[0]); i++) {
+            rollup_t r;
+            rollup_init(&r, day * 86400 + offsets[i]);
+            bad += check_bounds(&r, day * 86400 + offsets[i]);
+            times++;
+        }
+    }
+    printf("periods: %u times from 2020 to 2105, %d mismatches\n", times, bad);
+
+    static const uint32_t run_days[] = {
+        18250,      // 2019-12-20, over the leap February of 2020
+        24825,      // 2037-12-20, over 2^31 on 2038-01-19
+        47501,      // 2100-01-20, over the February of 2100
+    };
+    int run_bad = 0;
+    uint32_t seed = 1, sessions = 0;
+    for (size_t i = 0; i < sizeof(run_days) / sizeof(run_days[0]); i++) {
+        run_bad += check_rollup_run(run_days[i], &seed, &sessions);
+    }
+    printf("sessions: %u in %zu runs of %u days, %d mismatches\n", sessions, sizeof(run_days) / sizeof(run_days[0]),
+           CHECK_ROLLUP_RUN_DAYS, run_bad);
+    return bad || run_bad ? 1 : 0;
+}
+
+// check-reconcile: session A is in the journal, B has started and the copy
+// saved with it says so. Then B may reach the journal, the device resets and
+// finds, or not, a checkpoint. Times from 2040, past 2^31.
+#define CHECK_RECONCILE_T0 2208988800u     // 2040-01-01
+
+typedef struct {
+    const char *name;
+    bool b_recorded;        // B finished and reached the journal before the reset
+    bool checkpoint;        // false after power on
+    uint8_t cp_activity;
+    uint32_t cp_start;
+    uint8_t want_activity;  // running after the restore
+    uint32_t want_start;
+} reconcile_case_t;
+
+static const reconcile_case_t reconcile_cases[] = {
+    { "power on, B running", false, false, 0, 0, 1, CHECK_RECONCILE_T0 + 7200 },
+    { "power on, B recorded", true, false, 0, 0, SNAPSHOT_NOT_RUNNING, 0 },
+    { "checkpoint of B, older than the journal", true, true, 1, CHECK_RECONCILE_T0 + 7200, SNAPSHOT_NOT_RUNNING, 0 },
+    { "checkpoint not running, B not recorded", false, true, SNAPSHOT_NOT_RUNNING, 0, SNAPSHOT_NOT_RUNNING, 0 },
+    { "checkpoint of C, started as B was recorded", true, true, 2, CHECK_RECONCILE_T0 + 9000, 2,
+      CHECK_RECONCILE_T0 + 9000 },
+    { "checkpoint of C, B not recorded", false, true, 2, CHECK_RECONCILE_T0 + 9000, 2, CHECK_RECONCILE_T0 + 9000 },
+    { "checkpoint of an unknown activity", false, true, ROLLUP_MAX_ACTIVITIES, CHECK_RECONCILE_T0 + 9000, 1,
+      CHECK_RECONCILE_T0 + 7200 },
+};
+
+// A session started and finished as the store runs them: the copy is saved
+// when it starts, the journal gets it when it ends
+static int store_start(snapshot_t *snap, journal_meta_t *meta, const journal_t *journal, const session_record_t *rec)
+{
+    snap->running_activity = rec->activity;
+    snap->running_start = rec->start;
+    rollup_advance(&snap->rollup, rec->start);
+    return snapshot_save(snap, meta, journal) == ESP_OK ? 0 : -1;
+}
+
+static int store_record(snapshot_t *snap, journal_t *journal, const session_record_t *rec)
+{
+    if (journal_append(journal, rec) != ESP_OK) return -1;
+    rollup_advance(&snap->rollup, rec->start + rec->duration);
+    snapshot_add(snap, rec);
+    return 0;
+}
+
+static int cmd_check_reconcile(int argc, char **argv)
+{
+    const session_record_t a = { .start = CHECK_RECONCILE_T0, .duration = 3600, .activity = 0 };
+    const session_record_t b = { .start = CHECK_RECONCILE_T0 + 7200, .duration = 1800, .activity = 1 };
+    int bad = 0;
+    for (size_t i = 0; i < sizeof(reconcile_cases) / sizeof(reconcile_cases[0]); i++) {
+        const reconcile_case_t *c = &reconcile_cases[i];
+        image_t img, meta_img;
+        journal_t journal;
+        journal_meta_t meta;
+        journal_flash_t flash;
+        snapshot_t snap;
+        if (image_create(&img, 4 * JOURNAL_PAGE_SIZE) != 0 || image_open_journal(&img, &journal) != 0
+            || image_create(&meta_img, 2 * JOURNAL_PAGE_SIZE) != 0) {
+            return 1;
+        }
+        image_flash(&meta_img, &flash);
+        snapshot_init(&snap, a.start);
+        if (journal_meta_open(&meta, &flash) != ESP_OK || store_start(&snap, &meta, &journal, &a) != 0
+            || store_record(&snap, &journal, &a) != 0 || store_start(&snap, &meta, &journal, &b) != 0
+            || (c->b_recorded && store_record(&snap, &journal, &b) != 0)) {
+            return 1;
+        }
+        journal_close(&journal);
+
+        // The reset: everything from flash again
+        if (image_open_journal(&img, &journal) != 0 || journal_meta_open(&meta, &flash) != ESP_OK) return 1;
+        snapshot_restore(&snap, &meta, &journal, b.start + b.duration, NULL);
+        if (c->checkpoint) {
+            snapshot_reconcile(&snap, c->cp_activity, c->cp_start, journal.last_end);
+        }
+        bool ok = snap.running_activity == c->want_activity
+                  && (c->want_activity == SNAPSHOT_NOT_RUNNING || snap.running_start == c->want_start);
+        printf("%-45s running %3d since %10u  %s\n", c->name, snap.running_activity,
+               snap.running_activity == SNAPSHOT_NOT_RUNNING ? 0 : snap.running_start, ok ? "ok" : "WRONG");
+        bad += !ok;
+        journal_close(&journal);
+        free(img.data);
+        free(meta_img.data);
+    }
+    return bad ? 1 : 0;
+}
+
+// Run the retention the device runs in the background, on images
+static int cmd_compact(int argc, char **argv)
+{
+    if (argc < 5) {
+        fprintf(stderr, "usage: %s compact <image> <archive> <days>\n", argv[0]);
+        return 2;
+    }
+    image_t img, archive_img;
+    journal_t journal, archive;
+    if (image_load(&img, argv[2]) != 0 || image_open_journal(&img, &journal) != 0) return 1;
+    if (image_load(&archive_img, argv[3]) != 0) {
+        fprintf(stderr, "creating %s\n", argv[3]);
+        if (image_create(&archive_img, DEFAULT_ARCHIVE_SIZE) != 0) return 1;
+    }
+    if (image_open_journal(&archive_img, &archive) != 0) return 1;
+
+    uint64_t before_totals[ACTIVITY_COUNT] = {0};
+    uint64_t after_totals[ACTIVITY_COUNT] = {0};
+    add_totals(&journal, before_totals);
+    add_totals(&archive, before_totals);
+
+    // Relative to the newest session, the image has no clock
+    uint32_t age = strtoul(argv[4], NULL, 0) * 86400;
+    uint32_t cutoff = journal.last_end > age ? journal.last_end - age : 0;
+    compact_stats_t stats = {0};
+    esp_err_t err;
+    while ((err = compact_oldest_page(&journal, &archive, cutoff, &stats)) == ESP_OK) {
+    }
+    if (err != ESP_ERR_NOT_FOUND) {
+        fprintf(stderr, "compaction failed: error 0x%x\n", err);
+        return 1;
+    }
+
+    add_totals(&journal, after_totals);
+    add_totals(&archive, after_totals);
+    if (memcmp(before_totals, after_totals, sizeof(before_totals)) != 0) {
+        fprintf(stderr, "totals changed\n");
+        return 1;
+    }
+    printf("%u pages erased, %u sessions merged into %u records, %u bytes reclaimed\n",
+           stats.pages_erased, stats.sessions_merged, stats.records_written, stats.bytes_reclaimed);
+    return image_save(&img, argv[2]) == 0 && image_save(&archive_img, argv[3]) == 0 ? 0 : 1;
+}
+
+// check-compact: the retention on a synthetic history, with a reset between
+// a page's archive records and its erase
+#define CHECK_COMPACT_YEARS 3
+#define CHECK_COMPACT_AGE_DAYS 90
+// The page whose erase is undone
+#define CHECK_COMPACT_RESET_PAGE 5
+
+static int cmd_check_compact(int argc, char **argv)
+{
+    image_t img, archive_img;
+    journal_t journal, archive;
+    if (image_create(&img, DEFAULT_IMAGE_SIZE) != 0 || image_open_journal(&img, &journal) != 0
+        || image_create(&archive_img, DEFAULT_ARCHIVE_SIZE) != 0 || image_open_journal(&archive_img, &archive) != 0) {
+        return 1;
+    }
+    int count = synth_history(&journal, CHECK_COMPACT_YEARS);
+    if (count < 0) return 1;
+    session_record_t *all = malloc(count * sizeof(session_record_t));
+    journal_iter_t it;
+    int n_all = 0;
+    journal_iter_init(&it, &journal, journal_begin(&journal));
+    while (n_all < count && journal_iter_next(&it, &all[n_all], NULL)) {
+        n_all++;
+    }
+    if (n_all != count || journal.tail_seq != 1) {
+        fprintf(stderr, "the image reads back %d of %d sessions\n", n_all, count);
+        return 1;
+    }
+
+    uint32_t cutoff = journal.last_end - CHECK_COMPACT_AGE_DAYS * 86400;
+    compact_stats_t stats = {0};
+    uint8_t *before_erase = malloc(img.size);
+    esp_err_t err;
+    for (uint32_t page = 1;; page++) {
+        if (page == CHECK_COMPACT_RESET_PAGE) memcpy(before_erase, img.data, img.size);
+        err = compact_oldest_page(&journal, &archive, cutoff, &stats);
+        if (err != ESP_OK) break;
+        if (page == CHECK_COMPACT_RESET_PAGE) {
+            // Power lost before the erase: the page is still there, its
+            // records already in the archive
+            memcpy(img.data, before_erase, img.size);
+            journal_close(&journal);
+            journal_close(&archive);
+            if (image_open_journal(&img, &journal) != 0 || image_open_journal(&archive_img, &archive) != 0) return 1;
+        }
+    }
+    free(before_erase);
+    if (err != ESP_ERR_NOT_FOUND) {
+        fprintf(stderr, "compaction failed: error 0x%x\n", err);
+        return 1;
+    }
+
+    int bad = 0;
+    // The journal keeps the newest sessions as they were written
+    int kept = 0;
+    session_record_t rec;
+    journal_iter_init(&it, &journal, journal_begin(&journal));
+    while (journal_iter_next(&it, &rec, NULL)) {
+        kept++;
+    }
+    int first = n_all - kept;
+    journal_iter_init(&it, &journal, journal_begin(&journal));
+    for (int i = first; i < n_all && journal_iter_next(&it, &rec, NULL); i++) {
+        if (rec.start != all[i].start || rec.duration != all[i].duration || rec.activity != all[i].activity) {
+            if (bad == 0) fprintf(stderr, "journal: session %d changed\n", i);
+            bad++;
+        }
+    }
+    if (kept == n_all || all[first - 1].start + all[first - 1].duration >= cutoff) {
+        fprintf(stderr, "journal: %d of %d sessions kept, before the cutoff\n", kept, n_all);
+        bad++;
+    }
+
+    // The archive holds the others, in start order, their time per day and
+    // activity unchanged
+    uint32_t days = CHECK_COMPACT_YEARS * 366;
+    uint64_t (*want)[ACTIVITY_COUNT] = calloc(days, sizeof(*want));
+    uint64_t (*got)[ACTIVITY_COUNT] = calloc(days, sizeof(*got));
+    for (int i = 0; i < first; i++) {
+        want[(all[i].start - SYNTH_FIRST_DAY) / 86400][all[i].activity] += all[i].duration;
+    }
+    uint32_t records = 0, prev = 0;
+    journal_iter_init(&it, &archive, journal_begin(&archive));
+    while (journal_iter_next(&it, &rec, NULL)) {
+        uint32_t day = (rec.start - SYNTH_FIRST_DAY) / 86400;
+        if (rec.start < prev || rec.start < SYNTH_FIRST_DAY || day >= days || rec.activity >= ACTIVITY_COUNT) {
+            if (bad == 0) fprintf(stderr, "archive: record %u out of order or range\n", records);
+            bad++;
+            continue;
+        }
+        got[day][rec.activity] += rec.duration;
+        prev = rec.start;
+        records++;
+    }
+    for (uint32_t d = 0; d < days; d++) {
+        for (uint32_t a = 0; a < ACTIVITY_COUNT; a++) {
+            if (got[d][a] != want[d][a]) {
+                if (bad == 0) {
+                    fprintf(stderr, "archive: day %u activity %u has %llu s, not %llu\n", d, a,
+                            (unsigned long long)got[d][a], (unsigned long long)want[d][a]);
+                }
+                bad++;
+            }
+        }
+    }
+
+    printf("%d sessions: %d archived in %u records over %u pages, %d kept, a reset before erasing page %d, "
+           "%d mismatches\n",
+           n_all, first, records, journal.tail_seq - 1, kept, CHECK_COMPACT_RESET_PAGE, bad);
+    free(want);
+    free(got);
+    free(all);
+    return bad ? 1 : 0;
+}
+
+static int cmd_columnar(int argc, char **argv)
+{
+    if (argc < 4) {
+        fprintf(stderr, "usage: %s columnar <image> <out>\n", argv[0]);
+        return 2;
+    }
+    journal_view_t view;
+    if (journal_view_open(&view, argv[2]) != 0) return 1;
+    int err = columnar_write(&view.journal, argv[3]);
+    journal_view_close(&view);
+    return err == 0 ? 0 : 1;
+}
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// Sessions of one day, found with the index or by reading from the start
+static int query_day(const journal_t *journal, uint32_t day, bool indexed)
+{
+    journal_iter_t it;
+    session_record_t rec;
+    int n = 0;
+    journal_iter_init(&it, journal, indexed ? journal_seek_time(journal, day) : journal_begin(journal));
+    while (journal_iter_next(&it, &rec, NULL) && rec.start < day + 86400) {
+        if (rec.start >= day) n++;
+    }
+    return n;
+}
+
+static int cmd_bench_seek(int argc, char **argv)
+{
+    static const uint32_t history_years[] = { 1, 2, 5, 10 };
+    const int queries = 1000;
+
+    printf("years sessions  index: us/query reads/query  scan: us/query reads/query\n");
+    for (size_t h = 0; h < sizeof(history_years) / sizeof(history_years[0]); h++) {
+        uint32_t years = history_years[h];
+        image_t img;
+        journal_t journal;
+        if (image_create(&img, DEFAULT_IMAGE_SIZE) != 0 || image_open_journal(&img, &journal) != 0) return 1;
+        int count = synth_history(&journal, years);
+        if (count < 0) return 1;
+
+        double us[2];
+        double reads[2];
+        int found[2];
+        for (int indexed = 1; indexed >= 0; indexed--) {
+            uint32_t seed = 7;
+            found[indexed] = 0;
+            img.reads = 0;
+            double t0 = now_us();
+            for (int q = 0; q < queries; q++) {
+                uint32_t day = SYNTH_FIRST_DAY + synth_rand(&seed) % (years * 365) * 86400;
+                found[indexed] += query_day(&journal, day, indexed);
+            }
+            us[indexed] = (now_us() - t0) / queries;
+            reads[indexed] = (double)img.reads / queries;
+        }
+        if (found[0] != found[1]) {
+            fprintf(stderr, "index found %d sessions, scan %d\n", found[1], found[0]);
+            return 1;
+        }
+        printf("%5u %8d  %14.2f %12.1f  %13.2f %12.1f\n", years, count, us[1], reads[1], us[0], reads[0]);
+        journal_close(&journal);
+        free(img.data);
+    }
+    return 0;
+}
+
+// Back to back sessions from SYNTH_FIRST_DAY, counted into `snap` as the
+// device does. The snapshot is saved when the last one starts, so the
+// journal ends with one session after it.
+static int synth_sessions(journal_t *journal, journal_meta_t *meta, snapshot_t *snap, uint32_t count)
+{
+    uint32_t seed = 1;
+    uint32_t t = SYNTH_FIRST_DAY;
+    snapshot_init(snap, t);
+    for (uint32_t i = 0; i < count; i++) {
+        session_record_t rec = {
+            .start = t,
+            .duration = 300 + synth_rand(&seed) % 1800,
+            .activity = synth_rand(&seed) % ACTIVITY_COUNT,
+        };
+        if (i == count - 1) {
+            snap->running_activity = rec.activity;
+            snap->running_start = rec.start;
+            if (snapshot_save(snap, meta, journal) != ESP_OK) return -1;
+        }
+        esp_err_t err = journal_append(journal, &rec);
+        if (err != ESP_OK) {
+            fprintf(stderr, "append failed: error 0x%x\n", err);
+            return -1;
+        }
+        rollup_advance(&snap->rollup, rec.start + rec.duration);
+        snapshot_add(snap, &rec);
+        t += rec.duration + synth_rand(&seed) % 600;
+    }
+    return 0;
+}
+
+// Restore as at boot, from the snapshot or by replaying everything.
+// Returns the time taken in microseconds, reads go to the image counters.
+static double boot_restore(image_t *img, image_t *meta_img, bool use_snapshot, snapshot_t *snap, uint32_t *replayed)
+{
+    journal_t journal;
+    journal_meta_t meta = {0};
+    journal_flash_t flash;
+    if (image_open_journal(img, &journal) != 0) return -1;
+    image_flash(meta_img, &flash);
+    img->reads = meta_img->reads = 0;
+
+    double t0 = now_us();
+    if (use_snapshot && journal_meta_open(&meta, &flash) != ESP_OK) return -1;
+    snapshot_restore(snap, &meta, &journal, journal.last_end, replayed);
+    double us = now_us() - t0;
+    journal_close(&journal);
+    return us;
+}
+
+static int cmd_bench_boot(int argc, char **argv)
+{
+    static const uint32_t history_sessions[] = { 10000, 100000, 1000000 };
+
+    printf("sessions  open: us reads  snapshot: us reads replayed  full replay: us reads\n");
+    for (size_t h = 0; h < sizeof(history_sessions) / sizeof(history_sessions[0]); h++) {
+        uint32_t count = history_sessions[h];
+        // Room for all of them, so the full replay sees every session
+        uint32_t pages = count / ((JOURNAL_PAGE_SIZE - JOURNAL_HEADER_SIZE) / SESSION_CODEC_MAX_SIZE) + 2;
+        image_t img, meta_img;
+        journal_t journal;
+        journal_meta_t meta;
+        journal_flash_t flash;
+        snapshot_t expected, snap[2];
+        if (image_create(&img, pages * JOURNAL_PAGE_SIZE) != 0 || image_open_journal(&img, &journal) != 0
+            || image_create(&meta_img, 2 * JOURNAL_PAGE_SIZE) != 0) {
+            return 1;
+        }
+        image_flash(&meta_img, &flash);
+        if (journal_meta_open(&meta, &flash) != ESP_OK || synth_sessions(&journal, &meta, &expected, count) != 0) {
+            return 1;
+        }
+        journal_close(&journal);
+
+        // Opening alone, the part both ways share
+        img.reads = 0;
+        double t0 = now_us();
+        if (image_open_journal(&img, &journal) != 0) return 1;
+        double open_us = now_us() - t0;
+        uint32_t open_reads = img.reads;
+        journal_close(&journal);
+
+        double us[2];
+        uint32_t reads[2], replayed[2];
+        for (int use_snapshot = 1; use_snapshot >= 0; use_snapshot--) {
+            us[use_snapshot] = boot_restore(&img, &meta_img, use_snapshot, &snap[use_snapshot], &replayed[use_snapshot]);
+            if (us[use_snapshot] < 0) return 1;
+            reads[use_snapshot] = img.reads + meta_img.reads;
+        }
+        for (int use_snapshot = 1; use_snapshot >= 0; use_snapshot--) {
+            if (memcmp(snap[use_snapshot].totals_s, expected.totals_s, sizeof(expected.totals_s)) != 0
+                || memcmp(snap[use_snapshot].rollup.seconds, expected.rollup.seconds, sizeof(expected.rollup.seconds)) != 0) {
+                fprintf(stderr, "%s restore differs from the recorded state\n", use_snapshot ? "snapshot" : "full");
+                return 1;
+            }
+        }
+        if (snap[1].running_activity != SNAPSHOT_NOT_RUNNING) {
+            fprintf(stderr, "the last session is still running after the snapshot restore\n");
+            return 1;
+        }
+        printf("%8u  %8.0f %5u  %12.1f %5u %8u  %15.0f %7u\n", count, open_us, open_reads,
+               us[1], reads[1], replayed[1], us[0], reads[0]);
+        free(img.data);
+        free(meta_img.data);
+    }
+    return 0;
+}
+
+static int cmd_bench_read(int argc, char **argv)
+{
+    const uint32_t years = 10;
+    const int scans = 20;
+    const int queries = 1000;
+    image_t img;
+    journal_t journal;
+    if (image_create(&img, DEFAULT_IMAGE_SIZE) != 0 || image_open_journal(&img, &journal) != 0) return 1;
+    int count = synth_history(&journal, years);
+    if (count < 0) return 1;
+
+    printf("%d sessions, iterator %u B on the stack, no heap\n", count, (unsigned)sizeof(journal_iter_t));
+    printf("reader  scan: sessions/s reads  day query: us reads\n");
+    for (int mapped = 0; mapped < 2; mapped++) {
+        journal.flash.mapped = mapped ? img.data : NULL;
+
+        journal_iter_t it;
+        session_record_t rec;
+        uint64_t sum = 0;
+        img.reads = 0;
+        double t0 = now_us();
+        for (int s = 0; s < scans; s++) {
+            journal_iter_init(&it, &journal, journal_begin(&journal));
+            while (journal_iter_next(&it, &rec, NULL)) {
+                sum += rec.duration;
+            }
+        }
+        double scan_us = (now_us() - t0) / scans;
+        uint32_t scan_reads = img.reads / scans;
+
+        uint32_t seed = 7;
+        img.reads = 0;
+        t0 = now_us();
+        for (int q = 0; q < queries; q++) {
+            uint32_t day = SYNTH_FIRST_DAY + synth_rand(&seed) % (years * 365) * 86400;
+            sum += query_day(&journal, day, true);
+        }
+        double query_us = (now_us() - t0) / queries;
+        printf("%-6s  %15.0f %5u  %14.2f %5.1f\n", mapped ? "mapped" : "copy", count / scan_us * 1e6, scan_reads,
+               query_us, (double)img.reads / queries);
+        if (sum == 0) return 1;
+    }
+    journal_close(&journal);
+    free(img.data);
+    return 0;
+}
+
+// Kinds of history for bench-codec
+typedef enum {
+    WORKLOAD_DAYS,        // a few long sessions a day, as synth
+    WORKLOAD_POMODORO,    // 25 minutes of work and a 5 minute break, all day
+    WORKLOAD_SWITCHING,   // short sessions back to back, switching often
+    WORKLOAD_COUNT
+} workload_t;
+
+static const char *const workload_names[] = { "days", "pomodoro", "switching" };
+
+static void synth_workload(workload_t kind, session_record_t *recs, uint32_t count)
+{
+    uint32_t seed = 1;
+    uint32_t day = SYNTH_FIRST_DAY + 8 * 3600;
+    uint32_t t = day;
+    for (uint32_t i = 0; i < count; i++) {
+        session_record_t *rec = &recs[i];
+        if (kind == WORKLOAD_DAYS) {
+            rec->duration = 300 + synth_rand(&seed) % 5400;
+            rec->activity = synth_rand(&seed) % ACTIVITY_COUNT;
+        } else if (kind == WORKLOAD_POMODORO) {
+            rec->duration = (i % 2 ? 300 : 1500) + synth_rand(&seed) % 120;
+            rec->activity = i % 2 ? ACTIVITY_COUNT - 1 : synth_rand(&seed) % (ACTIVITY_COUNT - 1);
+        } else {
+            rec->duration = 60 + synth_rand(&seed) % 840;
+            rec->activity = synth_rand(&seed) % ACTIVITY_COUNT;
+        }
+        // Days end after about eight hours
+        if (t + rec->duration > day + 8 * 3600) {
+            day += 86400;
+            t = day + synth_rand(&seed) % 3600;
+        }
+        rec->start = t;
+        t += rec->duration + synth_rand(&seed) % (kind == WORKLOAD_DAYS ? 1800 : 120);
+    }
+}
+
+// Encode into pages as the journal does: each page counts from its first
+// session. Returns the bytes used.
+static size_t encode_pages(const session_record_t *recs, uint32_t count, uint8_t *out)
+{
+    size_t pos = 0;
+    size_t page_left = 0;
+    uint32_t prev = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (page_left < SESSION_CODEC_MAX_SIZE) {
+            pos += page_left;
+            page_left = JOURNAL_PAGE_SIZE - JOURNAL_HEADER_SIZE;
+            prev = recs[i].start;
+        }
+        size_t n = session_encode(&recs[i], prev, out + pos);
+        pos += n;
+        page_left -= n;
+        prev = recs[i].start;
+    }
+    return pos;
+}
+
+// Decode what encode_pages() wrote, returns the sessions that differ
+static uint32_t decode_pages(const session_record_t *recs, uint32_t count, const uint8_t *in, uint64_t *sum)
+{
+    size_t pos = 0;
+    size_t page_left = 0;
+    uint32_t prev = 0;
+    uint32_t bad = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (page_left < SESSION_CODEC_MAX_SIZE) {
+            pos += page_left;
+            page_left = JOURNAL_PAGE_SIZE - JOURNAL_HEADER_SIZE;
+            prev = recs[i].start;     // the page header's base time
+        }
+        session_record_t rec;
+        size_t n = session_decode(in + pos, page_left, prev, &rec);
+        if (n == 0 || rec.start != recs[i].start || rec.duration != recs[i].duration
+            || rec.activity != recs[i].activity) {
+            bad++;
+            n = n ? n : 1;
+        }
+        *sum += rec.duration;
+        pos += n;
+        page_left -= n;
+        prev = rec.start;
+    }
+    return bad;
+}
+
+static int cmd_bench_codec(int argc, char **argv)
+{
+    const uint32_t count = 1000000;
+    const int rounds = 5;
+    session_record_t *recs = malloc(count * sizeof(*recs));
+    // Worst case, every session in its largest encoding plus the page tails
+    uint8_t *buf = malloc((size_t)count * (SESSION_CODEC_MAX_SIZE + 1));
+    if (recs == NULL || buf == NULL) return 1;
+
+    printf("%u sessions\n", count);
+    printf("workload   B/session  pages  encode: ns/session MB/s  decode: ns/session MB/s\n");
+    for (int w = 0; w < WORKLOAD_COUNT; w++) {
+        synth_workload(w, recs, count);
+        size_t bytes = 0;
+        double t0 = now_us();
+        for (int r = 0; r < rounds; r++) {
+            bytes = encode_pages(recs, count, buf);
+        }
+        double encode_us = (now_us() - t0) / rounds;
+
+        uint64_t sum = 0;
+        uint32_t bad = 0;
+        t0 = now_us();
+        for (int r = 0; r < rounds; r++) {
+            bad += decode_pages(recs, count, buf, &sum);
+        }
+        double decode_us = (now_us() - t0) / rounds;
+        if (bad) {
+            fprintf(stderr, "%s: %u sessions decoded wrong\n", workload_names[w], bad / rounds);
+            return 1;
+        }
+
+        // Journal pages the history fills
+        uint32_t pages = (bytes + JOURNAL_PAGE_SIZE - JOURNAL_HEADER_SIZE - 1) / (JOURNAL_PAGE_SIZE - JOURNAL_HEADER_SIZE);
+        printf("%-10s %9.2f %6u  %18.1f %4.0f  %18.1f %4.0f\n", workload_names[w], (double)bytes / count, pages,
+               encode_us * 1000 / count, bytes / encode_us, decode_us * 1000 / count, bytes / decode_us);
+    }
+    free(recs);
+    free(buf);
+    return 0;
+}
+
+// A session every 10 to 50 seconds from 2000 on, short enough for 100
+// million of them to fit before 32-bit time runs out. Returns the number of
+// sessions or -1.
+#define DENSE_FIRST 946684800         // 2000-01-01
+
+static int synth_dense(journal_t *journal, uint32_t count)
+{
+    uint32_t seed = 1;
+    uint32_t t = DENSE_FIRST;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t gap = 10 + synth_rand(&seed) % 40;
+        session_record_t rec = {
+            .start = t,
+            .duration = 1 + synth_rand(&seed) % gap,
+            .activity = synth_rand(&seed) % ACTIVITY_COUNT,
+        };
+        esp_err_t err = journal_append(journal, &rec);
+        if (err != ESP_OK) {
+            fprintf(stderr, "append failed: error 0x%x\n", err);
+            return -1;
+        }
+        t += gap;
+    }
+    return count;
+}
+
+static void print_totals(const char *what, double us, const journal_view_totals_t *totals)
+{
+    uint64_t sessions = 0;
+    for (int a = 0; a < JOURNAL_VIEW_ACTIVITIES; a++) {
+        sessions += totals->sessions[a];
+    }
+    printf("%-18s %7.3f %10llu ", what, us / 1e6, (unsigned long long)sessions);
+    for (size_t a = 0; a < ACTIVITY_COUNT; a++) {
+        printf(" %10llu", (unsigned long long)totals->seconds[a]);
+    }
+    printf("\n");
+}
+
+static int cmd_bench_view(int argc, char **argv)
+{
+    uint32_t count = (argc > 2 ? strtoul(argv[2], NULL, 0) : 100) * 1000000;
+    // Four bytes per session, a little room to spare
+    uint32_t pages = count / ((JOURNAL_PAGE_SIZE - JOURNAL_HEADER_SIZE) / 4 - 20) + 2;
+    image_t img;
+    journal_t journal;
+    if (image_create(&img, pages * JOURNAL_PAGE_SIZE) != 0 || image_open_journal(&img, &journal) != 0) return 1;
+    double t0 = now_us();
+    if (synth_dense(&journal, count) < 0) return 1;
+    printf("%u sessions, %u MB image, written in %.1f s\n", count, img.size >> 20, (now_us() - t0) / 1e6);
+    journal_close(&journal);
+
+    char path[] = "/tmp/journal_view_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0 || image_save(&img, path) != 0) return 1;
+    close(fd);
+    free(img.data);
+    journal_view_t view;
+    t0 = now_us();
+    int err = journal_view_open(&view, path);
+    unlink(path);
+    if (err != 0) return 1;
+    printf("mapped and opened in %.1f ms\n", (now_us() - t0) / 1e3);
+
+    printf("pass                     s   sessions   seconds per activity\n");
+    // The first pass also faults the pages in, keep the best of a few
+    const int rounds = 3;
+    journal_view_filter_t all = { 0 };
+    journal_view_totals_t totals, iter_totals = { 0 };
+    double best = 0;
+    for (int r = 0; r < rounds; r++) {
+        t0 = now_us();
+        journal_view_sum(&view, &all, &totals);
+        double us = now_us() - t0;
+        best = r == 0 || us < best ? us : best;
+    }
+    print_totals("sum", best, &totals);
+
+    t0 = now_us();
+    journal_view_iter_t it;
+    session_record_t rec;
+    journal_view_iter_init(&it, &view, &all);
+    while (journal_view_next(&it, &rec)) {
+        iter_totals.sessions[rec.activity]++;
+        iter_totals.seconds[rec.activity] += rec.duration;
+    }
+    double iter_us = now_us() - t0;
+    print_totals("iterator", iter_us, &iter_totals);
+    if (memcmp(&totals, &iter_totals, sizeof(totals)) != 0) {
+        fprintf(stderr, "sum and iterator disagree\n");
+        return 1;
+    }
+
+    journal_view_filter_t work = { .activities = 1 << 0 };
+    t0 = now_us();
+    journal_view_sum(&view, &work, &totals);
+    print_totals("sum, Work only", now_us() - t0, &totals);
+
+    // The month halfway through the history
+    uint32_t from = (DENSE_FIRST + (rec.start - DENSE_FIRST) / 2) / 86400 * 86400;
+    journal_view_filter_t month = { .from = from, .to = from + 30 * 86400 };
+    t0 = now_us();
+    journal_view_sum(&view, &month, &totals);
+    print_totals("sum, 30 days", now_us() - t0, &totals);
+    printf("sum: %.1f ns per session, iterator: %.1f\n", best * 1000 / count, iter_us * 1000 / count);
+
+    journal_view_close(&view);
+    return 0;
+}
+
+// Totals from a CSV export, as a reader of the row format would
+static void csv_sum(const char *csv, const journal_view_filter_t *f, journal_view_totals_t *totals)
+{
+    memset(totals, 0, sizeof(*totals));
+    const char *p = strchr(csv, '\n') + 1;
+    while (*p) {
+        char *end;
+        strtoul(p, &end, 10);
+        uint32_t start = strtoul(end + 1, &end, 10);
+        uint32_t duration = strtoul(end + 1, &end, 10);
+        const char *name = end + 1;
+        const char *eol = strchr(name, '\n');
+        uint8_t activity = 0;
+        while (activity < ACTIVITY_COUNT
+               && (strncmp(name, activity_names[activity], eol - name) != 0
+                   || activity_names[activity][eol - name] != 0)) {
+            activity++;
+        }
+        p = eol + 1;
+        if (start < f->from || (f->to && start >= f->to)) continue;
+        if (f->activities && !(f->activities >> activity & 1)) continue;
+        totals->sessions[activity]++;
+        totals->seconds[activity] += duration;
+    }
+}
+
+static int cmd_bench_columnar(int argc, char **argv)
+{
+    uint32_t count = (argc > 2 ? strtoul(argv[2], NULL, 0) : 10) * 1000000;
+    uint32_t pages = count / ((JOURNAL_PAGE_SIZE - JOURNAL_HEADER_SIZE) / 4 - 20) + 2;
+    image_t img;
+    journal_t journal;
+    if (image_create(&img, pages * JOURNAL_PAGE_SIZE) != 0 || image_open_journal(&img, &journal) != 0) return 1;
+    if (synth_dense(&journal, count) < 0) return 1;
+    journal_close(&journal);
+
+    char image_path[] = "/tmp/journal_view_XXXXXX";
+    char columnar_path[] = "/tmp/columnar_XXXXXX";
+    int image_fd = mkstemp(image_path);
+    int columnar_fd = mkstemp(columnar_path);
+    if (image_fd < 0 || columnar_fd < 0 || image_save(&img, image_path) != 0) return 1;
+    close(image_fd);
+    close(columnar_fd);
+    free(img.data);
+
+    journal_view_t view;
+    columnar_t columnar;
+    if (journal_view_open(&view, image_path) != 0) return 1;
+    double t0 = now_us();
+    if (columnar_write(&view.journal, columnar_path) != 0 || columnar_open(&columnar, columnar_path) != 0) return 1;
+    double convert_us = now_us() - t0;
+    unlink(image_path);
+    unlink(columnar_path);
+
+    // The whole export in memory, so the parse is not measured with the disk
+    size_t csv_size = 0, csv_cap = 1 << 20;
+    char *csv = malloc(csv_cap);
+    char line[JOURNAL_EXPORT_LINE_MAX];
+    journal_iter_t it;
+    session_record_t rec;
+    journal_pos_t pos;
+    csv_size = journal_export_header(JOURNAL_EXPORT_CSV, csv, csv_cap);
+    journal_iter_init(&it, &view.journal, journal_begin(&view.journal));
+    while (csv && journal_iter_next(&it, &rec, &pos)) {
+        size_t len = journal_export_record(JOURNAL_EXPORT_CSV, &rec, pos, activity_name(rec.activity), line, sizeof(line));
+        if (csv_size + len + 1 > csv_cap) {
+            csv_cap *= 2;
+            csv = realloc(csv, csv_cap);
+            if (csv == NULL) return 1;
+        }
+        memcpy(csv + csv_size, line, len);
+        csv_size += len;
+    }
+    csv[csv_size] = 0;
+
+    printf("%u sessions: CSV %zu MB, image %zu MB (%.2f B/session), columnar %zu MB (%.2f B/session, "
+           "%u blocks), converted in %.2f s\n",
+           count, csv_size >> 20, view.size >> 20, (double)view.size / count, columnar.size >> 20,
+           (double)columnar.size / count, columnar.header->block_count, convert_us / 1e6);
+
+    // Filters: everything, one activity, a month and a day halfway through
+    uint32_t middle = (DENSE_FIRST + (rec.start - DENSE_FIRST) / 2) / 86400 * 86400;
+    static const char *const query_names[] = { "all", "Work only", "30 days", "one day, Work" };
+    const journal_view_filter_t queries[] = {
+        { 0 },
+        { .activities = 1 << 0 },
+        { .from = middle, .to = middle + 30 * 86400 },
+        { .from = middle, .to = middle + 86400, .activities = 1 << 0 },
+    };
+    printf("query                CSV: ms     image: ms  columnar: ms  sessions\n");
+    for (size_t q = 0; q < sizeof(queries) / sizeof(queries[0]); q++) {
+        journal_view_totals_t totals[3];
+        double us[3];
+        for (int reader = 0; reader < 3; reader++) {
+            // Best of a few, the first also faults the mapping in
+            for (int r = 0; r < 3; r++) {
+                t0 = now_us();
+                if (reader == 0) {
+                    csv_sum(csv, &queries[q], &totals[0]);
+                } else if (reader == 1) {
+                    journal_view_sum(&view, &queries[q], &totals[1]);
+                } else {
+                    columnar_sum(&columnar, &queries[q], &totals[2]);
+                }
+                double t = now_us() - t0;
+                us[reader] = r == 0 || t < us[reader] ? t : us[reader];
+            }
+        }
+        if (memcmp(&totals[0], &totals[1], sizeof(totals[0])) != 0
+            || memcmp(&totals[1], &totals[2], sizeof(totals[0])) != 0) {
+            fprintf(stderr, "%s: the readers disagree\n", query_names[q]);
+            return 1;
+        }
+        uint64_t sessions = 0;
+        for (int a = 0; a < JOURNAL_VIEW_ACTIVITIES; a++) {
+            sessions += totals[0].sessions[a];
+        }
+        printf("%-15s %12.2f %13.2f %13.2f %9llu\n", query_names[q], us[0] / 1e3, us[1] / 1e3, us[2] / 1e3,
+               (unsigned long long)sessions);
+    }
+    free(csv);
+    columnar_close(&columnar);
+    journal_view_close(&view);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc >= 2 && strcmp(argv[1], "export") == 0) return cmd_export(argc, argv);
+    if (argc >= 2 && strcmp(argv[1], "synth") == 0) return cmd_synth(argc, argv);
+    if (argc >= 2 && strcmp(argv[1], "compact") == 0) return cmd_compact(argc, argv);
+    if (argc >= 2 && strcmp(argv[1], "columnar") == 0) return cmd_columnar(argc, argv);
+    if (argc >= 2 && strcmp(argv[1], "check-export") == 0) return cmd_check_export(argc, argv);
+    if (argc >= 2 && strcmp(argv[1], "check-rollup") == 0) return cmd_check_rollup(argc, argv);
+    if (argc >= 2 && strcmp(argv[1], "check-reconcile") == 0) return cmd_check_reconcile(argc, argv);
+    if (argc >= 2 && strcmp(argv[1], "check-compact") == 0) return cmd_check_compact(argc, argv);
+    if (argc >= 2 && strcmp(argv[1], "bench-seek") == 0) return cmd_bench_seek(argc, argv);
+    if (argc >= 2 && strcmp(argv[1], "bench-boot") == 0) return cmd_bench_boot(argc, argv);
+    if (argc >= 2 && strcmp(argv[1], "bench-codec") == 0) return cmd_bench_codec(argc, argv);
+    if (argc >= 2 && strcmp(argv[1], "bench-read") == 0) return cmd_bench_read(argc, argv);
+    if (argc >= 2 && strcmp(argv[1], "bench-view") == 0) return cmd_bench_view(argc, argv);
+    if (argc >= 2 && strcmp(argv[1], "bench-columnar") == 0) return cmd_bench_columnar(argc, argv);
+
+    fprintf(stderr,
+            "usage: %s export|synth|compact|columnar <image> ... | check-export | check-rollup | check-reconcile"
+            " | check-compact | bench-seek | bench-boot | bench-codec | bench-read"
+            " | bench-view | bench-columnar\n",
+            argv[0]);
+    return 2;
+}
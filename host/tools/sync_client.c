@@ -0,0 +1,609 @@
+// Stand-in for the companion app: fetches the sessions the device has
+// recorded since the last sync.
+//
+//   sync_client /dev/ttyACM0 cursor.txt >> sessions.csv
+//   sync_client --simulate sessions.bin cursor.txt >> sessions.csv
+//   sync_client --mirror mirror.bin /dev/ttyACM0
+//   sync_client --check
+//
+// Sessions are written to stdout as "start,duration,activity" lines. The
+// cursor file holds where the last sync stopped and is updated after every
+// frame, so an interrupted sync continues where it was cut. With --simulate
+// the device is played by a child process serving a partition image over a
+// pseudo terminal, with the same sender code as the firmware.
+//
+// With --mirror the app keeps a copy of the journal pages instead and only
+// fetches the pages whose hash differs from its copy (see sync_proto.h).
+// The mirror is itself a partition image, readable by journal_tool and
+// journal_view, and keeps the pages the device has since recycled. Chunks
+// are written to it as they arrive, a page cut short by an interrupted sync
+// no longer matches and comes again.
+//
+// --check runs both kinds of sync against the simulator on a synthetic
+// history and exits non-zero if one goes wrong: a sync after new sessions
+// must bring exactly those, a sync with nothing new no more than the END
+// frame, and a full sync must reach CHECK_MIN_BYTES_PER_S.
+
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <pty.h>
+#include <sys/wait.h>
+#include "sync_proto.h"
+#include "sync_sender.h"
+#include "journal_image.h"
+
+// Same as the firmware defaults (CONFIG_SYNC_*)
+#define WINDOW 8
+#define RETRANSMIT_MS 300
+#define TIMEOUT_MS 5000
+
+// Say hello again if the device stays quiet this long, e.g. because the
+// console was still busy echoing the sync command
+#define HELLO_RETRY_MS 500
+
+static uint32_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int write_all(int fd, const uint8_t *data, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR || errno == EAGAIN) continue;
+            return -1;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int open_serial(const char *path)
+{
+    int fd = open(path, O_RDWR | O_NOCTTY);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    struct termios tio;
+    if (tcgetattr(fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    return fd;
+}
+
+static uint32_t load_cursor(const char *path)
+{
+    uint32_t cursor = 0;
+    FILE *f = path ? fopen(path, "r") : NULL;
+    if (f) {
+        if (fscanf(f, "%u", &cursor) != 1) cursor = 0;
+        fclose(f);
+    }
+    return cursor;
+}
+
+static void save_cursor(const char *path, uint32_t cursor)
+{
+    FILE *f = path ? fopen(path, "w") : NULL;
+    if (f) {
+        fprintf(f, "%u\n", cursor);
+        fclose(f);
+    }
+}
+
+// Device side of --simulate
+
+typedef struct {
+    int fd;
+    journal_t *journal;
+} sim_ctx_t;
+
+static int sim_read(void *ctx, journal_pos_t *pos, session_record_t *recs, int max)
+{
+    sim_ctx_t *sim = ctx;
+    journal_iter_t it;
+    int n = 0;
+    journal_iter_init(&it, sim->journal, *pos);
+    while (n < max && journal_iter_next(&it, &recs[n], NULL)) {
+        n++;
+    }
+    *pos = it.pos;
+    return n;
+}
+
+static void sim_write(void *ctx, const uint8_t *data, size_t len)
+{
+    write_all(((sim_ctx_t *)ctx)->fd, data, len);
+}
+
+static void sim_pages(void *ctx, uint32_t *tail, uint32_t *head)
+{
+    sim_ctx_t *sim = ctx;
+    *tail = sim->journal->tail_seq;
+    *head = sim->journal->head_seq;
+}
+
+static bool sim_read_page(void *ctx, uint32_t seq, uint32_t offset, uint8_t *dst, size_t len)
+{
+    return journal_read_page(((sim_ctx_t *)ctx)->journal, seq, offset, dst, len) == ESP_OK;
+}
+
+static int simulate_device(int fd, const char *image_path)
+{
+    image_t img;
+    journal_t journal;
+    if (image_load(&img, image_path) != 0 || image_open_journal(&img, &journal) != 0) return 1;
+
+    sim_ctx_t sim = { .fd = fd, .journal = &journal };
+    sync_io_t io = {
+        .read = sim_read,
+        .write = sim_write,
+        .pages = sim_pages,
+        .read_page = sim_read_page,
+        .ctx = &sim,
+    };
+    sync_sender_t sender;
+    sync_sender_init(&sender, &io, WINDOW, RETRANSMIT_MS, TIMEOUT_MS, now_ms());
+
+    sync_state_t state;
+    while ((state = sync_sender_poll(&sender, now_ms())) != SYNC_DONE && state != SYNC_FAILED) {
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        if (poll(&pfd, 1, 5) > 0) {
+            uint8_t buf[256];
+            ssize_t n = read(fd, buf, sizeof(buf));
+            if (n > 0) sync_sender_input(&sender, buf, n, now_ms());
+        }
+    }
+    fprintf(stderr, "device: %u sessions, %u pages in %u frames (%u resent), %u B\n",
+            sender.records, sender.pages, sender.frames, sender.retransmits, sender.bytes);
+    return state == SYNC_DONE ? 0 : 1;
+}
+
+// App side
+
+// Bytes the app sent, frames only
+static uint64_t sent;
+
+static void send_frame(int fd, uint8_t type, uint8_t seq, const uint8_t *payload, size_t len)
+{
+    uint8_t wire[SYNC_WIRE_MAX];
+    size_t n = sync_frame_build(type, seq, payload, len, wire);
+    write_all(fd, wire, n);
+    sent += n;
+}
+
+// Copy of the device pages for --mirror: page seq N at offset (N - 1) *
+// JOURNAL_PAGE_SIZE, pages never received left erased
+typedef struct {
+    int fd;
+    uint8_t *data;
+    uint32_t pages;
+} mirror_t;
+
+static int mirror_open(mirror_t *m, const char *path)
+{
+    memset(m, 0, sizeof(*m));
+    m->fd = open(path, O_RDWR | O_CREAT, 0644);
+    struct stat st;
+    if (m->fd < 0 || fstat(m->fd, &st) != 0) {
+        perror(path);
+        return -1;
+    }
+    m->pages = st.st_size / JOURNAL_PAGE_SIZE;
+    m->data = malloc((size_t)m->pages * JOURNAL_PAGE_SIZE + 1);
+    if (m->data == NULL || pread(m->fd, m->data, (size_t)m->pages * JOURNAL_PAGE_SIZE, 0)
+                           != (ssize_t)m->pages * JOURNAL_PAGE_SIZE) {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+static uint8_t *mirror_page(const mirror_t *m, uint32_t seq)
+{
+    return m->data + (size_t)(seq - 1) * JOURNAL_PAGE_SIZE;
+}
+
+// Make room up to page `seq`, with erased pages
+static int mirror_grow(mirror_t *m, uint32_t seq)
+{
+    if (seq <= m->pages) return 0;
+    uint8_t *data = realloc(m->data, (size_t)seq * JOURNAL_PAGE_SIZE);
+    if (data == NULL) return -1;
+    m->data = data;
+    size_t from = (size_t)m->pages * JOURNAL_PAGE_SIZE;
+    size_t len = (size_t)(seq - m->pages) * JOURNAL_PAGE_SIZE;
+    memset(m->data + from, 0xFF, len);
+    m->pages = seq;
+    return pwrite(m->fd, m->data + from, len, from) == (ssize_t)len ? 0 : -1;
+}
+
+// Store a PAGE frame, the chunk at offset 0 replaces the whole page
+static int mirror_store(mirror_t *m, const uint8_t *payload, size_t len)
+{
+    journal_pos_t pos = sync_get32(payload);
+    uint32_t seq = JOURNAL_POS_SEQ(pos);
+    uint32_t offset = JOURNAL_POS_OFFSET(pos);
+    len -= 4;
+    if (seq == 0 || offset + len > JOURNAL_PAGE_SIZE || mirror_grow(m, seq) != 0) return -1;
+
+    uint8_t *page = mirror_page(m, seq);
+    if (offset == 0) {
+        memset(page, 0xFF, JOURNAL_PAGE_SIZE);
+    }
+    memcpy(page + offset, payload + 4, len);
+    off_t at = (off_t)(seq - 1) * JOURNAL_PAGE_SIZE;
+    if (offset == 0) {
+        return pwrite(m->fd, page, JOURNAL_PAGE_SIZE, at) == JOURNAL_PAGE_SIZE ? 0 : -1;
+    }
+    return pwrite(m->fd, page + offset, len, at + offset) == (ssize_t)len ? 0 : -1;
+}
+
+// The zero first ends whatever text the device collected so far
+static void send_delimiter(int fd)
+{
+    static const uint8_t delimiter = 0;
+    write_all(fd, &delimiter, 1);
+}
+
+static void send_hello(int fd, uint32_t cursor)
+{
+    uint8_t payload[4];
+    sync_put32(payload, cursor);
+    send_delimiter(fd);
+    send_frame(fd, SYNC_HELLO, 0, payload, sizeof(payload));
+}
+
+// Hashes of the pages in the mirror, then the request for the others
+static void send_mirror(int fd, const mirror_t *m)
+{
+    uint8_t payload[1 + SYNC_HAVE_PER_FRAME * 8];
+    payload[0] = 0;
+    send_delimiter(fd);
+    for (uint32_t seq = 1; seq <= m->pages; seq++) {
+        const journal_page_header_t *hdr = (const journal_page_header_t *)mirror_page(m, seq);
+        if (hdr->magic != JOURNAL_PAGE_MAGIC || hdr->seq != seq) continue;
+        uint8_t *p = payload + 1 + payload[0] * 8;
+        sync_put32(p, seq);
+        sync_put32(p + 4, journal_crc32(0, hdr, JOURNAL_PAGE_SIZE));
+        if (++payload[0] == SYNC_HAVE_PER_FRAME) {
+            send_frame(fd, SYNC_HAVE, 0, payload, sizeof(payload));
+            payload[0] = 0;
+        }
+    }
+    if (payload[0] > 0) {
+        send_frame(fd, SYNC_HAVE, 0, payload, 1 + payload[0] * 8);
+    }
+    send_frame(fd, SYNC_MIRROR, 0, NULL, 0);
+}
+
+static void start_sync(int fd, uint32_t cursor, const mirror_t *mirror)
+{
+    if (mirror) {
+        send_mirror(fd, mirror);
+    } else {
+        send_hello(fd, cursor);
+    }
+}
+
+// A DATA, PAGE or END frame of the kind of sync we asked for
+static bool valid_frame(const sync_frame_t *frame, bool mirror)
+{
+    switch (frame->type) {
+    case SYNC_DATA:
+        return !mirror && frame->len >= 5 && frame->len == 5 + (size_t)frame->payload[4] * SYNC_RECORD_SIZE;
+    case SYNC_PAGE:
+        return mirror && frame->len > 4;
+    case SYNC_END:
+        return frame->len >= (mirror ? 8 : 4);
+    default:
+        return false;
+    }
+}
+
+typedef struct {
+    uint32_t records;
+    uint32_t pages;
+    uint64_t received;      // bytes, frames and anything else
+    uint64_t sent;
+    uint32_t elapsed_ms;
+} client_result_t;
+
+// Sessions go to `out`
+static int run_client(int fd, const char *cursor_path, mirror_t *mirror, FILE *out, client_result_t *res)
+{
+    uint32_t cursor = load_cursor(cursor_path);
+    uint32_t records = 0;
+    uint32_t pages = 0;
+    uint64_t bytes = 0;
+    uint64_t sent_before = sent;
+    uint8_t expected = 0;
+    bool started = false;
+    sync_rx_t rx;
+    sync_rx_init(&rx);
+
+    // Switch the console into sync mode, harmless for the simulator
+    static const char command[] = "sync\r\n";
+    write_all(fd, (const uint8_t *)command, sizeof(command) - 1);
+    start_sync(fd, cursor, mirror);
+
+    uint32_t start = now_ms();
+    uint32_t last_rx = start;
+    bool done = false;
+    while (!done) {
+        uint32_t now = now_ms();
+        if (now - last_rx > TIMEOUT_MS) {
+            fprintf(stderr, "no answer from the device\n");
+            return 1;
+        }
+        if (!started && now - last_rx > HELLO_RETRY_MS) {
+            start_sync(fd, cursor, mirror);
+            last_rx = now;
+        }
+
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        if (poll(&pfd, 1, 50) <= 0) continue;
+        uint8_t buf[4096];
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n <= 0) continue;
+        bytes += n;
+
+        for (ssize_t i = 0; i < n && !done; i++) {
+            sync_frame_t frame;
+            if (!sync_rx_push(&rx, buf[i], &frame)) continue;
+            last_rx = now_ms();
+            if (frame.type != SYNC_DATA && frame.type != SYNC_PAGE && frame.type != SYNC_END) continue;
+
+            if (frame.seq != expected) {
+                // Lost something, repeat the last good one so the device goes back
+                if (started) send_frame(fd, SYNC_ACK, expected - 1, NULL, 0);
+                continue;
+            }
+            if (!valid_frame(&frame, mirror != NULL)) continue;
+
+            if (frame.type == SYNC_PAGE) {
+                if (mirror_store(mirror, frame.payload, frame.len) != 0) {
+                    perror("mirror");
+                    return 1;
+                }
+                pages += JOURNAL_POS_OFFSET(sync_get32(frame.payload)) == 0;
+            } else if (frame.type == SYNC_DATA) {
+                const uint8_t *p = frame.payload + 5;
+                for (int r = 0; r < frame.payload[4]; r++, p += SYNC_RECORD_SIZE) {
+                    fprintf(out, "%u,%u,%u\n", sync_get32(p), sync_get32(p + 4), p[8]);
+                }
+                records += frame.payload[4];
+            } else {
+                done = true;
+            }
+            if (mirror == NULL) {
+                cursor = sync_get32(frame.payload);
+                fflush(out);
+                save_cursor(cursor_path, cursor);
+            }
+            send_frame(fd, SYNC_ACK, frame.seq, NULL, 0);
+            expected++;
+            started = true;
+        }
+    }
+
+    uint32_t elapsed = now_ms() - start;
+    if (res) {
+        *res = (client_result_t) {
+            .records = records,
+            .pages = pages,
+            .received = bytes,
+            .sent = sent - sent_before,
+            .elapsed_ms = elapsed,
+        };
+    }
+    if (mirror) {
+        fprintf(stderr, "%u pages, %llu B received and %llu B sent in %u ms, %u bad frames\n",
+                pages, (unsigned long long)bytes, (unsigned long long)sent, elapsed, rx.bad_frames);
+        return 0;
+    }
+    fprintf(stderr, "%u sessions, %llu B received in %u ms (%llu B/s), %u bad frames, cursor %u\n",
+            records, (unsigned long long)bytes, elapsed,
+            elapsed ? (unsigned long long)bytes * 1000 / elapsed : 0, rx.bad_frames, cursor);
+    return 0;
+}
+
+// Sync with a child process serving `image` over a pseudo terminal
+static int simulate_sync(const char *image, const char *cursor_path, mirror_t *mirror, FILE *out,
+                         client_result_t *res)
+{
+    int master, slave;
+    if (openpty(&master, &slave, NULL, NULL, NULL) != 0) {
+        perror("openpty");
+        return 1;
+    }
+    struct termios tio;
+    tcgetattr(slave, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(slave, TCSANOW, &tio);
+
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(slave);
+        _exit(simulate_device(master, image));
+    }
+    close(master);
+    int ret = run_client(slave, cursor_path, mirror, out, res);
+    close(slave);
+    int status;
+    waitpid(pid, &status, 0);
+    return ret != 0 ? ret : WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
+
+#define CHECK_IMAGE_SIZE (256 * 1024)
+#define CHECK_DAYS 365
+// Over the pseudo terminal the first sync (about 18 KB) moves close to 2 MB/s
+// on a shared cloud core. A single wait for the retransmit timer (300 ms)
+// takes it below this, a busy machine does not.
+#define CHECK_MIN_BYTES_PER_S (50 * 1024)
+
+static session_record_t check_recs[2 * CHECK_DAYS * 8];
+static uint32_t check_count;
+
+// `days` more of a few sessions a day, the same on every run
+static int check_append(journal_t *journal, uint32_t days)
+{
+    static uint32_t seed = 1, day = 1577836800 + 8 * 3600;
+    for (uint32_t d = 0; d < days; d++, day += 86400) {
+        seed = seed * 1103515245 + 12345;
+        uint32_t t = day;
+        for (uint32_t s = 0; s < 2 + (seed >> 8) % 7; s++) {
+            session_record_t rec = { .start = t, .duration = 300 + (seed >> 4) % 3000, .activity = s % 5 };
+            if (journal_append(journal, &rec) != ESP_OK) return -1;
+            check_recs[check_count++] = rec;
+            t += rec.duration + 600;
+        }
+    }
+    return 0;
+}
+
+// Wire size of an END frame with `len` bytes of payload
+static size_t end_frame_size(size_t len)
+{
+    uint8_t payload[8] = { 0 }, wire[SYNC_WIRE_MAX];
+    return sync_frame_build(SYNC_END, 0, payload, len, wire);
+}
+
+// One cursor sync, whose sessions must be check_recs[from..check_count)
+static int check_cursor_sync(const char *name, const char *image, const char *cursor_path, uint32_t from,
+                             client_result_t *res)
+{
+    char *text = NULL;
+    size_t len;
+    FILE *out = open_memstream(&text, &len);
+    int ret = simulate_sync(image, cursor_path, NULL, out, res);
+    fclose(out);
+
+    uint32_t n = 0;
+    bool same = ret == 0;
+    for (char *line = text; same && *line; line = strchr(line, '\n') + 1, n++) {
+        unsigned start, duration, activity;
+        const session_record_t *want = &check_recs[from + n];
+        same = from + n < check_count && sscanf(line, "%u,%u,%u", &start, &duration, &activity) == 3
+               && start == want->start && duration == want->duration && activity == want->activity;
+    }
+    free(text);
+    if (!same || from + n != check_count) {
+        fprintf(stderr, "check: %s sync brought %u sessions, expected the %u from %u on\n",
+                name, n, check_count - from, from);
+        return 1;
+    }
+    return 0;
+}
+
+static int check(void)
+{
+    char dir[] = "/tmp/sync_check.XXXXXX";
+    if (mkdtemp(dir) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    char image[64], cursor[64], mirror_path[64];
+    snprintf(image, sizeof(image), "%s/sessions.bin", dir);
+    snprintf(cursor, sizeof(cursor), "%s/cursor.txt", dir);
+    snprintf(mirror_path, sizeof(mirror_path), "%s/mirror.bin", dir);
+
+    image_t img;
+    journal_t journal;
+    if (image_create(&img, CHECK_IMAGE_SIZE) != 0 || image_open_journal(&img, &journal) != 0
+        || check_append(&journal, CHECK_DAYS) != 0 || image_save(&img, image) != 0) {
+        return 1;
+    }
+
+    int bad = 0;
+    client_result_t res;
+    bad += check_cursor_sync("first", image, cursor, 0, &res);
+    uint64_t rate = res.elapsed_ms ? res.received * 1000 / res.elapsed_ms : UINT64_MAX;
+    if (rate < CHECK_MIN_BYTES_PER_S) {
+        fprintf(stderr, "check: first sync moved %llu B/s, expected at least %u\n",
+                (unsigned long long)rate, CHECK_MIN_BYTES_PER_S);
+        bad++;
+    }
+
+    // Another year: only it comes, then nothing but the END frame
+    uint32_t before = check_count;
+    if (check_append(&journal, CHECK_DAYS) != 0 || image_save(&img, image) != 0) return 1;
+    bad += check_cursor_sync("second", image, cursor, before, &res);
+    bad += check_cursor_sync("no-op", image, cursor, check_count, &res);
+    if (res.received > end_frame_size(4)) {
+        fprintf(stderr, "check: no-op sync received %llu B, the END frame is %zu\n",
+                (unsigned long long)res.received, end_frame_size(4));
+        bad++;
+    }
+
+    // Mirror: every page, then none
+    mirror_t mirror;
+    if (mirror_open(&mirror, mirror_path) != 0) return 1;
+    if (simulate_sync(image, NULL, &mirror, stdout, &res) != 0 || res.pages != journal.head_seq) {
+        fprintf(stderr, "check: mirror sync fetched %u pages of %u\n", res.pages, journal.head_seq);
+        bad++;
+    }
+    if (memcmp(mirror.data, img.data, (size_t)journal.head_seq * JOURNAL_PAGE_SIZE) != 0) {
+        fprintf(stderr, "check: the mirror differs from the image\n");
+        bad++;
+    }
+    if (simulate_sync(image, NULL, &mirror, stdout, &res) != 0 || res.pages != 0
+        || res.received > end_frame_size(8)) {
+        fprintf(stderr, "check: no-op mirror sync fetched %u pages, received %llu B, the END frame is %zu\n",
+                res.pages, (unsigned long long)res.received, end_frame_size(8));
+        bad++;
+    }
+
+    unlink(image);
+    unlink(cursor);
+    unlink(mirror_path);
+    rmdir(dir);
+    printf("check: %u sessions, first sync %llu B/s, %d failures\n", check_count, (unsigned long long)rate, bad);
+    return bad ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    static mirror_t mirror_file;
+    const char *prog = argv[0];
+    mirror_t *mirror = NULL;
+    if (argc >= 2 && strcmp(argv[1], "--check") == 0) return check();
+    if (argc >= 3 && strcmp(argv[1], "--mirror") == 0) {
+        mirror = &mirror_file;
+        if (mirror_open(mirror, argv[2]) != 0) return 1;
+        argv += 2;
+        argc -= 2;
+    }
+    if (argc >= 3 && strcmp(argv[1], "--simulate") == 0) {
+        return simulate_sync(argv[2], argc > 3 ? argv[3] : NULL, mirror, stdout, NULL);
+    }
+    if (argc >= 2 && argv[1][0] != '-') {
+        int fd = open_serial(argv[1]);
+        if (fd < 0) return 1;
+        return run_client(fd, argc > 2 ? argv[2] : NULL, mirror, stdout, NULL);
+    }
+
+    fprintf(stderr, "usage: %s <serial device> [cursor file]\n"
+                    "       %s --simulate <image> [cursor file]\n"
+                    "       %s --mirror <mirror image> <serial device> | --simulate <image>\n"
+                    "       %s --check\n",
+            prog, prog, prog, prog);
+    return 2;
+}
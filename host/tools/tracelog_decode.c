@@ -0,0 +1,253 @@
+// Decodes the binary trace log written by the tracelog component.
+//
+//   idf.py monitor | tracelog_decode build/esp_idf_v5.0_tembed.elf
+//
+// Reads console output on stdin. Trace records are formatted with the tag and
+// format string looked up in the application ELF, everything else is passed
+// through unchanged.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "tracelog_wire.h"
+
+#define SHT_NOBITS 8
+#define SHF_ALLOC 2
+
+typedef struct {
+    uint32_t addr;
+    uint32_t offset;
+    uint32_t size;
+} section_t;
+
+static uint8_t *elf;
+static size_t elf_size;
+static section_t *sections;
+static int section_count;
+
+static uint32_t rd16(const uint8_t *p) { return p[0] | p[1] << 8; }
+static uint32_t rd32(const uint8_t *p) { return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24; }
+
+static int load_elf(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    elf_size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    elf = malloc(elf_size);
+    if (!elf || fread(elf, 1, elf_size, f) != elf_size) {
+        fprintf(stderr, "%s: read failed\n", path);
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+
+    // 32-bit little endian only, which is what the ESP32-S3 toolchain emits
+    if (elf_size < 52 || memcmp(elf, "\x7f" "ELF", 4) != 0 || elf[4] != 1 || elf[5] != 1) {
+        fprintf(stderr, "%s: not a 32-bit little endian ELF\n", path);
+        return -1;
+    }
+    uint32_t shoff = rd32(elf + 0x20);
+    uint32_t shentsize = rd16(elf + 0x2e);
+    uint32_t shnum = rd16(elf + 0x30);
+    if (shoff + (uint64_t)shentsize * shnum > elf_size) {
+        fprintf(stderr, "%s: truncated section table\n", path);
+        return -1;
+    }
+
+    sections = calloc(shnum, sizeof(section_t));
+    for (uint32_t i = 0; i < shnum; i++) {
+        const uint8_t *sh = elf + shoff + i * shentsize;
+        uint32_t type = rd32(sh + 4);
+        uint32_t flags = rd32(sh + 8);
+        if (type == SHT_NOBITS || !(flags & SHF_ALLOC)) continue;
+        section_t *s = &sections[section_count++];
+        s->addr = rd32(sh + 0x0c);
+        s->offset = rd32(sh + 0x10);
+        s->size = rd32(sh + 0x14);
+    }
+    return 0;
+}
+
+// Pointer into the loaded ELF for a target address, or NULL
+static const uint8_t *target_ptr(uint32_t addr, uint32_t len)
+{
+    for (int i = 0; i < section_count; i++) {
+        const section_t *s = &sections[i];
+        if (addr >= s->addr && addr - s->addr + (uint64_t)len <= s->size
+            && s->offset + (uint64_t)(addr - s->addr) + len <= elf_size) {
+            return elf + s->offset + (addr - s->addr);
+        }
+    }
+    return NULL;
+}
+
+static const char *target_string(uint32_t addr)
+{
+    const uint8_t *p = target_ptr(addr, 1);
+    if (!p) return NULL;
+    // Make sure it is terminated inside the image
+    if (!memchr(p, 0, elf + elf_size - p)) return NULL;
+    return (const char *)p;
+}
+
+static int b64_value(char c)
+{
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == '+') return 62;
+    if (c == '/') return 63;
+    return -1;
+}
+
+static int decode_record(const char *text, tracelog_record_t *rec)
+{
+    uint8_t raw[TRACELOG_RECORD_SIZE];
+    for (int i = 0, o = 0; o < TRACELOG_RECORD_SIZE; i += 4, o += 3) {
+        int v[4];
+        for (int k = 0; k < 4; k++) {
+            v[k] = b64_value(text[i + k]);
+            if (v[k] < 0) return -1;
+        }
+        uint32_t w = v[0] << 18 | v[1] << 12 | v[2] << 6 | v[3];
+        raw[o] = w >> 16;
+        raw[o + 1] = w >> 8;
+        raw[o + 2] = w;
+    }
+    rec->seq = rd32(raw);
+    rec->site = rd32(raw + 4);
+    rec->timestamp_us = rd32(raw + 8);
+    for (int i = 0; i < TRACELOG_MAX_ARGS; i++) {
+        rec->args[i] = rd32(raw + 12 + 4 * i);
+    }
+    return 0;
+}
+
+// printf with 32-bit raw arguments. Length modifiers are dropped since every
+// argument was truncated to 32 bits on the device.
+static void format_message(char *out, size_t size, const char *fmt, const uint32_t *args)
+{
+    size_t n = 0;
+    int next_arg = 0;
+
+    while (*fmt && n + 1 < size) {
+        if (*fmt != '%') {
+            out[n++] = *fmt++;
+            continue;
+        }
+        if (fmt[1] == '%') {
+            out[n++] = '%';
+            fmt += 2;
+            continue;
+        }
+
+        char spec[32];
+        size_t len = 0;
+        spec[len++] = *fmt++;
+        while (*fmt && strchr("-+ #0123456789.", *fmt) && len < sizeof(spec) - 2) {
+            spec[len++] = *fmt++;
+        }
+        while (*fmt && strchr("hlLzjt", *fmt)) fmt++;
+        char conv = *fmt ? *fmt++ : 'd';
+        spec[len++] = conv;
+        spec[len] = 0;
+
+        uint32_t arg = next_arg < TRACELOG_MAX_ARGS ? args[next_arg] : 0;
+        next_arg++;
+
+        int w;
+        switch (conv) {
+        case 'd':
+        case 'i':
+            w = snprintf(out + n, size - n, spec, (int32_t)arg);
+            break;
+        case 's': {
+            const char *str = target_string(arg);
+            if (str) {
+                w = snprintf(out + n, size - n, spec, str);
+            } else {
+                w = snprintf(out + n, size - n, "<str 0x%08x>", arg);
+            }
+            break;
+        }
+        case 'p':
+            w = snprintf(out + n, size - n, "0x%08x", arg);
+            break;
+        case 'f':
+        case 'e':
+        case 'g':
+            w = snprintf(out + n, size - n, "<float 0x%08x>", arg);
+            break;
+        default:
+            w = snprintf(out + n, size - n, spec, arg);
+            break;
+        }
+        if (w < 0) break;
+        n += (size_t)w < size - n ? (size_t)w : size - n - 1;
+    }
+    out[n] = 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <application.elf> < console.log\n", argv[0]);
+        return 2;
+    }
+    if (load_elf(argv[1]) != 0) return 1;
+
+    char line[1024];
+    int have_seq = 0;
+    uint32_t next_seq = 0;
+    uint32_t last_ts = 0;
+    uint64_t ts_high = 0;
+
+    while (fgets(line, sizeof(line), stdin)) {
+        char *rec_text = strstr(line, TRACELOG_LINE_PREFIX);
+        tracelog_record_t rec;
+        if (!rec_text || strlen(rec_text) < TRACELOG_LINE_PREFIX_LEN + TRACELOG_RECORD_SIZE / 3 * 4
+            || decode_record(rec_text + TRACELOG_LINE_PREFIX_LEN, &rec) != 0) {
+            fputs(line, stdout);
+            continue;
+        }
+        // Text the record interrupted, if any
+        fwrite(line, 1, rec_text - line, stdout);
+
+        // Sequence numbers and the clock start again at every boot
+        if (have_seq && rec.seq < next_seq) {
+            printf("# device restarted\n");
+            last_ts = 0;
+            ts_high = 0;
+        } else if (have_seq && rec.seq != next_seq) {
+            printf("# %u trace records dropped\n", rec.seq - next_seq);
+        }
+        have_seq = 1;
+        next_seq = rec.seq + 1;
+
+        // The device only sends the low 32 bits of its microsecond clock
+        if (rec.timestamp_us < last_ts) ts_high += 1ULL << 32;
+        last_ts = rec.timestamp_us;
+        uint64_t ts = ts_high | rec.timestamp_us;
+
+        const uint8_t *site = target_ptr(rec.site, TRACELOG_SITE_SIZE);
+        const char *tag = site ? target_string(rd32(site)) : NULL;
+        const char *fmt = site ? target_string(rd32(site + 4)) : NULL;
+        if (!tag || !fmt) {
+            printf("? (%llu.%06llu) unknown trace site 0x%08x\n",
+                   (unsigned long long)(ts / 1000000), (unsigned long long)(ts % 1000000), rec.site);
+            continue;
+        }
+
+        char msg[512];
+        format_message(msg, sizeof(msg), fmt, rec.args);
+        printf("%c (%llu.%06llu) %s: %s\n", (char)rd32(site + 8),
+               (unsigned long long)(ts / 1000000), (unsigned long long)(ts % 1000000), tag, msg);
+    }
+    return 0;
+}
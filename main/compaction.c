@@ -0,0 +1,86 @@
+#include <time.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "perf.h"
+#include "time_tracker.h"
+#include "compaction.h"
+
+#define TAG "compact"
+
+#define COMPACT_TASK_STACK 3072
+
+static TaskHandle_t compact_task;
+static compaction_report_t report;
+static portMUX_TYPE report_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void compact_pass(void)
+{
+    uint32_t age = CONFIG_JOURNAL_COMPACT_AGE_DAYS * 86400;
+    uint32_t now = time(NULL);
+    if (age == 0 || now <= age) return;
+
+    compact_stats_t stats = {0};
+    esp_err_t err;
+    perf_ui_loop_max_gap_take();
+    int64_t t0 = esp_timer_get_time();
+    do {
+        // One page per lock, then the UI gets the CPU back before the next
+        session_journal_lock();
+        err = compact_oldest_page(&session_journal, &session_archive, now - age, &stats);
+        session_journal_unlock();
+        vTaskDelay(1);
+    } while (err == ESP_OK);
+    uint32_t elapsed_ms = (esp_timer_get_time() - t0) / 1000;
+    uint32_t ui_gap_us = perf_ui_loop_max_gap_take();
+
+    if (err != ESP_ERR_NOT_FOUND) {
+        ESP_LOGE(TAG, "Compaction stopped: %s", esp_err_to_name(err));
+    }
+    if (stats.pages_erased) {
+        ESP_LOGI(TAG, "%u pages erased, %u sessions into %u records, %u bytes reclaimed, UI gap up to %u ms",
+                 stats.pages_erased, stats.sessions_merged, stats.records_written, stats.bytes_reclaimed,
+                 ui_gap_us / 1000);
+    }
+
+    portENTER_CRITICAL(&report_lock);
+    report.total.pages_erased += stats.pages_erased;
+    report.total.sessions_merged += stats.sessions_merged;
+    report.total.records_written += stats.records_written;
+    report.total.bytes_reclaimed += stats.bytes_reclaimed;
+    report.passes++;
+    report.last_pass_ms = elapsed_ms;
+    if (ui_gap_us > report.max_ui_gap_us) report.max_ui_gap_us = ui_gap_us;
+    portEXIT_CRITICAL(&report_lock);
+}
+
+static void compact_task_fn(void *arg)
+{
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(CONFIG_JOURNAL_COMPACT_PERIOD_MIN * 60 * 1000));
+        compact_pass();
+    }
+}
+
+void compaction_start(void)
+{
+    if (session_archive.page_count == 0) {
+        ESP_LOGW(TAG, "No archive, old sessions are only dropped when the journal is full");
+        return;
+    }
+    xTaskCreate(compact_task_fn, "compact", COMPACT_TASK_STACK, NULL, tskIDLE_PRIORITY, &compact_task);
+}
+
+void compaction_run(void)
+{
+    if (compact_task) xTaskNotifyGive(compact_task);
+}
+
+void compaction_report_get(compaction_report_t *out)
+{
+    portENTER_CRITICAL(&report_lock);
+    *out = report;
+    portEXIT_CRITICAL(&report_lock);
+}
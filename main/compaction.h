@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdint.h>
+#include "compact.h"
+
+typedef struct {
+    compact_stats_t total;      // since boot
+    uint32_t passes;
+    uint32_t last_pass_ms;
+    uint32_t max_ui_gap_us;     // longest UI loop pass seen during compaction
+} compaction_report_t;
+
+// Start the background task merging old sessions into the archive, see
+// CONFIG_JOURNAL_COMPACT_AGE_DAYS
+void compaction_start(void);
+
+// Run a pass now instead of waiting for the next one
+void compaction_run(void);
+
+void compaction_report_get(compaction_report_t *report);
@@ -0,0 +1,791 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_console.h"
+#include "driver/usb_serial_jtag.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "lvgl.h"
+#include "perf.h"
+#include "tracelog.h"
+#include "journal_partition.h"
+#include "journal_export.h"
+#include "sync_sender.h"
+#include "compaction.h"
+#include "storage.h"
+#include "stats_chart.h"
+#include "lvgl_blend.h"
+#include "lvgl_heap.h"
+#include "session_clock.h"
+#include "ui_fonts.h"
+#include "time_tracker.h"
+#include "console.h"
+
+#define TAG "console"
+
+// Below the UI loop, so a long dump only runs when the UI is idle
+#define CONSOLE_TASK_PRIORITY 1
+#define CONSOLE_TASK_STACK 4096
+
+// Sessions copied out of the journal per lock
+#define DUMP_CHUNK 16
+
+#define SCRATCH_PARTITION "scratch"
+
+static tembed_t console_tembed;
+
+// min / avg / max of a benchmark, in microseconds
+typedef struct {
+    uint32_t count;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint64_t sum_us;
+} bench_stats_t;
+
+static void bench_add(bench_stats_t *stats, int64_t us)
+{
+    if (stats->count == 0 || us < stats->min_us) stats->min_us = us;
+    if (us > stats->max_us) stats->max_us = us;
+    stats->sum_us += us;
+    stats->count++;
+}
+
+static void bench_print(const char *name, const bench_stats_t *stats)
+{
+    if (stats->count == 0) {
+        printf("%s: no samples\n", name);
+        return;
+    }
+    printf("%s: %u runs, min %u avg %u max %u us\n", name, stats->count,
+           stats->min_us, (uint32_t)(stats->sum_us / stats->count), stats->max_us);
+}
+
+static uint32_t arg_count(int argc, char **argv, int index, uint32_t def)
+{
+    if (argc <= index) return def;
+    uint32_t n = strtoul(argv[index], NULL, 0);
+    return n ? n : def;
+}
+
+static void format_time(char *buf, size_t size, time_t t)
+{
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    strftime(buf, size, "%Y-%m-%d %H:%M:%S", &tm);
+}
+
+static int cmd_activities(int argc, char **argv)
+{
+    // A racy read is fine here, these only change once per session
+    for (int i = 0; i < LABEL_COUNT; i++) {
+        uint32_t total_s = labels[i].total_time_ms / 1000;
+        uint32_t current_s = labels[i].current_time_ms / 1000;
+        printf("%d %-10s %4u:%02u:%02u%s\n", i, labels[i].name,
+               total_s / 3600, total_s / 60 % 60, total_s % 60,
+               i == running_label_index ? "  running" : "");
+        if (i == running_label_index) {
+            printf("  current %u:%02u:%02u\n", current_s / 3600, current_s / 60 % 60, current_s % 60);
+        }
+    }
+    return 0;
+}
+
+// Copy up to `max` sessions from `*pos` on and advance it, with their
+// positions if `positions` is not NULL. Callers print them without the lock,
+// so the UI only ever waits for one chunk even if the console is slow to drain.
+// `it` keeps the decoding state between chunks, a chunk that starts where the
+// last one ended does not decode its page from the start again.
+static int read_chunk(journal_iter_t *it, journal_pos_t *pos, session_record_t *chunk, journal_pos_t *positions, int max)
+{
+    int n = 0;
+    session_journal_lock();
+    if (it->journal != &session_journal || it->pos != *pos) {
+        journal_iter_init(it, &session_journal, *pos);
+    }
+    while (n < max && journal_iter_next(it, &chunk[n], positions ? &positions[n] : NULL)) {
+        n++;
+    }
+    *pos = it->pos;
+    session_journal_unlock();
+    return n;
+}
+
+static const char *activity_name(uint8_t activity)
+{
+    return activity < LABEL_COUNT ? labels[activity].name : "?";
+}
+
+static int cmd_sessions(int argc, char **argv)
+{
+    // Only the last `limit` sessions if given
+    uint32_t limit = arg_count(argc, argv, 1, 0);
+
+    session_journal_lock();
+    journal_pos_t pos = journal_begin(&session_journal);
+    if (limit) {
+        pos = journal_rewind(&session_journal, journal_end(&session_journal), limit);
+    }
+    session_journal_unlock();
+
+    session_record_t chunk[DUMP_CHUNK];
+    journal_pos_t positions[DUMP_CHUNK];
+    uint32_t total = 0;
+    int n;
+    journal_iter_t it = {0};
+    while ((n = read_chunk(&it, &pos, chunk, positions, DUMP_CHUNK)) > 0) {
+        for (int i = 0; i < n; i++) {
+            char start[24];
+            format_time(start, sizeof(start), chunk[i].start);
+            printf("%s %6u s  %s\n", start, chunk[i].duration, activity_name(chunk[i].activity));
+        }
+        total += n;
+    }
+    printf("%u sessions\n", total);
+    return 0;
+}
+
+// Sessions of one day (UTC) and the time spent on each activity
+static int cmd_day(int argc, char **argv)
+{
+    struct tm tm = {0};
+    time_t now = time(NULL);
+    gmtime_r(&now, &tm);
+    if (argc > 1) {
+        if (sscanf(argv[1], "%d-%d-%d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday) != 3) {
+            printf("usage: day [YYYY-MM-DD]\n");
+            return 1;
+        }
+        tm.tm_year -= 1900;
+        tm.tm_mon -= 1;
+    }
+    tm.tm_hour = tm.tm_min = tm.tm_sec = 0;
+    tm.tm_isdst = 0;
+    uint32_t from = mktime(&tm);
+    uint32_t to = from + 24 * 3600;
+
+    int64_t t0 = esp_timer_get_time();
+    session_journal_lock();
+    journal_pos_t pos = journal_seek_time(&session_journal, from);
+    session_journal_unlock();
+    uint32_t seek_us = esp_timer_get_time() - t0;
+
+    uint32_t totals[LABEL_COUNT] = {0};
+    session_record_t chunk[DUMP_CHUNK];
+    int n;
+    bool done = false;
+    journal_iter_t it = {0};
+    while (!done && (n = read_chunk(&it, &pos, chunk, NULL, DUMP_CHUNK)) > 0) {
+        for (int i = 0; i < n && !done; i++) {
+            if (chunk[i].start >= to) {
+                done = true;
+                break;
+            }
+            char start[24];
+            format_time(start, sizeof(start), chunk[i].start);
+            printf("%s %6u s  %s\n", start, chunk[i].duration, activity_name(chunk[i].activity));
+            if (chunk[i].activity < LABEL_COUNT) totals[chunk[i].activity] += chunk[i].duration;
+        }
+    }
+    for (int i = 0; i < LABEL_COUNT; i++) {
+        if (totals[i]) printf("%-10s %u:%02u\n", labels[i].name, totals[i] / 3600, totals[i] / 60 % 60);
+    }
+    printf("seek %u us\n", seek_us);
+    return 0;
+}
+
+typedef struct {
+    rollup_t rollup;
+    uint32_t get_us;
+} stats_call_t;
+
+// The running session is the UI loop's, read it there
+static void stats_get_on_ui(void *arg)
+{
+    stats_call_t *call = arg;
+    int64_t t0 = esp_timer_get_time();
+    tracker_rollup_get(&call->rollup);
+    call->get_us = esp_timer_get_time() - t0;
+}
+
+static int cmd_stats(int argc, char **argv)
+{
+    stats_call_t call;
+    tracker_run_on_ui(stats_get_on_ui, &call);
+
+    printf("%-10s %8s %8s %8s\n", "", "today", "week", "month");
+    for (int i = 0; i < LABEL_COUNT && i < ROLLUP_MAX_ACTIVITIES; i++) {
+        printf("%-10s", labels[i].name);
+        for (int p = 0; p < ROLLUP_PERIOD_COUNT; p++) {
+            uint32_t s = call.rollup.seconds[p][i];
+            printf(" %5u:%02u", s / 3600, s / 60 % 60);
+        }
+        printf("\n");
+    }
+    printf("%u us\n", call.get_us);
+    return 0;
+}
+
+static int cmd_compact(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "now") == 0) {
+        compaction_run();
+        printf("compaction started, run compact again for the results\n");
+        return 0;
+    }
+
+    compaction_report_t report;
+    compaction_report_get(&report);
+    session_journal_lock();
+    uint32_t journal_pages = session_journal.head_seq ? session_journal.head_seq - session_journal.tail_seq + 1 : 0;
+    uint32_t archive_pages = session_archive.head_seq ? session_archive.head_seq - session_archive.tail_seq + 1 : 0;
+    uint32_t page_count = session_journal.page_count;
+    uint32_t archive_count = session_archive.page_count;
+    session_journal_unlock();
+
+    printf("journal %u/%u pages, archive %u/%u pages, keeping %u days\n",
+           journal_pages, page_count, archive_pages, archive_count, CONFIG_JOURNAL_COMPACT_AGE_DAYS);
+    printf("%u passes: %u pages erased, %u sessions into %u records, %u bytes reclaimed\n",
+           report.passes, report.total.pages_erased, report.total.sessions_merged,
+           report.total.records_written, report.total.bytes_reclaimed);
+    printf("last pass %u ms, longest UI loop pass during compaction %u us\n",
+           report.last_pass_ms, report.max_ui_gap_us);
+    return 0;
+}
+
+// Machine readable dump for the companion app. Each line is encoded and
+// written on its own, so memory use does not depend on the history length.
+static int cmd_export(int argc, char **argv)
+{
+    journal_export_format_t format;
+    if (argc < 2 || !journal_export_parse_format(argv[1], &format)) {
+        printf("usage: export csv|json [cursor]\n");
+        return 1;
+    }
+    journal_pos_t pos = argc > 2 ? strtoul(argv[2], NULL, 0) : 0;
+
+    size_t heap_before = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+    size_t heap_low = heap_before;
+    int64_t t0 = esp_timer_get_time();
+
+    char line[JOURNAL_EXPORT_LINE_MAX];
+    size_t len = journal_export_header(format, line, sizeof(line));
+    fwrite(line, 1, len, stdout);
+
+    session_record_t chunk[DUMP_CHUNK];
+    journal_pos_t positions[DUMP_CHUNK];
+    uint32_t total = 0;
+    int n;
+    journal_iter_t it = {0};
+    while ((n = read_chunk(&it, &pos, chunk, positions, DUMP_CHUNK)) > 0) {
+        for (int i = 0; i < n; i++) {
+            len = journal_export_record(format, &chunk[i], positions[i], activity_name(chunk[i].activity),
+                                        line, sizeof(line));
+            fwrite(line, 1, len, stdout);
+        }
+        total += n;
+        size_t heap = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+        if (heap < heap_low) heap_low = heap;
+    }
+    fflush(stdout);
+
+    // After the data, so the app can stop reading at the first '#' line
+    uint32_t elapsed_ms = (esp_timer_get_time() - t0) / 1000;
+    printf("# %u sessions, cursor %u, %u ms, %u sessions/s, peak heap %u B\n", total, pos, elapsed_ms,
+           elapsed_ms ? (uint32_t)((uint64_t)total * 1000 / elapsed_ms) : total, heap_before - heap_low);
+    return 0;
+}
+
+static int sync_read(void *ctx, journal_pos_t *pos, session_record_t *recs, int max)
+{
+    static journal_iter_t it;
+    return read_chunk(&it, pos, recs, NULL, max);
+}
+
+static void sync_pages(void *ctx, uint32_t *tail, uint32_t *head)
+{
+    session_journal_lock();
+    *tail = session_journal.tail_seq;
+    *head = session_journal.head_seq;
+    session_journal_unlock();
+}
+
+static bool sync_read_page(void *ctx, uint32_t seq, uint32_t offset, uint8_t *dst, size_t len)
+{
+    session_journal_lock();
+    esp_err_t err = journal_read_page(&session_journal, seq, offset, dst, len);
+    session_journal_unlock();
+    return err == ESP_OK;
+}
+
+static void sync_write(void *ctx, const uint8_t *data, size_t len)
+{
+    usb_serial_jtag_write_bytes(data, len, portMAX_DELAY);
+}
+
+static uint32_t now_ms(void)
+{
+    return esp_timer_get_time() / 1000;
+}
+
+static int sync_quiet_vprintf(const char *fmt, va_list args)
+{
+    return 0;
+}
+
+// Binary sync with the companion app on this port, until it is done or the
+// app goes quiet. See sync_proto.h for the protocol.
+static int cmd_sync(int argc, char **argv)
+{
+    static const sync_io_t io = {
+        .read = sync_read,
+        .write = sync_write,
+        .pages = sync_pages,
+        .read_page = sync_read_page,
+    };
+    static sync_sender_t sender;
+    sync_sender_init(&sender, &io, CONFIG_SYNC_WINDOW, CONFIG_SYNC_RETRANSMIT_MS, CONFIG_SYNC_TIMEOUT_MS, now_ms());
+
+    // Log lines would only cost retransmissions, but keep the link for the
+    // data. Trace records are raw bytes that would break the framing. The
+    // lines are dropped at the output, so the levels set per tag stay.
+    vprintf_like_t log_vprintf = esp_log_set_vprintf(sync_quiet_vprintf);
+    tracelog_pause();
+    int64_t t0 = esp_timer_get_time();
+
+    uint8_t buf[64];
+    sync_state_t state;
+    while ((state = sync_sender_poll(&sender, now_ms())) != SYNC_DONE && state != SYNC_FAILED) {
+        int n = usb_serial_jtag_read_bytes(buf, sizeof(buf), pdMS_TO_TICKS(5));
+        if (n > 0) {
+            sync_sender_input(&sender, buf, n, now_ms());
+        }
+    }
+
+    tracelog_resume();
+    esp_log_set_vprintf(log_vprintf);
+    uint32_t elapsed_ms = (esp_timer_get_time() - t0) / 1000;
+    ESP_LOGI(TAG, "sync %s: %u sessions, %u pages in %u frames (%u resent), %u B, %u ms",
+             state == SYNC_DONE ? "done" : "failed", sender.records, sender.pages, sender.frames,
+             sender.retransmits, sender.bytes, elapsed_ms);
+    return state == SYNC_DONE ? 0 : 1;
+}
+
+static int cmd_perf(int argc, char **argv)
+{
+    perf_frame_counters_t frames;
+    perf_frame_counters_get(&frames);
+    uint32_t n = frames.frames ? frames.frames : 1;
+    printf("frames %u, render avg %u max %u us, flush avg %u max %u us\n", frames.frames,
+           (uint32_t)(frames.render_us / n), frames.render_max_us,
+           (uint32_t)(frames.flush_us / n), frames.flush_max_us);
+
+    static const char *const source_names[PERF_INPUT_SOURCE_MAX] = { "knob", "button" };
+    for (int src = 0; src < PERF_INPUT_SOURCE_MAX; src++) {
+        perf_latency_stats_t lat;
+        perf_latency_get(src, &lat);
+        printf("%-6s %u events (%u merged), p50 %u p90 %u p99 %u max %u us\n", source_names[src],
+               lat.count, lat.merged, lat.p50_us, lat.p90_us, lat.p99_us, lat.max_us);
+    }
+
+    uint32_t depth, max_depth;
+    perf_input_queue_get(&depth, &max_depth);
+    printf("input queue %u, max %u\n", depth, max_depth);
+
+    storage_stats_t storage;
+    storage_stats_get(&storage);
+    printf("storage %u writes, %u erase steps, %u waited for a frame (max %u us), longest cache-off step %u us\n",
+           storage.writes, storage.erase_steps, storage.deferred, storage.max_wait_us, storage.max_cache_off_us);
+
+    printf("internal heap %u free, %u min, %u largest\n",
+           heap_caps_get_free_size(MALLOC_CAP_INTERNAL),
+           heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL),
+           heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL));
+    printf("psram %u free, %u min\n",
+           heap_caps_get_free_size(MALLOC_CAP_SPIRAM),
+           heap_caps_get_minimum_free_size(MALLOC_CAP_SPIRAM));
+
+    static const char *const pool_names[LVGL_HEAP_POOLS] = { "internal", "psram" };
+    for (int pool = 0; pool < LVGL_HEAP_POOLS; pool++) {
+        lvgl_heap_stats_t heap;
+        lvgl_heap_stats_get(pool, &heap);
+        printf("lvgl %-8s %u of %u used, max %u, largest free %u, frag %u%%, %u blocks, %u allocs, "
+               "%u spilled, %u failed\n", pool_names[pool], heap.used, heap.size, heap.max_used,
+               heap.largest_free, heap.frag_pct, heap.blocks, heap.allocs, heap.spilled, heap.failed);
+    }
+    stats_chart_stats_t chart;
+    stats_chart_stats_get(&chart);
+    printf("stats chart %u redraws (last %u us, max %u us), %u from the buffer, %u lvgl objects\n",
+           chart.redraws, chart.last_us, chart.max_us, chart.cached, chart.objects);
+    session_clock_stats_t clock;
+    session_clock_stats_get(&clock);
+    printf("session clock %u updates, %u digit cells redrawn\n", clock.updates, clock.cells);
+    ui_fonts_stats_t fonts;
+    ui_fonts_stats_get(&fonts);
+    printf("ui fonts %u glyphs from the fallback, last U+%04X\n", fonts.misses, fonts.last_miss);
+    lvgl_blend_stats_t blend;
+    lvgl_blend_stats_get(&blend);
+    const draw565_kernels_t *kernels = lvgl_blend_kernels();
+    printf("fills %s: %u fills, %llu pixels, %u left to lvgl\n", kernels ? kernels->name : "stock",
+           blend.fills, blend.pixels, blend.stock);
+    printf("trace records dropped %u\n", tracelog_dropped());
+    return 0;
+}
+
+// Redraw the whole screen once, run in the UI loop
+static void bench_redraw_once(void *arg)
+{
+    int64_t t0 = esp_timer_get_time();
+    lv_obj_invalidate(lv_disp_get_scr_act(lvgl_disp));
+    lv_refr_now(lvgl_disp);
+    bench_add(arg, esp_timer_get_time() - t0);
+}
+
+static void bench_redraw_with(const char *name, uint32_t runs)
+{
+    bench_stats_t stats = {0};
+    perf_frame_counters_t before, after;
+    perf_frame_counters_get(&before);
+    for (uint32_t i = 0; i < runs; i++) {
+        // One frame per call, input keeps being handled in between
+        tracker_run_on_ui(bench_redraw_once, &stats);
+    }
+    perf_frame_counters_get(&after);
+
+    bench_print(name, &stats);
+    uint32_t frames = after.frames - before.frames;
+    if (frames) {
+        printf("  render avg %u us, flush avg %u us over %u frames\n",
+               (uint32_t)((after.render_us - before.render_us) / frames),
+               (uint32_t)((after.flush_us - before.flush_us) / frames), frames);
+    }
+}
+
+// Switch kernels in the UI loop, between two frames, so no frame mixes sets
+static void bench_use_kernels(void *arg)
+{
+    lvgl_blend_use(arg);
+}
+
+// With LVGL's own fills, then the draw565 kernels
+static void bench_redraw(uint32_t runs)
+{
+    static const draw565_kernels_t *const backends[] = { NULL, &draw565_vector };
+    const draw565_kernels_t *configured = lvgl_blend_kernels();
+    for (int i = 0; i < sizeof(backends) / sizeof(backends[0]); i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "redraw %s", backends[i] ? backends[i]->name : "stock");
+        tracker_run_on_ui(bench_use_kernels, (void *)backends[i]);
+        bench_redraw_with(name, runs);
+    }
+    tracker_run_on_ui(bench_use_kernels, (void *)configured);
+}
+
+static void bench_led(uint32_t runs)
+{
+#ifdef CONFIG_TEMBED_INIT_LEDS
+    bench_stats_t stats = {0};
+    for (uint32_t i = 0; i < runs; i++) {
+        int64_t t0 = esp_timer_get_time();
+        apa102_startFrame(&console_tembed->leds);
+        for (int led = 0; led < CONFIG_APA102_LED_COUNT; led++) {
+            apa102_sendColor(&console_tembed->leds, 0, 0, 0, 0);
+        }
+        apa102_endFrame(&console_tembed->leds, CONFIG_APA102_LED_COUNT);
+        bench_add(&stats, esp_timer_get_time() - t0);
+    }
+    bench_print("led frame", &stats);
+#else
+    printf("LEDs are disabled\n");
+#endif
+}
+
+// Append to a journal on the scratch partition, the session log is untouched
+static void bench_journal(uint32_t runs)
+{
+    journal_t journal;
+    esp_err_t err = journal_open_partition(&journal, SCRATCH_PARTITION);
+    if (err != ESP_OK) {
+        printf("%s: %s\n", SCRATCH_PARTITION, esp_err_to_name(err));
+        return;
+    }
+    storage_route(&journal.flash);
+
+    int64_t t0 = esp_timer_get_time();
+    err = journal_format(&journal);
+    printf("format %u kB: %u us\n", journal.page_count * JOURNAL_PAGE_SIZE / 1024,
+           (uint32_t)(esp_timer_get_time() - t0));
+    if (err != ESP_OK) {
+        printf("format failed: %s\n", esp_err_to_name(err));
+        journal_close(&journal);
+        return;
+    }
+
+    bench_stats_t stats = {0};
+    session_record_t rec = { .start = 1000000, .duration = 60, .activity = 0 };
+    for (uint32_t i = 0; i < runs; i++) {
+        t0 = esp_timer_get_time();
+        err = journal_append(&journal, &rec);
+        bench_add(&stats, esp_timer_get_time() - t0);
+        if (err != ESP_OK) {
+            printf("append failed: %s\n", esp_err_to_name(err));
+            break;
+        }
+        rec.start += rec.duration;
+    }
+    bench_print("journal append", &stats);
+
+    // Read back in place through the flash cache and through copies
+    const uint8_t *mapped = journal.flash.mapped;
+    for (int copy = 0; copy < 2; copy++) {
+        if (copy == 0 && mapped == NULL) continue;
+        journal.flash.mapped = copy ? NULL : mapped;
+        journal_iter_t it;
+        uint32_t n = 0;
+        size_t heap_before = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+        t0 = esp_timer_get_time();
+        journal_iter_init(&it, &journal, journal_begin(&journal));
+        while (journal_iter_next(&it, &rec, NULL)) {
+            n++;
+        }
+        uint32_t us = esp_timer_get_time() - t0;
+        printf("journal read %s: %u records in %u us, %u records/s, heap %d B\n", copy ? "copied" : "mapped", n, us,
+               us ? (uint32_t)((uint64_t)n * 1000000 / us) : n,
+               (int)(heap_before - heap_caps_get_free_size(MALLOC_CAP_DEFAULT)));
+    }
+    journal.flash.mapped = mapped;
+
+    // Seek to times spread over the history
+    bench_stats_t seek = {0};
+    uint32_t first = 1000000;
+    for (uint32_t i = 0; i < 100; i++) {
+        uint32_t target = first + (rec.start - first) / 100 * i + 30;
+        t0 = esp_timer_get_time();
+        journal_seek_time(&journal, target);
+        bench_add(&seek, esp_timer_get_time() - t0);
+    }
+    bench_print("journal seek", &seek);
+    journal_close(&journal);
+}
+
+// Storage stress test: sessions are logged to the scratch journal as fast
+// as the storage task takes them while the screen redraws every frame
+static lv_timer_t *stress_redraw_timer;
+static int64_t knob_probe_last_us;
+static uint32_t knob_probe_max_gap_us;
+static uint32_t knob_probe_late;
+
+static void stress_redraw_cb(lv_timer_t *timer)
+{
+    lv_obj_invalidate(lv_disp_get_scr_act(lvgl_disp));
+}
+
+// Both run in the UI loop
+static void stress_redraw_start(void *arg)
+{
+    stress_redraw_timer = lv_timer_create(stress_redraw_cb, CONFIG_LV_DISP_DEF_REFR_PERIOD, NULL);
+}
+
+static void stress_redraw_stop(void *arg)
+{
+    lv_timer_del(stress_redraw_timer);
+    stress_redraw_timer = NULL;
+}
+
+// Polls like the knob driver does, on the esp_timer task at the same period.
+// The driver needs CONFIG_KNOB_DEBOUNCE_TICKS polls in a row to see an edge,
+// so a poll that comes a whole period late can lose a detent.
+static void knob_probe_cb(void *arg)
+{
+    int64_t now = esp_timer_get_time();
+    if (knob_probe_last_us) {
+        uint32_t gap = now - knob_probe_last_us;
+        if (gap > knob_probe_max_gap_us) knob_probe_max_gap_us = gap;
+        if (gap > 2 * CONFIG_KNOB_PERIOD_TIME_MS * 1000) knob_probe_late++;
+    }
+    knob_probe_last_us = now;
+}
+
+static void bench_storage(uint32_t seconds)
+{
+    journal_t journal;
+    esp_err_t err = journal_open_partition(&journal, SCRATCH_PARTITION);
+    if (err != ESP_OK) {
+        printf("%s: %s\n", SCRATCH_PARTITION, esp_err_to_name(err));
+        return;
+    }
+    storage_route(&journal.flash);
+
+    esp_timer_handle_t probe;
+    const esp_timer_create_args_t probe_args = {
+        .callback = &knob_probe_cb,
+        .name = "knob_probe"
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&probe_args, &probe));
+    knob_probe_last_us = 0;
+    knob_probe_max_gap_us = 0;
+    knob_probe_late = 0;
+
+    storage_stats_t before, after;
+    perf_frame_counters_t frames_before, frames_after;
+    storage_stats_get(&before);
+    perf_frame_counters_get(&frames_before);
+    storage_max_cache_off_take();
+    perf_frame_max_take();
+    tracker_run_on_ui(stress_redraw_start, NULL);
+    ESP_ERROR_CHECK(esp_timer_start_periodic(probe, CONFIG_KNOB_PERIOD_TIME_MS * 1000));
+
+    // Formatting is part of the test, it erases the whole partition
+    int64_t t0 = esp_timer_get_time();
+    err = journal_format(&journal);
+    session_record_t rec = { .start = 1000000, .duration = 60, .activity = 0 };
+    uint32_t sessions = 0;
+    while (err == ESP_OK && esp_timer_get_time() - t0 < seconds * 1000000LL) {
+        err = journal_append(&journal, &rec);
+        rec.start += rec.duration;
+        rec.activity = (rec.activity + 1) % LABEL_COUNT;
+        sessions++;
+    }
+
+    esp_timer_stop(probe);
+    esp_timer_delete(probe);
+    tracker_run_on_ui(stress_redraw_stop, NULL);
+    uint32_t frame_max_us = perf_frame_max_take();
+    uint32_t cache_off_us = storage_max_cache_off_take();
+    storage_stats_get(&after);
+    perf_frame_counters_get(&frames_after);
+    journal_close(&journal);
+
+    if (err != ESP_OK) {
+        printf("append failed: %s\n", esp_err_to_name(err));
+    }
+    uint32_t budget_us = CONFIG_LV_DISP_DEF_REFR_PERIOD * 1000;
+    printf("%u sessions in %u s: %u writes, %u erase steps, %u waited for a frame\n", sessions, seconds,
+           after.writes - before.writes, after.erase_steps - before.erase_steps, after.deferred - before.deferred);
+    printf("frames %u, longest %u us, budget %u us\n", frames_after.frames - frames_before.frames,
+           frame_max_us, budget_us);
+    printf("longest cache-off step %u us\n", cache_off_us);
+    printf("knob polls: longest gap %u us, %u late\n", knob_probe_max_gap_us, knob_probe_late);
+    printf("%s\n", err == ESP_OK && frame_max_us <= budget_us && knob_probe_late == 0 ? "PASS" : "FAIL");
+}
+
+static int cmd_bench(int argc, char **argv)
+{
+    if (argc < 2) {
+        printf("usage: bench redraw|led|journal|storage [runs|seconds]\n");
+        return 1;
+    }
+    if (strcmp(argv[1], "redraw") == 0) {
+        bench_redraw(arg_count(argc, argv, 2, 20));
+    } else if (strcmp(argv[1], "led") == 0) {
+        bench_led(arg_count(argc, argv, 2, 100));
+    } else if (strcmp(argv[1], "journal") == 0) {
+        bench_journal(arg_count(argc, argv, 2, 500));
+    } else if (strcmp(argv[1], "storage") == 0) {
+        bench_storage(arg_count(argc, argv, 2, 10));
+    } else {
+        printf("unknown benchmark %s\n", argv[1]);
+        return 1;
+    }
+    return 0;
+}
+
+static int cmd_time(int argc, char **argv)
+{
+    if (argc > 1) {
+        struct timeval tv = { .tv_sec = strtoul(argv[1], NULL, 0) };
+        settimeofday(&tv, NULL);
+    }
+    char buf[24];
+    format_time(buf, sizeof(buf), time(NULL));
+    printf("%s UTC (%u)\n", buf, (uint32_t)time(NULL));
+    return 0;
+}
+
+static const esp_console_cmd_t commands[] = {
+    {
+        .command = "activities",
+        .help = "List the activities and their total time",
+        .func = cmd_activities,
+    },
+    {
+        .command = "sessions",
+        .help = "Dump the session log, or only the last [count] sessions",
+        .hint = "[count]",
+        .func = cmd_sessions,
+    },
+    {
+        .command = "day",
+        .help = "List the sessions of a day (UTC), today by default",
+        .hint = "[YYYY-MM-DD]",
+        .func = cmd_day,
+    },
+    {
+        .command = "compact",
+        .help = "Report on merging old sessions into the archive, or run a pass now",
+        .hint = "[now]",
+        .func = cmd_compact,
+    },
+    {
+        .command = "stats",
+        .help = "Time per activity today, this week and this month (UTC)",
+        .func = cmd_stats,
+    },
+    {
+        .command = "export",
+        .help = "Export the session log as CSV or JSON lines, from [cursor] on",
+        .hint = "csv|json [cursor]",
+        .func = cmd_export,
+    },
+    {
+        .command = "sync",
+        .help = "Send the sessions the companion app does not have yet (binary)",
+        .func = cmd_sync,
+    },
+    {
+        .command = "perf",
+        .help = "Print render, flush and input latency counters and heap usage",
+        .func = cmd_perf,
+    },
+    {
+        .command = "bench",
+        .help = "Run a micro-benchmark: full screen redraw, LED frame, journal append, or the storage stress test",
+        .hint = "redraw|led|journal|storage [runs|seconds]",
+        .func = cmd_bench,
+    },
+    {
+        .command = "time",
+        .help = "Print the clock, or set it to [epoch] seconds",
+        .hint = "[epoch]",
+        .func = cmd_time,
+    },
+};
+
+void console_start(tembed_t tembed)
+{
+    console_tembed = tembed;
+
+    esp_console_repl_t *repl = NULL;
+    esp_console_repl_config_t repl_config = ESP_CONSOLE_REPL_CONFIG_DEFAULT();
+    repl_config.prompt = "tt>";
+    repl_config.task_priority = CONSOLE_TASK_PRIORITY;
+    repl_config.task_stack_size = CONSOLE_TASK_STACK;
+
+    esp_console_dev_usb_serial_jtag_config_t jtag_config = ESP_CONSOLE_DEV_USB_SERIAL_JTAG_CONFIG_DEFAULT();
+    esp_err_t err = esp_console_new_repl_usb_serial_jtag(&jtag_config, &repl_config, &repl);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create the console: %s", esp_err_to_name(err));
+        return;
+    }
+
+    esp_console_register_help_command();
+    for (int i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
+        ESP_ERROR_CHECK(esp_console_cmd_register(&commands[i]));
+    }
+    ESP_ERROR_CHECK(esp_console_start_repl(repl));
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include "tembed.h"
+
+// Start the serial console on the USB-Serial/JTAG port. Commands run in a
+// task below the UI loop, type "help" for the list.
+void console_start(tembed_t tembed);
@@ -0,0 +1,106 @@
+#include "freertos/FreeRTOS.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "lvgl.h"
+#include "lvgl_heap.h"
+#include "perf.h"
+#include "diag_overlay.h"
+
+// Refreshing more often would make the overlay a noticeable part of what it measures
+#define OVERLAY_PERIOD_MS 1000
+#define OVERLAY_WIDTH 160
+#define OVERLAY_HEIGHT 84
+
+static lv_obj_t *overlay_label;
+static lv_timer_t *overlay_timer;
+
+// Previous samples, rates are computed over the time between two updates
+static perf_frame_counters_t prev_frames;
+static perf_cpu_sample_t prev_cpu;
+static bool have_prev_cpu;
+static int64_t prev_time_us;
+
+static void overlay_update(lv_timer_t *timer)
+{
+    int64_t now = esp_timer_get_time();
+    uint32_t elapsed_ms = (now - prev_time_us) / 1000;
+    prev_time_us = now;
+
+    perf_frame_counters_t frames;
+    perf_frame_counters_get(&frames);
+    uint32_t n = frames.frames - prev_frames.frames;
+    uint32_t fps = elapsed_ms ? n * 1000 / elapsed_ms : 0;
+    uint32_t render_us = n ? (frames.render_us - prev_frames.render_us) / n : 0;
+    uint32_t flush_us = n ? (frames.flush_us - prev_frames.flush_us) / n : 0;
+    prev_frames = frames;
+
+    perf_cpu_sample_t cpu;
+    uint32_t load[portNUM_PROCESSORS] = {0};
+    if (perf_cpu_sample(&cpu)) {
+        if (have_prev_cpu) {
+            for (int core = 0; core < portNUM_PROCESSORS; core++) {
+                load[core] = perf_cpu_load(&prev_cpu, &cpu, core);
+            }
+        }
+        prev_cpu = cpu;
+        have_prev_cpu = true;
+    }
+
+    lvgl_heap_stats_t lvi, lvp;
+    lvgl_heap_stats_get(LVGL_HEAP_INTERNAL, &lvi);
+    lvgl_heap_stats_get(LVGL_HEAP_PSRAM, &lvp);
+
+    uint32_t depth, max_depth;
+    perf_input_queue_get(&depth, &max_depth);
+
+    perf_latency_stats_t knob;
+    perf_latency_get(PERF_INPUT_KNOB, &knob);
+
+    lv_label_set_text_fmt(overlay_label,
+                          "fps %u r%u.%u f%u.%ums\n"
+                          "cpu %u%% %u%%\n"
+                          "int %uk min %uk\n"
+                          "psr %uk min %uk\n"
+                          "lvi %uk ^%uk f%u%%\n"
+                          "lvp %uk ^%uk f%u%%\n"
+                          "inq %u max %u\n"
+                          "knob p50 %u p99 %ums",
+                          fps, render_us / 1000, render_us / 100 % 10, flush_us / 1000, flush_us / 100 % 10,
+                          load[0], load[portNUM_PROCESSORS - 1],
+                          heap_caps_get_free_size(MALLOC_CAP_INTERNAL) / 1024,
+                          heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL) / 1024,
+                          heap_caps_get_free_size(MALLOC_CAP_SPIRAM) / 1024,
+                          heap_caps_get_minimum_free_size(MALLOC_CAP_SPIRAM) / 1024,
+                          lvi.used / 1024, lvi.max_used / 1024, lvi.frag_pct,
+                          lvp.used / 1024, lvp.max_used / 1024, lvp.frag_pct,
+                          depth, max_depth,
+                          knob.p50_us / 1000, knob.p99_us / 1000);
+}
+
+void diag_overlay_toggle(lv_obj_t *parent)
+{
+    if (overlay_label != NULL) {
+        lv_timer_del(overlay_timer);
+        lv_obj_del(overlay_label);
+        overlay_timer = NULL;
+        overlay_label = NULL;
+        return;
+    }
+
+    // Fixed size so new text never changes the layout, only this area is redrawn
+    overlay_label = lv_label_create(parent);
+    lv_obj_set_size(overlay_label, OVERLAY_WIDTH, OVERLAY_HEIGHT);
+    lv_obj_align(overlay_label, LV_ALIGN_TOP_LEFT, 0, 0);
+    lv_obj_set_style_text_font(overlay_label, &lv_font_unscii_8, LV_PART_MAIN);
+    lv_obj_set_style_text_color(overlay_label, lv_color_hex(0x00FF00), LV_PART_MAIN);
+    lv_obj_set_style_bg_color(overlay_label, lv_color_hex(0x000000), LV_PART_MAIN);
+    lv_obj_set_style_bg_opa(overlay_label, LV_OPA_COVER, LV_PART_MAIN);
+    lv_obj_set_style_pad_all(overlay_label, 2, LV_PART_MAIN);
+    lv_label_set_long_mode(overlay_label, LV_LABEL_LONG_CLIP);
+
+    perf_frame_counters_get(&prev_frames);
+    have_prev_cpu = false;
+    prev_time_us = esp_timer_get_time();
+    lv_label_set_text(overlay_label, "");
+    overlay_timer = lv_timer_create(overlay_update, OVERLAY_PERIOD_MS, NULL);
+}
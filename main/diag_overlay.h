@@ -0,0 +1,6 @@
+#pragma once
+
+#include "lvgl.h"
+
+// Show or hide the diagnostics overlay in the top left corner of `parent`
+void diag_overlay_toggle(lv_obj_t *parent);
@@ -0,0 +1,312 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "lvgl.h"
+#include "time_tracker.h"
+#include "ui_fonts.h"
+#include "history_screen.h"
+
+#define TAG "history"
+
+// Rows on screen, the only widgets the screen creates
+#define HISTORY_ROWS 6
+#define HISTORY_ROW_HEIGHT 28
+// Sessions in memory: a screenful on screen and up to one and a half on
+// either side. Each read brings one screenful.
+#define HISTORY_CACHE (4 * HISTORY_ROWS)
+
+#define HISTORY_TASK_STACK 3072
+// Below the UI loop, above the compaction
+#define HISTORY_TASK_PRIORITY 1
+
+// Sessions come from the archive, then the journal: compaction moves the
+// days it merges from one to the other, so the archive only holds older ones
+enum { SRC_ARCHIVE, SRC_JOURNAL };
+
+// Where the journal ends when the task reads it
+#define POS_NEWEST UINT32_MAX
+
+typedef struct {
+    uint8_t src;
+    journal_pos_t pos;
+} edge_t;
+
+typedef struct {
+    session_record_t rec;
+    edge_t at;
+} entry_t;
+
+typedef enum {
+    FETCH_OLDER,        // the screenful before `from`
+    FETCH_NEWER,        // the screenful from `from` on
+} fetch_dir_t;
+
+// One read, set up by the UI and filled in by the task
+typedef struct {
+    fetch_dir_t dir;
+    edge_t from;
+    uint32_t gen;
+    entry_t entries[HISTORY_ROWS];  // oldest first
+    int count;
+    edge_t end;         // after the newest entry read, or where the journal ended
+} fetch_t;
+
+static lv_obj_t *history_box;
+static lv_obj_t *rows[HISTORY_ROWS];
+
+// Loaded sessions, oldest first. `top` is the one on the first row, the rows
+// below go back in time.
+static entry_t cache[HISTORY_CACHE];
+static int cache_count;
+static int top;
+static edge_t cache_end;        // after the newest loaded session
+static bool at_oldest;
+static bool at_newest;
+
+// Incremented on every open, so a read for an earlier one is dropped
+static uint32_t gen;
+static bool fetching;
+static fetch_t fetch;
+static TaskHandle_t fetch_task;
+
+static journal_t *source(uint8_t src)
+{
+    return src == SRC_ARCHIVE ? &session_archive : &session_journal;
+}
+
+static int read_from(uint8_t src, journal_pos_t from, journal_pos_t before, entry_t *out, journal_pos_t *end)
+{
+    const journal_t *j = source(src);
+    journal_iter_t it;
+    int n = 0;
+    *end = from;
+    if (j->page_count == 0) return 0;
+
+    journal_iter_init(&it, j, from);
+    while (n < HISTORY_ROWS && journal_iter_next(&it, &out[n].rec, &out[n].at.pos) && out[n].at.pos < before) {
+        out[n].at.src = src;
+        n++;
+    }
+    *end = it.pos;
+    return n;
+}
+
+// Called with the journal lock held. Decodes the records of at most one
+// page before the screenful asked for.
+static void read_older(fetch_t *f)
+{
+    edge_t from = f->from;
+    if (from.pos == POS_NEWEST) {
+        from.pos = journal_end(&session_journal);
+    }
+    f->end = from;
+    for (;;) {
+        const journal_t *j = source(from.src);
+        journal_pos_t end;
+        f->count = j->page_count > 0
+                 ? read_from(from.src, journal_rewind(j, from.pos, HISTORY_ROWS), from.pos, f->entries, &end) : 0;
+        if (f->count > 0 || from.src == SRC_ARCHIVE) return;
+        from.src = SRC_ARCHIVE;
+        from.pos = session_archive.page_count > 0 ? journal_end(&session_archive) : 0;
+    }
+}
+
+static void read_newer(fetch_t *f)
+{
+    edge_t from = f->from;
+    for (;;) {
+        f->count = read_from(from.src, from.pos, UINT32_MAX, f->entries, &from.pos);
+        if (f->count > 0 || from.src == SRC_JOURNAL) break;
+        from.src = SRC_JOURNAL;
+        from.pos = journal_begin(&session_journal);
+    }
+    f->end = from;
+}
+
+static void format_row(char *buf, size_t size, const session_record_t *rec)
+{
+    struct tm tm;
+    time_t t = rec->start;
+    gmtime_r(&t, &tm);
+    size_t n = strftime(buf, size, "%Y-%m-%d %H:%M", &tm);
+    snprintf(buf + n, size - n, "  %3u:%02u  %s", rec->duration / 3600, rec->duration / 60 % 60,
+             rec->activity < LABEL_COUNT ? labels[rec->activity].name : "?");
+}
+
+static void render(void)
+{
+    char buf[64];
+    for (int r = 0; r < HISTORY_ROWS; r++) {
+        int i = top - r;
+        if (i >= 0 && i < cache_count) {
+            format_row(buf, sizeof(buf), &cache[i].rec);
+            lv_label_set_text(rows[r], buf);
+        } else if (r == 0) {
+            lv_label_set_text_static(rows[r], at_oldest ? "No sessions" : "Loading...");
+        } else {
+            lv_label_set_text_static(rows[r], "");
+        }
+    }
+}
+
+static void request(fetch_dir_t dir, edge_t from)
+{
+    fetch.dir = dir;
+    fetch.from = from;
+    fetch.gen = gen;
+    fetching = true;
+    xTaskNotifyGive(fetch_task);
+}
+
+// Keep a screenful loaded past both ends of the view
+static void prefetch(void)
+{
+    if (history_box == NULL || fetching || fetch_task == NULL) return;
+
+    if (cache_count == 0) {
+        if (!at_oldest) request(FETCH_OLDER, (edge_t) { SRC_JOURNAL, POS_NEWEST });
+    } else if (!at_oldest && top - (HISTORY_ROWS - 1) < HISTORY_ROWS) {
+        request(FETCH_OLDER, cache[0].at);
+    } else if (!at_newest && cache_count - 1 - top < HISTORY_ROWS) {
+        request(FETCH_NEWER, cache_end);
+    }
+}
+
+static void add_older(const fetch_t *f)
+{
+    bool first = cache_count == 0;
+    if (first) {
+        cache_end = f->end;
+    }
+    // Make room by forgetting the newest
+    if (cache_count > HISTORY_CACHE - f->count) {
+        cache_count = HISTORY_CACHE - f->count;
+        cache_end = cache[cache_count].at;
+        at_newest = false;
+    }
+    memmove(cache + f->count, cache, cache_count * sizeof(cache[0]));
+    memcpy(cache, f->entries, f->count * sizeof(cache[0]));
+    cache_count += f->count;
+    top = first ? cache_count - 1 : top + f->count;
+    if (top >= cache_count) top = cache_count - 1;
+    at_oldest = f->count == 0;
+}
+
+static void add_newer(const fetch_t *f)
+{
+    // Make room by forgetting the oldest
+    int drop = cache_count + f->count - HISTORY_CACHE;
+    if (drop > 0) {
+        memmove(cache, cache + drop, (cache_count - drop) * sizeof(cache[0]));
+        cache_count -= drop;
+        top = top > drop ? top - drop : 0;
+        at_oldest = false;
+    }
+    memcpy(cache + cache_count, f->entries, f->count * sizeof(cache[0]));
+    cache_count += f->count;
+    cache_end = f->end;
+    // Sessions recorded after this only show on the next open
+    at_newest = f->count < HISTORY_ROWS && f->end.src == SRC_JOURNAL;
+}
+
+// Runs in the UI loop, see tracker_run_on_ui()
+static void apply_fetch(void *arg)
+{
+    const fetch_t *f = arg;
+    fetching = false;
+    if (history_box != NULL && f->gen == gen) {
+        if (f->dir == FETCH_OLDER) {
+            add_older(f);
+        } else {
+            add_newer(f);
+        }
+        render();
+    }
+    prefetch();
+}
+
+static void fetch_task_fn(void *arg)
+{
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        session_journal_lock();
+        if (fetch.dir == FETCH_OLDER) {
+            read_older(&fetch);
+        } else {
+            read_newer(&fetch);
+        }
+        session_journal_unlock();
+        tracker_run_on_ui(apply_fetch, &fetch);
+    }
+}
+
+void history_screen_open(lv_obj_t *parent)
+{
+    if (history_box != NULL) return;
+
+    if (fetch_task == NULL
+        && xTaskCreate(fetch_task_fn, "history", HISTORY_TASK_STACK, NULL, HISTORY_TASK_PRIORITY, &fetch_task) != pdPASS) {
+        ESP_LOGE(TAG, "No memory for the history task");
+        fetch_task = NULL;
+    }
+
+    history_box = lv_obj_create(parent);
+    lv_obj_set_size(history_box, 320, 170);
+    lv_obj_align(history_box, LV_ALIGN_TOP_LEFT, 0, 0);
+    lv_obj_set_style_bg_color(history_box, lv_color_hex(0x000000), LV_PART_MAIN);
+    lv_obj_set_style_bg_opa(history_box, LV_OPA_COVER, LV_PART_MAIN);
+    lv_obj_set_style_border_width(history_box, 0, LV_PART_MAIN);
+    lv_obj_set_style_radius(history_box, 0, LV_PART_MAIN);
+    lv_obj_set_style_pad_all(history_box, 0, LV_PART_MAIN);
+    lv_obj_clear_flag(history_box, LV_OBJ_FLAG_SCROLLABLE);
+
+    for (int r = 0; r < HISTORY_ROWS; r++) {
+        rows[r] = lv_label_create(history_box);
+        lv_obj_set_size(rows[r], 312, HISTORY_ROW_HEIGHT);
+        lv_obj_set_pos(rows[r], 4, 1 + r * HISTORY_ROW_HEIGHT);
+        lv_obj_set_style_text_color(rows[r], lv_color_hex(0xFFFFFF), LV_PART_MAIN);
+        lv_obj_set_style_text_font(rows[r], &ui_font_14, LV_PART_MAIN);
+        lv_obj_set_style_pad_top(rows[r], 6, LV_PART_MAIN);
+        lv_label_set_long_mode(rows[r], LV_LABEL_LONG_CLIP);
+    }
+
+    gen++;
+    cache_count = 0;
+    top = 0;
+    at_oldest = false;
+    at_newest = true;
+    render();
+    prefetch();
+}
+
+void history_screen_close(void)
+{
+    if (history_box == NULL) return;
+
+    // A read still running is dropped when it arrives
+    lv_obj_del(history_box);
+    history_box = NULL;
+}
+
+bool history_screen_is_open(void)
+{
+    return history_box != NULL;
+}
+
+void history_screen_scroll(int count)
+{
+    if (history_box == NULL) return;
+
+    int oldest_top = cache_count < HISTORY_ROWS ? cache_count - 1 : HISTORY_ROWS - 1;
+    int want = top - count;
+    if (want < oldest_top) want = oldest_top;
+    if (want > cache_count - 1) want = cache_count - 1;
+    if (want != top && cache_count > 0) {
+        top = want;
+        render();
+    }
+    prefetch();
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdbool.h>
+#include "lvgl.h"
+
+// Past sessions, newest first, over the whole of `parent`. Only the rows on
+// screen and a screenful on either side are kept in memory, a background
+// task reads them from the archive and the journal ahead of the scrolling.
+void history_screen_open(lv_obj_t *parent);
+void history_screen_close(void);
+bool history_screen_is_open(void);
+
+// Move by `count` rows, positive goes back in time. Never waits for flash:
+// at the end of what is loaded so far the view stays until the task has
+// read more.
+void history_screen_scroll(int count);
@@ -0,0 +1,79 @@
+#include "sdkconfig.h"
+#include "lvgl.h"
+#include "src/draw/sw/lv_draw_sw.h"
+#include "lvgl_blend.h"
+
+// The kernels mix colors the way lv_color_mix() does in this configuration
+#if LV_COLOR_DEPTH != 16 || LV_COLOR_16_SWAP == 0 || LV_COLOR_MIX_ROUND_OFS != 128
+#error "draw565 needs 16-bit swapped colors with LV_COLOR_MIX_ROUND_OFS 128"
+#endif
+
+#if CONFIG_DRAW565_LVGL
+static const draw565_kernels_t *kernels = &draw565_vector;
+#else
+static const draw565_kernels_t *kernels;
+#endif
+
+static lvgl_blend_stats_t stats;
+
+// Same clipping and offsets as lv_draw_sw_blend_basic(), which handles
+// everything this does not
+static void blend(lv_draw_ctx_t *draw_ctx, const lv_draw_sw_blend_dsc_t *dsc)
+{
+    const draw565_kernels_t *k = kernels;
+    lv_disp_t *disp = _lv_refr_get_disp_refreshing();
+    if (k == NULL || dsc->src_buf != NULL || dsc->blend_mode != LV_BLEND_MODE_NORMAL
+        || disp->driver->set_px_cb != NULL || disp->driver->screen_transp) {
+        stats.stock++;
+        lv_draw_sw_blend_basic(draw_ctx, dsc);
+        return;
+    }
+
+    const lv_opa_t *mask = dsc->mask_buf;
+    if (mask != NULL && dsc->mask_res == LV_DRAW_MASK_RES_TRANSP) return;
+    if (dsc->mask_res == LV_DRAW_MASK_RES_FULL_COVER) mask = NULL;
+
+    lv_area_t area;
+    if (!_lv_area_intersect(&area, dsc->blend_area, draw_ctx->clip_area)) return;
+
+    const lv_area_t *buf_area = draw_ctx->buf_area;
+    int32_t stride = lv_area_get_width(buf_area);
+    uint16_t *dst = (uint16_t *)draw_ctx->buf + stride * (area.y1 - buf_area->y1) + (area.x1 - buf_area->x1);
+    int32_t w = lv_area_get_width(&area);
+    int32_t h = lv_area_get_height(&area);
+    // LVGL takes nearly opaque as opaque
+    uint8_t opa = dsc->opa >= LV_OPA_MAX ? LV_OPA_COVER : dsc->opa;
+
+    if (mask != NULL) {
+        int32_t mask_stride = lv_area_get_width(dsc->mask_area);
+        mask += mask_stride * (area.y1 - dsc->mask_area->y1) + (area.x1 - dsc->mask_area->x1);
+        k->fill_mask(dst, stride, w, h, dsc->color.full, opa, mask, mask_stride);
+    } else if (opa == LV_OPA_COVER) {
+        k->fill(dst, stride, w, h, dsc->color.full);
+    } else {
+        k->fill_opa(dst, stride, w, h, dsc->color.full, opa);
+    }
+    stats.fills++;
+    stats.pixels += w * h;
+}
+
+void lvgl_blend_ctx_init(lv_disp_drv_t *drv, lv_draw_ctx_t *draw_ctx)
+{
+    lv_draw_sw_init_ctx(drv, draw_ctx);
+    ((lv_draw_sw_ctx_t *)draw_ctx)->blend = blend;
+}
+
+void lvgl_blend_use(const draw565_kernels_t *k)
+{
+    kernels = k;
+}
+
+const draw565_kernels_t *lvgl_blend_kernels(void)
+{
+    return kernels;
+}
+
+void lvgl_blend_stats_get(lvgl_blend_stats_t *out)
+{
+    *out = stats;
+}
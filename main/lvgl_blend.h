@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdint.h>
+#include "lvgl.h"
+#include "draw565.h"
+
+// draw_ctx_init for the display driver: LVGL's software renderer, with the
+// plain color fills (backgrounds, rounded rects, antialiased edges through
+// their masks) done by the draw565 kernels. Image copies and the other blend
+// modes stay with LVGL.
+void lvgl_blend_ctx_init(lv_disp_drv_t *drv, lv_draw_ctx_t *draw_ctx);
+
+// Kernels used from the next fill on, NULL for LVGL's own loops. Every
+// backend gives the same pixels.
+void lvgl_blend_use(const draw565_kernels_t *kernels);
+const draw565_kernels_t *lvgl_blend_kernels(void);
+
+typedef struct {
+    uint32_t fills;         // done by the kernels
+    uint32_t stock;         // left to LVGL
+    uint64_t pixels;        // filled by the kernels
+} lvgl_blend_stats_t;
+
+void lvgl_blend_stats_get(lvgl_blend_stats_t *stats);
@@ -0,0 +1,68 @@
+#include <stddef.h>
+#include "esp_attr.h"
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "journal.h"
+#include "snapshot.h"
+#include "rtc_checkpoint.h"
+
+#define RTC_CHECKPOINT_MAGIC 0x31435454   // "TTC1"
+
+typedef struct {
+    uint32_t magic;
+    rtc_checkpoint_t cp;
+    uint32_t crc;       // journal_crc32 of magic and cp
+} rtc_slot_t;
+
+static RTC_NOINIT_ATTR rtc_slot_t rtc_slot;
+// The UI loop ticks it while the session store stops it
+static portMUX_TYPE slot_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static uint32_t slot_crc(const rtc_slot_t *slot)
+{
+    return journal_crc32(0, slot, offsetof(rtc_slot_t, crc));
+}
+
+bool rtc_checkpoint_load(rtc_checkpoint_t *cp)
+{
+    // After power on the memory holds whatever it powered up with
+    esp_reset_reason_t reason = esp_reset_reason();
+    if (reason == ESP_RST_POWERON || reason == ESP_RST_UNKNOWN) return false;
+    if (rtc_slot.magic != RTC_CHECKPOINT_MAGIC || rtc_slot.crc != slot_crc(&rtc_slot)) return false;
+
+    *cp = rtc_slot.cp;
+    return true;
+}
+
+static void set_locked(uint8_t activity, uint32_t start)
+{
+    rtc_slot.magic = RTC_CHECKPOINT_MAGIC;
+    rtc_slot.cp.activity = activity;
+    rtc_slot.cp.start = start;
+    if (rtc_slot.cp.now < start) rtc_slot.cp.now = start;
+    rtc_slot.crc = slot_crc(&rtc_slot);
+}
+
+void rtc_checkpoint_set(uint8_t activity, uint32_t start)
+{
+    portENTER_CRITICAL(&slot_lock);
+    set_locked(activity, start);
+    portEXIT_CRITICAL(&slot_lock);
+}
+
+void rtc_checkpoint_stop(uint8_t activity, uint32_t start)
+{
+    portENTER_CRITICAL(&slot_lock);
+    if (rtc_slot.cp.activity == activity && rtc_slot.cp.start == start) {
+        set_locked(SNAPSHOT_NOT_RUNNING, 0);
+    }
+    portEXIT_CRITICAL(&slot_lock);
+}
+
+void rtc_checkpoint_tick(uint32_t now)
+{
+    portENTER_CRITICAL(&slot_lock);
+    rtc_slot.cp.now = now;
+    rtc_slot.crc = slot_crc(&rtc_slot);
+    portEXIT_CRITICAL(&slot_lock);
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+// The running session mirrored in RTC memory, which keeps its contents
+// through a panic, watchdog or software reset but not through power loss.
+// Updating it costs no flash writes, so it can follow every state change.
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct {
+    uint8_t activity;       // SNAPSHOT_NOT_RUNNING if nothing is running
+    uint32_t start;         // start of the running session
+    uint32_t now;           // clock at the last update
+} rtc_checkpoint_t;
+
+// The checkpoint left by the previous run, false after power on or if it
+// does not pass its checksum
+bool rtc_checkpoint_load(rtc_checkpoint_t *cp);
+
+// A session started (or stopped, with SNAPSHOT_NOT_RUNNING)
+void rtc_checkpoint_set(uint8_t activity, uint32_t start);
+
+// Stopped, unless another session has started since this one
+void rtc_checkpoint_stop(uint8_t activity, uint32_t start);
+
+// Keep the clock in the checkpoint current, so it can be restored after a
+// reset that loses it
+void rtc_checkpoint_tick(uint32_t now);
@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "esp_log.h"
+#include "lvgl.h"
+#include "session_clock.h"
+
+#define TAG "clock"
+
+#define CELLS 8                 // HH:MM:SS
+#define COLON 10                // glyph index after the ten digits
+#define GLYPHS 11
+#define MAX_SECONDS (99 * 3600 + 59 * 60 + 59)
+
+static lv_obj_t *clock_obj;
+static lv_color_t *atlas;
+static lv_img_dsc_t glyphs[GLYPHS];
+static lv_coord_t cell_x[CELLS + 1];    // left edge of each cell, and the right end
+static uint8_t shown[CELLS];            // glyph in each cell
+static session_clock_stats_t stats;
+
+static uint8_t glyph_of(char c)
+{
+    return c == ':' ? COLON : c - '0';
+}
+
+// The glyph centered in a cell of `w` by the font's line height, mixed over
+// `bg` the way LVGL draws a letter
+static void rasterize(const lv_font_t *font, uint32_t letter, lv_coord_t w, lv_color_t fg, lv_color_t bg,
+                      lv_color_t *out)
+{
+    lv_coord_t h = lv_font_get_line_height(font);
+    for (int i = 0; i < w * h; i++) {
+        out[i] = bg;
+    }
+
+    lv_font_glyph_dsc_t g;
+    const uint8_t *bitmap;
+    if (!lv_font_get_glyph_dsc(font, &g, letter, 0) || (bitmap = lv_font_get_glyph_bitmap(font, letter)) == NULL) {
+        return;
+    }
+    // Packed rows, most significant bits first, as lv_draw_sw_letter reads them
+    uint32_t max = (1u << g.bpp) - 1;
+    lv_coord_t x0 = (w - g.adv_w) / 2 + g.ofs_x;
+    lv_coord_t y0 = font->line_height - font->base_line - g.box_h - g.ofs_y;
+    uint32_t bit = 0;
+    for (lv_coord_t y = 0; y < g.box_h; y++) {
+        for (lv_coord_t x = 0; x < g.box_w; x++, bit += g.bpp) {
+            uint32_t v = bitmap[bit / 8] >> (8 - g.bpp - bit % 8) & max;
+            lv_coord_t px = x0 + x, py = y0 + y;
+            if (v && px >= 0 && px < w && py >= 0 && py < h) {
+                out[py * w + px] = lv_color_mix(fg, bg, v * 255 / max);
+            }
+        }
+    }
+}
+
+static void draw_cb(lv_event_t *e)
+{
+    lv_draw_ctx_t *draw_ctx = lv_event_get_draw_ctx(e);
+    lv_area_t coords;
+    lv_obj_get_coords(clock_obj, &coords);
+
+    lv_draw_img_dsc_t dsc;
+    lv_draw_img_dsc_init(&dsc);
+    for (int i = 0; i < CELLS; i++) {
+        lv_area_t cell = { coords.x1 + cell_x[i], coords.y1, coords.x1 + cell_x[i + 1] - 1, coords.y2 };
+        if (_lv_area_is_on(&cell, draw_ctx->clip_area)) {
+            lv_draw_img(draw_ctx, &dsc, &cell, &glyphs[shown[i]]);
+        }
+    }
+}
+
+lv_obj_t *session_clock_create(lv_obj_t *parent, const lv_font_t *font, lv_color_t fg, lv_color_t bg)
+{
+    lv_coord_t h = lv_font_get_line_height(font);
+    lv_coord_t digit_w = 0;
+    for (char c = '0'; c <= '9'; c++) {
+        uint16_t w = lv_font_get_glyph_width(font, c, 0);
+        if (w > digit_w) digit_w = w;
+    }
+    lv_coord_t colon_w = lv_font_get_glyph_width(font, ':', 0);
+
+    atlas = malloc((10 * digit_w + colon_w) * h * sizeof(lv_color_t));
+    if (atlas == NULL) {
+        ESP_LOGE(TAG, "No memory for the clock glyphs");
+    }
+    lv_color_t *next = atlas;
+    for (int i = 0; i < GLYPHS; i++) {
+        lv_coord_t w = i == COLON ? colon_w : digit_w;
+        glyphs[i].header.cf = LV_IMG_CF_TRUE_COLOR;
+        glyphs[i].header.w = w;
+        glyphs[i].header.h = h;
+        glyphs[i].data_size = w * h * sizeof(lv_color_t);
+        if (atlas != NULL) {
+            rasterize(font, i == COLON ? ':' : '0' + i, w, fg, bg, next);
+            glyphs[i].data = (const uint8_t *)next;
+            next += w * h;
+        }
+    }
+
+    const char *layout = "00:00:00";
+    for (int i = 0; i < CELLS; i++) {
+        shown[i] = glyph_of(layout[i]);
+        cell_x[i + 1] = cell_x[i] + glyphs[shown[i]].header.w;
+    }
+
+    // No styles: nothing but the cells is drawn
+    clock_obj = lv_obj_create(parent);
+    lv_obj_remove_style_all(clock_obj);
+    lv_obj_set_size(clock_obj, cell_x[CELLS], h);
+    lv_obj_clear_flag(clock_obj, LV_OBJ_FLAG_CLICKABLE | LV_OBJ_FLAG_SCROLLABLE);
+    if (atlas != NULL) {
+        lv_obj_add_event_cb(clock_obj, draw_cb, LV_EVENT_DRAW_MAIN, NULL);
+    }
+    return clock_obj;
+}
+
+void session_clock_set(uint32_t seconds)
+{
+    if (clock_obj == NULL) return;
+
+    if (seconds > MAX_SECONDS) seconds = MAX_SECONDS;
+    char text[CELLS + 1];
+    snprintf(text, sizeof(text), "%02u:%02u:%02u", (unsigned)(seconds / 3600), (unsigned)(seconds / 60 % 60),
+             (unsigned)(seconds % 60));
+
+    lv_area_t coords;
+    lv_obj_get_coords(clock_obj, &coords);
+    stats.updates++;
+    for (int i = 0; i < CELLS; i++) {
+        uint8_t g = glyph_of(text[i]);
+        if (g == shown[i]) continue;
+        shown[i] = g;
+        lv_area_t cell = { coords.x1 + cell_x[i], coords.y1, coords.x1 + cell_x[i + 1] - 1, coords.y2 };
+        lv_obj_invalidate_area(clock_obj, &cell);
+        stats.cells++;
+    }
+}
+
+void session_clock_stats_get(session_clock_stats_t *out)
+{
+    *out = stats;
+}
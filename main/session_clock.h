@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdint.h>
+#include "lvgl.h"
+
+// HH:MM:SS of the running session in fixed-width cells. The digits and the
+// colon are rasterized once, antialiased over `bg`, into a small atlas when
+// the widget is created, and drawn as plain image copies. Setting the time
+// only invalidates the cells whose digit changed, usually one or two a
+// second, instead of laying out and redrawing a whole label.
+lv_obj_t *session_clock_create(lv_obj_t *parent, const lv_font_t *font, lv_color_t fg, lv_color_t bg);
+
+// Up to 99:59:59, longer sessions stay there
+void session_clock_set(uint32_t seconds);
+
+typedef struct {
+    uint32_t updates;
+    uint32_t cells;         // invalidated by the updates
+} session_clock_stats_t;
+
+void session_clock_stats_get(session_clock_stats_t *stats);
@@ -0,0 +1,263 @@
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "journal_partition.h"
+#include "rtc_checkpoint.h"
+#include "storage.h"
+#include "time_tracker.h"
+
+#define TAG "store"
+
+#define SESSION_PARTITION "sessions"
+#define META_PARTITION "meta"
+#define ARCHIVE_PARTITION "archive"
+
+#define STORE_TASK_STACK 4096
+// Below the UI loop, which only waits for it when the queue is full
+#define STORE_TASK_PRIORITY 1
+#define STORE_QUEUE_LEN 8
+
+typedef struct {
+    bool start;             // a session started, else `rec` ended
+    session_record_t rec;   // for a start, only activity and start are set
+} store_job_t;
+
+journal_t session_journal;
+journal_t session_archive;
+static SemaphoreHandle_t journal_mutex;
+static bool journal_ok;
+
+static journal_meta_t meta;
+static bool meta_ok;
+static snapshot_t snapshot;
+
+// The UI queues its starts and sessions for the store task, since appends and
+// snapshots wait for the flash, erases for several frames. Until a session is
+// in the journal its record stays in `pending`, and the rollups the UI reads
+// are those of the last finished job plus the pending records.
+static QueueHandle_t jobs;
+static rollup_t view_rollup;
+static journal_pos_t view_end;
+// Queued, running, and one the UI loop waits to queue
+static session_record_t pending[STORE_QUEUE_LEN + 2];
+static int pending_count;
+static portMUX_TYPE view_lock = portMUX_INITIALIZER_UNLOCKED;
+
+void session_journal_lock(void)
+{
+    xSemaphoreTake(journal_mutex, portMAX_DELAY);
+}
+
+void session_journal_unlock(void)
+{
+    xSemaphoreGive(journal_mutex);
+}
+
+// Never let the clock run behind `t`
+static void clock_floor(uint32_t t)
+{
+    if (time(NULL) < t) {
+        struct timeval tv = { .tv_sec = t };
+        settimeofday(&tv, NULL);
+    }
+}
+
+// The checkpoint in RTC memory follows every start and stop, so after a reset
+// it knows better than the snapshot whether a session was running, see
+// snapshot_reconcile()
+static void reconcile_checkpoint(void)
+{
+    rtc_checkpoint_t cp;
+    if (!rtc_checkpoint_load(&cp)) return;
+
+    // The clock survives most resets, the checkpoint covers the others
+    clock_floor(cp.now);
+    uint8_t activity = snapshot.running_activity;
+    uint32_t start = snapshot.running_start;
+    if (snapshot_reconcile(&snapshot, cp.activity, cp.start, session_journal.last_end)
+        && (cp.activity != activity || cp.start != start)) {
+        ESP_LOGI(TAG, "Running session from the RTC checkpoint: %d since %u", cp.activity, cp.start);
+    }
+}
+
+// Called with the lock held
+static void save_snapshot(void)
+{
+    if (!meta_ok) return;
+
+    esp_err_t err = snapshot_save(&snapshot, &meta, &session_journal);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to save snapshot: %s", esp_err_to_name(err));
+    }
+}
+
+// Called with the lock held, after each job
+static void publish_rollup(const session_record_t *done)
+{
+    portENTER_CRITICAL(&view_lock);
+    view_rollup = snapshot.rollup;
+    if (journal_ok) view_end = journal_end(&session_journal);
+    if (done != NULL && pending_count > 0) {
+        memmove(&pending[0], &pending[1], (pending_count - 1) * sizeof(pending[0]));
+        pending_count--;
+    }
+    portEXIT_CRITICAL(&view_lock);
+}
+
+static void run_start(const store_job_t *job)
+{
+    // The journal only learns about a session when it ends, so this is when
+    // the snapshot has something new to say
+    session_journal_lock();
+    snapshot.running_activity = job->rec.activity;
+    snapshot.running_start = job->rec.start;
+    rollup_advance(&snapshot.rollup, time(NULL));
+    save_snapshot();
+    publish_rollup(NULL);
+    session_journal_unlock();
+}
+
+static void run_record(const store_job_t *job)
+{
+    session_journal_lock();
+    esp_err_t err = journal_append(&session_journal, &job->rec);
+    if (err == ESP_OK) {
+        rollup_advance(&snapshot.rollup, time(NULL));
+        snapshot_add(&snapshot, &job->rec);
+    }
+    publish_rollup(&job->rec);
+    session_journal_unlock();
+    // Only now, a reset before this finds the session in the journal. A
+    // session started meanwhile keeps its checkpoint.
+    rtc_checkpoint_stop(job->rec.activity, job->rec.start);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to record session: %s", esp_err_to_name(err));
+    }
+}
+
+// Jobs run in the order they were queued, so every snapshot matches the
+// journal it was saved with
+static void store_task_fn(void *arg)
+{
+    for (;;) {
+        store_job_t job;
+        xQueueReceive(jobs, &job, portMAX_DELAY);
+        if (job.start) {
+            run_start(&job);
+        } else {
+            run_record(&job);
+        }
+    }
+}
+
+esp_err_t session_store_open(snapshot_t *state)
+{
+    journal_mutex = xSemaphoreCreateMutex();
+    assert(journal_mutex);
+    snapshot_init(&snapshot, time(NULL));
+    storage_start();
+
+    // Opening only reads, so the writes can be routed through the storage
+    // task afterwards
+    esp_err_t err = journal_open_partition(&session_journal, SESSION_PARTITION);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Session journal unavailable: %s", esp_err_to_name(err));
+        rtc_checkpoint_set(SNAPSHOT_NOT_RUNNING, 0);
+        publish_rollup(NULL);
+        *state = snapshot;
+        return err;
+    }
+    storage_route(&session_journal.flash);
+    journal_ok = true;
+
+    err = journal_open_partition(&session_archive, ARCHIVE_PARTITION);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Session archive unavailable: %s", esp_err_to_name(err));
+        session_archive.page_count = 0;
+    } else {
+        storage_route(&session_archive.flash);
+    }
+
+    journal_flash_t flash;
+    if (journal_flash_from_partition(META_PARTITION, &flash) == ESP_OK && storage_route(&flash) == ESP_OK
+        && journal_meta_open(&meta, &flash) == ESP_OK) {
+        meta_ok = true;
+    } else {
+        ESP_LOGW(TAG, "No meta partition, every boot reads the whole journal");
+    }
+
+    // The clock has no battery backup, so never let it start before the last
+    // recorded session. The console can set the real time.
+    clock_floor(session_journal.last_end);
+
+    int64_t t0 = esp_timer_get_time();
+    uint32_t replayed;
+    snapshot_restore(&snapshot, &meta, &session_journal, time(NULL), &replayed);
+    ESP_LOGI(TAG, "Restored in %u ms, %u sessions replayed", (uint32_t)(esp_timer_get_time() - t0) / 1000, replayed);
+
+    reconcile_checkpoint();
+    if (snapshot.running_activity != SNAPSHOT_NOT_RUNNING) {
+        clock_floor(snapshot.running_start);
+    }
+    rtc_checkpoint_set(snapshot.running_activity, snapshot.running_start);
+    publish_rollup(NULL);
+
+    jobs = xQueueCreate(STORE_QUEUE_LEN, sizeof(store_job_t));
+    assert(jobs);
+    xTaskCreate(store_task_fn, "store", STORE_TASK_STACK, NULL, STORE_TASK_PRIORITY, NULL);
+
+    *state = snapshot;
+    return ESP_OK;
+}
+
+void session_store_start(uint8_t activity, uint32_t start)
+{
+    rtc_checkpoint_set(activity, start);
+    if (!journal_ok) return;
+
+    store_job_t job = { .start = true, .rec = { .start = start, .activity = activity } };
+    xQueueSend(jobs, &job, portMAX_DELAY);
+}
+
+void session_store_record(const session_record_t *rec)
+{
+    if (!journal_ok) {
+        rtc_checkpoint_set(SNAPSHOT_NOT_RUNNING, 0);
+        return;
+    }
+
+    store_job_t job = { .start = false, .rec = *rec };
+    portENTER_CRITICAL(&view_lock);
+    pending[pending_count++] = *rec;
+    portEXIT_CRITICAL(&view_lock);
+    xQueueSend(jobs, &job, portMAX_DELAY);
+}
+
+void session_store_rollup(rollup_t *out)
+{
+    session_record_t recs[STORE_QUEUE_LEN + 2];
+    portENTER_CRITICAL(&view_lock);
+    *out = view_rollup;
+    int n = pending_count;
+    memcpy(recs, pending, n * sizeof(recs[0]));
+    portEXIT_CRITICAL(&view_lock);
+
+    rollup_advance(out, time(NULL));
+    for (int i = 0; i < n; i++) {
+        rollup_add(out, &recs[i]);
+    }
+}
+
+journal_pos_t session_store_journal_end(void)
+{
+    portENTER_CRITICAL(&view_lock);
+    journal_pos_t end = view_end;
+    portEXIT_CRITICAL(&view_lock);
+    return end;
+}
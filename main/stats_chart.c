@@ -0,0 +1,288 @@
+#include <string.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "lvgl.h"
+#include "time_tracker.h"
+#include "stats_chart.h"
+
+#define TAG "chart"
+
+#define CHART_WIDTH 320
+#define CHART_HEIGHT 170
+#define DAYS 7
+#define HOURS 24
+
+// Heatmap: a row per day, oldest first, under a line of hour ticks
+#define HEAT_X 24
+#define HEAT_Y 12
+#define CELL 12
+#define CELL_GAP 1
+#define HEAT_LEVELS 5
+
+// Bars: a row per activity under the heatmap
+#define BAR_Y (HEAT_Y + DAYS * CELL + 4)
+#define BAR_ROW 14
+#define BAR_X 72
+#define BAR_MAX_WIDTH 180
+#define BAR_HEIGHT 9
+#define BAR_TEXT_X (BAR_X + BAR_MAX_WIDTH + 6)
+
+#define HEAT_TASK_STACK 3072
+// Below the UI loop, the same as the history task
+#define HEAT_TASK_PRIORITY 1
+
+// Everything the canvas shows, at the resolution it shows it
+typedef struct {
+    uint8_t level[DAYS][HOURS];
+    uint8_t first_wday;                 // weekday of the top row
+    uint8_t bar[LABEL_COUNT];           // pixels
+    uint16_t minutes[LABEL_COUNT];
+} view_t;
+
+// Minutes per hour of the finished sessions, read from the journal by the
+// heat task only when a session was added or the day changed
+typedef struct {
+    journal_pos_t end;
+    uint32_t first_day;
+    uint8_t minutes[DAYS][HOURS];
+} heat_t;
+
+static const uint32_t heat_colors[HEAT_LEVELS] = { 0x202020, 0x0E4429, 0x006D32, 0x26A641, 0x39D353 };
+static const uint32_t activity_colors[ROLLUP_MAX_ACTIVITIES] = {
+    0x4E79A7, 0xF28E2B, 0x59A14F, 0xE15759, 0xB07AA1, 0x76B7B2, 0xEDC948, 0x9C755F,
+};
+static const char *const wday_names[7] = { "Su", "Mo", "Tu", "We", "Th", "Fr", "Sa" };
+
+static lv_obj_t *chart_canvas;
+static lv_color_t *chart_buf;
+static heat_t heat;
+static bool heat_valid;
+// The read the task is doing, untouched by the UI until it is handed over
+static heat_t heat_read;
+static bool heat_reading;
+static TaskHandle_t heat_task;
+static view_t shown;
+static bool shown_valid;
+static stats_chart_stats_t stats;
+
+// Add the part of [start, end) in the seven days to the minutes per hour
+static void add_span(uint8_t minutes[DAYS][HOURS], uint32_t first_day, uint32_t start, uint32_t end)
+{
+    uint32_t last = first_day + DAYS * 86400;
+    if (start < first_day) start = first_day;
+    if (end > last) end = last;
+    while (start < end) {
+        uint32_t hour = (start - first_day) / 3600;
+        uint32_t hour_end = first_day + (hour + 1) * 3600;
+        uint32_t part = (end < hour_end ? end : hour_end) - start;
+        uint32_t m = minutes[hour / HOURS][hour % HOURS] + part / 60;
+        minutes[hour / HOURS][hour % HOURS] = m > 60 ? 60 : m;
+        start += part;
+    }
+}
+
+// A week of sessions, at most a few hundred records under the lock
+static void read_heat(heat_t *h)
+{
+    memset(h->minutes, 0, sizeof(h->minutes));
+
+    journal_iter_t it;
+    session_record_t rec;
+    session_journal_lock();
+    h->end = journal_end(&session_journal);
+    // Sessions that started the day before can reach into the first day
+    journal_iter_init(&it, &session_journal, journal_seek_time(&session_journal, h->first_day - 86400));
+    while (journal_iter_next(&it, &rec, NULL)) {
+        add_span(h->minutes, h->first_day, rec.start, rec.start + rec.duration);
+    }
+    session_journal_unlock();
+}
+
+// Runs in the UI loop, see tracker_run_on_ui()
+static void apply_heat(void *arg)
+{
+    heat = heat_read;
+    heat_valid = true;
+    heat_reading = false;
+    stats_chart_refresh();
+}
+
+static void heat_task_fn(void *arg)
+{
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        read_heat(&heat_read);
+        tracker_run_on_ui(apply_heat, NULL);
+    }
+}
+
+static uint8_t heat_level(uint8_t minutes)
+{
+    return minutes == 0 ? 0 : minutes < 15 ? 1 : minutes < 30 ? 2 : minutes < 45 ? 3 : 4;
+}
+
+// False while the heat of these seven days is still being read
+static bool build_view(view_t *v)
+{
+    uint32_t now = time(NULL);
+    uint32_t first_day = now - now % 86400 - (DAYS - 1) * 86400;
+    bool fresh = heat_valid && heat.first_day == first_day;
+    if ((!fresh || heat.end != session_store_journal_end()) && !heat_reading && heat_task != NULL) {
+        heat_reading = true;
+        heat_read.first_day = first_day;
+        xTaskNotifyGive(heat_task);
+    }
+    // Sessions just added show once the read is back, another day's heat
+    // not at all
+    if (!fresh) return false;
+
+    uint8_t minutes[DAYS][HOURS];
+    memcpy(minutes, heat.minutes, sizeof(minutes));
+    session_record_t running;
+    if (tracker_running_session(&running)) {
+        add_span(minutes, first_day, running.start, running.start + running.duration);
+    }
+
+    memset(v, 0, sizeof(*v));
+    for (int d = 0; d < DAYS; d++) {
+        for (int h = 0; h < HOURS; h++) {
+            v->level[d][h] = heat_level(minutes[d][h]);
+        }
+    }
+    v->first_wday = (first_day / 86400 + 4) % 7;    // 1970-01-01 was a Thursday
+
+    rollup_t rollup;
+    tracker_rollup_get(&rollup);
+    uint32_t max = 1;
+    for (int a = 0; a < LABEL_COUNT && a < ROLLUP_MAX_ACTIVITIES; a++) {
+        if (rollup.seconds[ROLLUP_WEEK][a] > max) max = rollup.seconds[ROLLUP_WEEK][a];
+    }
+    for (int a = 0; a < LABEL_COUNT && a < ROLLUP_MAX_ACTIVITIES; a++) {
+        uint32_t s = rollup.seconds[ROLLUP_WEEK][a];
+        v->bar[a] = (uint64_t)s * BAR_MAX_WIDTH / max;
+        v->minutes[a] = s / 60;
+    }
+    return true;
+}
+
+// Plain stores into the buffer, no draw descriptors or masks
+static void fill(int x, int y, int w, int h, uint32_t color)
+{
+    lv_color_t c = lv_color_hex(color);
+    for (int row = y; row < y + h; row++) {
+        lv_color_t *p = chart_buf + row * CHART_WIDTH + x;
+        for (int i = 0; i < w; i++) {
+            p[i] = c;
+        }
+    }
+}
+
+static void text(int x, int y, const char *s, uint32_t color)
+{
+    lv_draw_label_dsc_t dsc;
+    lv_draw_label_dsc_init(&dsc);
+    dsc.font = &lv_font_unscii_8;
+    dsc.color = lv_color_hex(color);
+    lv_canvas_draw_text(chart_canvas, x, y, CHART_WIDTH - x, &dsc, s);
+}
+
+static uint32_t count_objects(lv_obj_t *obj)
+{
+    uint32_t n = 1;
+    uint32_t children = lv_obj_get_child_cnt(obj);
+    for (uint32_t i = 0; i < children; i++) {
+        n += count_objects(lv_obj_get_child(obj, i));
+    }
+    return n;
+}
+
+static void draw(const view_t *v)
+{
+    int64_t t0 = esp_timer_get_time();
+    fill(0, 0, CHART_WIDTH, CHART_HEIGHT, 0x000000);
+
+    for (int h = 0; h < HOURS; h += 6) {
+        char tick[4];
+        lv_snprintf(tick, sizeof(tick), "%d", h);
+        text(HEAT_X + h * CELL, 2, tick, 0x808080);
+    }
+    for (int d = 0; d < DAYS; d++) {
+        int y = HEAT_Y + d * CELL;
+        text(2, y + 2, wday_names[(v->first_wday + d) % 7], 0xFFFFFF);
+        for (int h = 0; h < HOURS; h++) {
+            fill(HEAT_X + h * CELL, y, CELL - CELL_GAP, CELL - CELL_GAP, heat_colors[v->level[d][h]]);
+        }
+    }
+
+    for (int a = 0; a < LABEL_COUNT && a < ROLLUP_MAX_ACTIVITIES; a++) {
+        int y = BAR_Y + a * BAR_ROW;
+        char total[12];
+        text(2, y + 1, labels[a].name, 0xFFFFFF);
+        fill(BAR_X, y, v->bar[a], BAR_HEIGHT, activity_colors[a]);
+        lv_snprintf(total, sizeof(total), "%u:%02u", v->minutes[a] / 60, v->minutes[a] % 60);
+        text(BAR_TEXT_X, y + 1, total, 0xFFFFFF);
+    }
+    lv_obj_invalidate(chart_canvas);
+
+    stats.last_us = esp_timer_get_time() - t0;
+    if (stats.last_us > stats.max_us) stats.max_us = stats.last_us;
+    stats.redraws++;
+    stats.objects = count_objects(lv_scr_act());
+    shown = *v;
+    shown_valid = true;
+}
+
+void stats_chart_refresh(void)
+{
+    if (chart_canvas == NULL) return;
+
+    view_t v;
+    if (!build_view(&v)) return;
+    if (shown_valid && memcmp(&v, &shown, sizeof(v)) == 0) {
+        stats.cached++;
+        return;
+    }
+    draw(&v);
+}
+
+void stats_chart_open(lv_obj_t *parent)
+{
+    if (chart_canvas != NULL) return;
+
+    if (heat_task == NULL
+        && xTaskCreate(heat_task_fn, "heat", HEAT_TASK_STACK, NULL, HEAT_TASK_PRIORITY, &heat_task) != pdPASS) {
+        ESP_LOGE(TAG, "No memory for the heat task");
+        heat_task = NULL;
+    }
+    if (chart_buf == NULL) {
+        chart_buf = heap_caps_malloc(CHART_WIDTH * CHART_HEIGHT * sizeof(lv_color_t), MALLOC_CAP_SPIRAM);
+        if (chart_buf == NULL) {
+            ESP_LOGE(TAG, "No PSRAM for the chart");
+            return;
+        }
+        // Blank until the first week is read
+        fill(0, 0, CHART_WIDTH, CHART_HEIGHT, 0x000000);
+    }
+    chart_canvas = lv_canvas_create(parent);
+    lv_canvas_set_buffer(chart_canvas, chart_buf, CHART_WIDTH, CHART_HEIGHT, LV_IMG_CF_TRUE_COLOR);
+    lv_obj_align(chart_canvas, LV_ALIGN_TOP_LEFT, 0, 0);
+    stats_chart_refresh();
+}
+
+void stats_chart_close(void)
+{
+    if (chart_canvas == NULL) return;
+
+    // The buffer stays, with what it showed
+    lv_obj_del(chart_canvas);
+    chart_canvas = NULL;
+}
+
+void stats_chart_stats_get(stats_chart_stats_t *out)
+{
+    *out = stats;
+}
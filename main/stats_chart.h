@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "lvgl.h"
+
+// Hour by day heatmap of the last seven days (UTC) and this week's time per
+// activity, drawn into a single canvas over the whole of `parent`. The
+// canvas buffer lives in PSRAM and outlasts the screen: it is only drawn
+// again when what it shows has changed, otherwise LVGL just copies it out.
+void stats_chart_open(lv_obj_t *parent);
+void stats_chart_close(void);
+
+// Draw again if the figures changed since the last time, call periodically
+void stats_chart_refresh(void);
+
+typedef struct {
+    uint32_t redraws;
+    uint32_t cached;        // opens and refreshes served from the buffer
+    uint32_t last_us;       // time to draw the canvas
+    uint32_t max_us;
+    uint32_t objects;       // LVGL objects on the screen at the last redraw
+} stats_chart_stats_t;
+
+void stats_chart_stats_get(stats_chart_stats_t *stats);
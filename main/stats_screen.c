@@ -0,0 +1,105 @@
+#include "lvgl.h"
+#include "time_tracker.h"
+#include "stats_screen.h"
+#include "stats_chart.h"
+#include "ui_fonts.h"
+
+// The figures come from the rollups, refreshing them costs a few table cells
+#define STATS_PERIOD_MS 5000
+#define STATS_NAME_WIDTH 104
+#define STATS_COL_WIDTH 72
+
+static lv_obj_t *stats_parent;
+static lv_obj_t *stats_table;
+static lv_timer_t *stats_timer;
+static bool chart_shown;
+
+static void set_duration(uint16_t row, uint16_t col, uint32_t seconds)
+{
+    lv_table_set_cell_value_fmt(stats_table, row, col, "%u:%02u", seconds / 3600, seconds / 60 % 60);
+}
+
+static void stats_update(lv_timer_t *timer)
+{
+    if (chart_shown) {
+        stats_chart_refresh();
+        return;
+    }
+
+    rollup_t rollup;
+    tracker_rollup_get(&rollup);
+
+    for (int i = 0; i < LABEL_COUNT && i < ROLLUP_MAX_ACTIVITIES; i++) {
+        for (int p = 0; p < ROLLUP_PERIOD_COUNT; p++) {
+            set_duration(i + 1, p + 1, rollup.seconds[p][i]);
+        }
+    }
+}
+
+void stats_screen_open(lv_obj_t *parent)
+{
+    if (stats_table != NULL) return;
+
+    stats_parent = parent;
+    chart_shown = false;
+    stats_table = lv_table_create(parent);
+    lv_obj_set_size(stats_table, 320, 170);
+    lv_obj_align(stats_table, LV_ALIGN_TOP_LEFT, 0, 0);
+    lv_obj_set_style_bg_color(stats_table, lv_color_hex(0x000000), LV_PART_MAIN);
+    lv_obj_set_style_bg_opa(stats_table, LV_OPA_COVER, LV_PART_MAIN);
+    lv_obj_set_style_border_width(stats_table, 0, LV_PART_MAIN);
+    lv_obj_set_style_bg_color(stats_table, lv_color_hex(0x000000), LV_PART_ITEMS);
+    lv_obj_set_style_text_color(stats_table, lv_color_hex(0xFFFFFF), LV_PART_ITEMS);
+    lv_obj_set_style_text_font(stats_table, &ui_font_14, LV_PART_ITEMS);
+    lv_obj_set_style_border_width(stats_table, 0, LV_PART_ITEMS);
+    lv_obj_set_style_pad_all(stats_table, 4, LV_PART_ITEMS);
+    lv_obj_clear_flag(stats_table, LV_OBJ_FLAG_SCROLLABLE);
+
+    lv_table_set_col_cnt(stats_table, 1 + ROLLUP_PERIOD_COUNT);
+    lv_table_set_row_cnt(stats_table, 1 + LABEL_COUNT);
+    lv_table_set_col_width(stats_table, 0, STATS_NAME_WIDTH);
+    lv_table_set_cell_value(stats_table, 0, 0, "");
+    lv_table_set_cell_value(stats_table, 0, 1, "Today");
+    lv_table_set_cell_value(stats_table, 0, 2, "Week");
+    lv_table_set_cell_value(stats_table, 0, 3, "Month");
+    for (int p = 0; p < ROLLUP_PERIOD_COUNT; p++) {
+        lv_table_set_col_width(stats_table, p + 1, STATS_COL_WIDTH);
+    }
+    for (int i = 0; i < LABEL_COUNT; i++) {
+        lv_table_set_cell_value(stats_table, i + 1, 0, labels[i].name);
+    }
+
+    stats_update(NULL);
+    stats_timer = lv_timer_create(stats_update, STATS_PERIOD_MS, NULL);
+}
+
+void stats_screen_close(void)
+{
+    if (stats_table == NULL) return;
+
+    lv_timer_del(stats_timer);
+    stats_chart_close();
+    lv_obj_del(stats_table);
+    stats_timer = NULL;
+    stats_table = NULL;
+}
+
+bool stats_screen_is_open(void)
+{
+    return stats_table != NULL;
+}
+
+void stats_screen_dial(int steps)
+{
+    if (stats_table == NULL || steps % 2 == 0) return;
+
+    chart_shown = !chart_shown;
+    if (chart_shown) {
+        lv_obj_add_flag(stats_table, LV_OBJ_FLAG_HIDDEN);
+        stats_chart_open(stats_parent);
+    } else {
+        stats_chart_close();
+        lv_obj_clear_flag(stats_table, LV_OBJ_FLAG_HIDDEN);
+        stats_update(NULL);
+    }
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stdbool.h>
+#include "lvgl.h"
+
+// Today, this week and this month per activity, over the whole of `parent`.
+// The dial switches to the charts of stats_chart.h and back.
+void stats_screen_open(lv_obj_t *parent);
+void stats_screen_close(void);
+bool stats_screen_is_open(void);
+void stats_screen_dial(int steps);
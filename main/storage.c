@@ -0,0 +1,216 @@
+#include <assert.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "storage.h"
+
+#define TAG "storage"
+
+#define STORAGE_TASK_STACK 3072
+// Above the UI loop and on its core, so a gap between frames is used as soon
+// as it opens, and the UI loop cannot start a frame between the check for a
+// gap and the end of the step
+#define STORAGE_TASK_PRIORITY 3
+#if CONFIG_ESP_MAIN_TASK_AFFINITY_NO_AFFINITY
+#error "the storage task needs the UI loop (the main task) pinned to a core"
+#endif
+#define STORAGE_TASK_CORE CONFIG_ESP_MAIN_TASK_AFFINITY
+#define SECTOR_SIZE 4096
+// A frame that never finishes must not hold the journal up for good
+#define MAX_DEFER_US 100000
+// Sessions, archive, meta and the scratch partition of bench
+#define MAX_ROUTES 4
+
+typedef struct {
+    journal_flash_t inner;
+} route_t;
+
+typedef struct {
+    route_t *route;
+    bool erase;
+    uint32_t offset;
+    const void *src;
+    size_t len;
+    esp_err_t result;
+} request_t;
+
+static TaskHandle_t storage_task;
+static QueueHandle_t requests;
+static SemaphoreHandle_t caller_lock;
+static SemaphoreHandle_t request_done;
+static route_t routes[MAX_ROUTES];
+
+static volatile bool frame_busy;
+static storage_stats_t stats;
+static uint32_t max_cache_off_since_take;
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+void storage_frame_start(void)
+{
+    frame_busy = true;
+}
+
+bool storage_frame_done_isr(void)
+{
+    frame_busy = false;
+    BaseType_t woken = pdFALSE;
+    if (storage_task) {
+        vTaskNotifyGiveFromISR(storage_task, &woken);
+    }
+    return woken == pdTRUE;
+}
+
+void storage_frame_skipped(void)
+{
+    frame_busy = false;
+    if (storage_task) {
+        xTaskNotifyGive(storage_task);
+    }
+}
+
+// Until LVGL is between frames
+static void wait_for_gap(void)
+{
+    if (!frame_busy) return;
+
+    int64_t t0 = esp_timer_get_time();
+    while (frame_busy && esp_timer_get_time() - t0 < MAX_DEFER_US) {
+        ulTaskNotifyTake(pdTRUE, 1);
+    }
+    uint32_t waited = esp_timer_get_time() - t0;
+    portENTER_CRITICAL(&stats_lock);
+    stats.deferred++;
+    if (waited > stats.max_wait_us) stats.max_wait_us = waited;
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+static void count_step(int64_t t0, bool erase)
+{
+    uint32_t us = esp_timer_get_time() - t0;
+    portENTER_CRITICAL(&stats_lock);
+    if (erase) {
+        stats.erase_steps++;
+    } else {
+        stats.writes++;
+    }
+    if (us > stats.max_cache_off_us) stats.max_cache_off_us = us;
+    if (us > max_cache_off_since_take) max_cache_off_since_take = us;
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+static void run(request_t *req)
+{
+    journal_flash_t *flash = &req->route->inner;
+    if (!req->erase) {
+        wait_for_gap();
+        int64_t t0 = esp_timer_get_time();
+        req->result = flash->write(flash->ctx, req->offset, req->src, req->len);
+        count_step(t0, false);
+        return;
+    }
+
+    req->result = ESP_OK;
+    for (uint32_t done = 0; done < req->len && req->result == ESP_OK; done += SECTOR_SIZE) {
+        wait_for_gap();
+        int64_t t0 = esp_timer_get_time();
+        req->result = flash->erase(flash->ctx, req->offset + done, SECTOR_SIZE);
+        count_step(t0, true);
+    }
+}
+
+static void storage_task_fn(void *arg)
+{
+    for (;;) {
+        request_t *req;
+        xQueueReceive(requests, &req, portMAX_DELAY);
+        run(req);
+        xSemaphoreGive(request_done);
+    }
+}
+
+static esp_err_t submit(request_t *req)
+{
+    xSemaphoreTake(caller_lock, portMAX_DELAY);
+    xQueueSend(requests, &req, portMAX_DELAY);
+    xSemaphoreTake(request_done, portMAX_DELAY);
+    xSemaphoreGive(caller_lock);
+    return req->result;
+}
+
+static esp_err_t routed_read(void *ctx, uint32_t offset, void *dst, size_t len)
+{
+    route_t *route = ctx;
+    return route->inner.read(route->inner.ctx, offset, dst, len);
+}
+
+static esp_err_t routed_write(void *ctx, uint32_t offset, const void *src, size_t len)
+{
+    request_t req = { .route = ctx, .offset = offset, .src = src, .len = len };
+    return submit(&req);
+}
+
+static esp_err_t routed_erase(void *ctx, uint32_t offset, size_t len)
+{
+    if (offset % SECTOR_SIZE || len % SECTOR_SIZE) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    request_t req = { .route = ctx, .erase = true, .offset = offset, .len = len };
+    return submit(&req);
+}
+
+void storage_start(void)
+{
+    requests = xQueueCreate(1, sizeof(request_t *));
+    caller_lock = xSemaphoreCreateMutex();
+    request_done = xSemaphoreCreateBinary();
+    assert(requests && caller_lock && request_done);
+    xTaskCreatePinnedToCore(storage_task_fn, "storage", STORAGE_TASK_STACK, NULL, STORAGE_TASK_PRIORITY,
+                            &storage_task, STORAGE_TASK_CORE);
+}
+
+esp_err_t storage_route(journal_flash_t *flash)
+{
+    if (storage_task == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (flash->write == routed_write) {
+        return ESP_OK;
+    }
+
+    route_t *route = NULL;
+    for (int i = 0; i < MAX_ROUTES && route == NULL; i++) {
+        if (routes[i].inner.write == NULL || routes[i].inner.ctx == flash->ctx) {
+            route = &routes[i];
+        }
+    }
+    if (route == NULL) {
+        ESP_LOGE(TAG, "No route left");
+        return ESP_ERR_NO_MEM;
+    }
+    route->inner = *flash;
+    flash->read = routed_read;
+    flash->write = routed_write;
+    flash->erase = routed_erase;
+    flash->ctx = route;
+    return ESP_OK;
+}
+
+void storage_stats_get(storage_stats_t *out)
+{
+    portENTER_CRITICAL(&stats_lock);
+    *out = stats;
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+uint32_t storage_max_cache_off_take(void)
+{
+    portENTER_CRITICAL(&stats_lock);
+    uint32_t us = max_cache_off_since_take;
+    max_cache_off_since_take = 0;
+    portEXIT_CRITICAL(&stats_lock);
+    return us;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+// Every flash write and erase of the journals and the meta partition runs on
+// one task, between frames. Flash operations turn the caches off, and with
+// code and rodata in PSRAM that stalls rendering and input polling on both
+// cores, so the task waits until LVGL is neither rendering nor flushing.
+// Erases go one 4 KB sector at a time, each in its own gap between frames.
+// Callers block until their operation is done, so the journal code does not
+// change; the UI loop leaves its writes to the session store's task.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "journal.h"
+
+typedef struct {
+    uint32_t writes;
+    uint32_t erase_steps;       // 4 KB sectors
+    uint32_t deferred;          // steps that waited for a frame to finish
+    uint32_t max_wait_us;       // longest such wait
+    uint32_t max_cache_off_us;  // longest single write or erase step, the caches are off about that long
+} storage_stats_t;
+
+void storage_start(void);
+
+// Send the writes and erases of `flash` through the storage task. Reads stay
+// in the caller's task. Routing the same partition again reuses its slot.
+esp_err_t storage_route(journal_flash_t *flash);
+
+// Display driver hooks: a frame starts rendering, and the panel has taken its
+// last area (from the ISR, returns whether a task was woken)
+void storage_frame_start(void);
+bool storage_frame_done_isr(void);
+
+// The frame ended without flushing its last area, so no flush-done interrupt
+// will follow
+void storage_frame_skipped(void);
+
+// Since boot
+void storage_stats_get(storage_stats_t *stats);
+
+// Longest cache-off step since the previous call
+uint32_t storage_max_cache_off_take(void);
@@ -6,6 +6,10 @@
 #include "esp_log.h"
 #include "esp_err.h"
 #include "esp_timer.h"
+#include "perf.h"
+#include "storage.h"
+#include "lvgl_blend.h"
+#include "lvgl_heap.h"
 
 #include "assert.h"
 
@@ -15,12 +19,22 @@
 #define LVGL_TICK_PERIOD_MS 2
 
 static bool lvgl_init_done = false;
+// The area being flushed is the last of its frame
+static volatile bool flushing_last_area;
+// The frame being rendered has handed its last area to the panel
+static bool last_area_flushed;
 
 bool notify_lvgl_flush_ready(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_io_event_data_t *edata, void *user_ctx)
 {
     if(!lvgl_init_done) return false;
     lv_disp_drv_t *disp_driver = (lv_disp_drv_t *)user_ctx;
+    perf_frame_flush_ready();
     lv_disp_flush_ready(disp_driver);
+    if (flushing_last_area) {
+        flushing_last_area = false;
+        // Flash writes may run until the next frame starts rendering
+        return storage_frame_done_isr();
+    }
     return false;
 }
 
@@ -31,10 +45,31 @@ static void lvgl_flush_cb(lv_disp_drv_t *drv, const lv_area_t *area, lv_color_t
     int offsetx2 = area->x2;
     int offsety1 = area->y1;
     int offsety2 = area->y2;
+    flushing_last_area = lv_disp_flush_is_last(drv);
+    if (flushing_last_area) last_area_flushed = true;
+    perf_frame_flush(flushing_last_area);
     // copy a buffer's content to a specific area of the display
     esp_lcd_panel_draw_bitmap(panel_handle, offsetx1, offsety1, offsetx2 + 1, offsety2 + 1, color_map);
 }
 
+static void lvgl_render_start_cb(lv_disp_drv_t *drv)
+{
+    perf_frame_render_start();
+    last_area_flushed = false;
+    storage_frame_start();
+    lvgl_heap_render_start();
+}
+
+static void lvgl_monitor_cb(lv_disp_drv_t *drv, uint32_t time, uint32_t px)
+{
+    lvgl_heap_render_end();
+    perf_frame_rendered();
+    if (!last_area_flushed) {
+        // Otherwise queued flash writes wait out the longest deferral
+        storage_frame_skipped();
+    }
+}
+
 /* Rotate display and touch, when rotated screen in LVGL. Called when driver parameters are updated. */
 static void lvgl_port_update_callback(lv_disp_drv_t *drv)
 {
@@ -94,7 +129,10 @@ lv_disp_t *tembed_lvgl_init(tembed_t tembed) {
     lvgl_disp_drv.ver_res = TEMBED_LCD_V_RES;
     lvgl_disp_drv.flush_cb = lvgl_flush_cb;
     lvgl_disp_drv.drv_update_cb = lvgl_port_update_callback;
+    lvgl_disp_drv.render_start_cb = lvgl_render_start_cb;
+    lvgl_disp_drv.monitor_cb = lvgl_monitor_cb;
     lvgl_disp_drv.draw_buf = &disp_buf;
+    lvgl_disp_drv.draw_ctx_init = lvgl_blend_ctx_init;
     lvgl_disp_drv.user_data = tembed->lcd;
 
     lv_disp_t *disp = lv_disp_drv_register(&lvgl_disp_drv);
@@ -2,18 +2,34 @@
 #include "sdkconfig.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "esp_chip_info.h"
 #include "esp_flash.h"
 #include "driver/gpio.h"
 #include "esp_err.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "math.h"
 #include "iot_button.h"
 #include "iot_knob.h"
 #include "tembed.h"
 #include "apa102.h"
 #include "tembed_lvgl.h"
+#include "perf.h"
+#include "diag_overlay.h"
+#include "stats_screen.h"
+#include "history_screen.h"
+#include "session_clock.h"
+#include "ui_fonts.h"
+#include "rtc_checkpoint.h"
+#include "compaction.h"
+#include "tracelog.h"
+#include "console.h"
+#include "time_tracker.h"
 #include <stdarg.h>
+#include <assert.h>
+#include <time.h>
 
 #define TAG "tembed"
 #define POWER_ON_GPIO 46
@@ -53,6 +69,35 @@ static lv_obj_t *right_panel;
 // Add this with the other forward declarations at the top
 static void button_long_press_cb(void *arg, void *data);
 
+// Dial and button callbacks run in the esp_timer task. They only stamp the
+// event and queue it; the UI changes happen in the LVGL loop.
+typedef enum {
+    INPUT_KNOB_LEFT,
+    INPUT_KNOB_RIGHT,
+    INPUT_BUTTON_PRESS,         // first press of a gesture, as it goes down
+    INPUT_BUTTON_CLICKS,        // presses of a finished multi-click
+    INPUT_BUTTON_LONG_PRESS,
+    INPUT_CALL,                 // tracker_run_on_ui()
+} input_type_t;
+
+typedef struct {
+    input_type_t type;
+    int64_t stamp_us;   // esp_timer_get_time() when the event was detected,
+                        // the first press for INPUT_BUTTON_CLICKS
+    int clicks;         // number of presses for INPUT_BUTTON_CLICKS
+    void (*fn)(void *arg);
+    void *arg;
+    SemaphoreHandle_t done;     // given when fn returned, one per call
+} input_event_t;
+
+#define INPUT_QUEUE_LEN 16
+static QueueHandle_t input_queue;
+
+// The UI loop runs above the console and the trace log drain task
+#define UI_TASK_PRIORITY 2
+
+static time_t session_start;
+
 void turn_off_device() {
     // Set the GPIO pin as output
     gpio_set_direction(POWER_ON_GPIO, GPIO_MODE_OUTPUT);
@@ -68,18 +113,6 @@ typedef enum {
     DIALOG_STOP_TASK
 } dialog_state_t;
 
-typedef struct {
-    char *name;                // Label name
-    uint32_t total_time_ms;    // Total time in milliseconds
-    uint32_t current_time_ms;  // Current session time in milliseconds
-    bool timer_running;        // Is the timer running?
-    lv_obj_t *lv_label;
-    uint32_t color;   
-} label_info_t;
-
-// Increase number of labels for more activities
-#define LABEL_COUNT 5
-
 // Initialize labels with more meaningful activity names
 label_info_t labels[LABEL_COUNT] = {
     {"Work", 0, 0, false, NULL, 0x444444},
@@ -94,6 +127,8 @@ dialog_state_t current_dialog = DIALOG_NONE;
 int running_label_index = -1;  // Track which label is currently running
 
 lv_obj_t *info_label;
+static lv_obj_t *session_clock;
+static int info_label_index = -2;      // task shown by info_label, -1 for none
 lv_obj_t *dialog_box;
 lv_obj_t *active_task_label;
 lv_disp_t *lvgl_disp;
@@ -143,13 +178,22 @@ void update_label_positions()
         lv_obj_set_size(labels[i].lv_label, 160, item_height); 
         
         // Update the label text to include total minutes spent
-        uint32_t total_mins = labels[i].total_time_ms / (60 * 1000);
+        uint32_t total_mins = (labels[i].total_time_ms + labels[i].current_time_ms) / (60 * 1000);
         lv_label_set_text_fmt(labels[i].lv_label, "%s [%dm]", labels[i].name, total_mins);
     }
 }
 
-static void knob_left_cb(void *arg, void *data)
+static void handle_knob_left()
 {
+    if (stats_screen_is_open()) {
+        stats_screen_dial(-1);
+        return;
+    }
+    if (history_screen_is_open()) {
+        history_screen_scroll(-1);
+        return;
+    }
+
     if (dialog_box != NULL) {
         // If dialog is active, change selection
         dialog_selected_button = 0; // Select "Yes"
@@ -159,13 +203,22 @@ static void knob_left_cb(void *arg, void *data)
     
     // Existing code for when no dialog is active
     selected_label_index = (selected_label_index - 1 + LABEL_COUNT) % LABEL_COUNT;
-    ESP_LOGI(TAG, "KNOB: KNOB_LEFT Selected Label Index is %d", selected_label_index);
+    TRACE_LOGI(TAG, "KNOB: KNOB_LEFT Selected Label Index is %d", selected_label_index);
     update_selected_label_visuals();
     update_label_positions();
 }
 
-static void knob_right_cb(void *arg, void *data)
+static void handle_knob_right()
 {
+    if (stats_screen_is_open()) {
+        stats_screen_dial(1);
+        return;
+    }
+    if (history_screen_is_open()) {
+        history_screen_scroll(1);
+        return;
+    }
+
     if (dialog_box != NULL) {
         // If dialog is active, change selection
         dialog_selected_button = 1; // Select "No"
@@ -175,7 +228,7 @@ static void knob_right_cb(void *arg, void *data)
     
     // Existing code for when no dialog is active
     selected_label_index = (selected_label_index + 1) % LABEL_COUNT;
-    ESP_LOGI(TAG, "KNOB: KNOB_RIGHT Selected Label Index is %d", selected_label_index);
+    TRACE_LOGI(TAG, "KNOB: KNOB_RIGHT Selected Label Index is %d", selected_label_index);
     update_selected_label_visuals();
     update_label_positions();
 }
@@ -271,12 +324,59 @@ void trigger_dialog_action() {
     }
 }
 
+// Append the session that just ended to the journal
+static void record_session(int index, const label_info_t *label)
+{
+    session_record_t rec = {
+        .start = session_start,
+        .duration = label->current_time_ms / 1000,
+        .activity = index,
+    };
+    session_store_record(&rec);
+}
+
+bool tracker_running_session(session_record_t *rec)
+{
+    int running = running_label_index;
+    if (running < 0) return false;
+
+    rec->start = session_start;
+    rec->duration = labels[running].current_time_ms / 1000;
+    rec->activity = running;
+    return true;
+}
+
+void tracker_rollup_get(rollup_t *rollup)
+{
+    session_store_rollup(rollup);
+
+    session_record_t rec;
+    if (tracker_running_session(&rec)) {
+        rollup_add(rollup, &rec);
+    }
+}
+
+// Show the running task on the left, gray instead of its color
+static void update_active_task_label()
+{
+    if (running_label_index >= 0) {
+        lv_label_set_text_fmt(active_task_label, "Active: %s", labels[running_label_index].name);
+        lv_obj_set_style_bg_color(active_task_label, lv_color_hex(0xAAAAAA), LV_PART_MAIN);
+        lv_obj_set_style_text_color(active_task_label, lv_color_hex(0x000000), LV_PART_MAIN);
+    } else {
+        lv_label_set_text(active_task_label, "No Active Task");
+        lv_obj_set_style_bg_color(active_task_label, lv_color_hex(0x333333), LV_PART_MAIN);
+        lv_obj_set_style_text_color(active_task_label, lv_color_hex(0xFFFFFF), LV_PART_MAIN);
+    }
+}
+
 // Process dialog "Yes" response
 static void dialog_yes_cb(lv_event_t *e) {
     if (current_dialog == DIALOG_START_TASK) {
         // Stop any currently running timer
         if (running_label_index >= 0) {
             label_info_t *prev_label = &labels[running_label_index];
+            record_session(running_label_index, prev_label);
             prev_label->timer_running = false;
             prev_label->total_time_ms += prev_label->current_time_ms;
             prev_label->current_time_ms = 0;
@@ -288,26 +388,23 @@ static void dialog_yes_cb(lv_event_t *e) {
         label->timer_running = true;
         label->current_time_ms = 0;
         running_label_index = selected_label_index;
+        session_start = time(NULL);
+        session_store_start(running_label_index, session_start);
         ESP_LOGI(TAG, "Started timer for label %s", label->name);
         
-        // Update the active task display (gray instead of color)
-        lv_label_set_text_fmt(active_task_label, "Active: %s", label->name);
-        lv_obj_set_style_bg_color(active_task_label, lv_color_hex(0xAAAAAA), LV_PART_MAIN);
-        lv_obj_set_style_text_color(active_task_label, lv_color_hex(0x000000), LV_PART_MAIN);
+        update_active_task_label();
     } 
     else if (current_dialog == DIALOG_STOP_TASK) {
         // Stop the current timer
         label_info_t *label = &labels[selected_label_index];
+        record_session(selected_label_index, label);
         label->timer_running = false;
         label->total_time_ms += label->current_time_ms;
         label->current_time_ms = 0;
         running_label_index = -1;
         ESP_LOGI(TAG, "Stopped timer for label %s", label->name);
         
-        // Update the active task display
-        lv_label_set_text(active_task_label, "No Active Task");
-        lv_obj_set_style_bg_color(active_task_label, lv_color_hex(0x333333), LV_PART_MAIN);
-        lv_obj_set_style_text_color(active_task_label, lv_color_hex(0xFFFFFF), LV_PART_MAIN);
+        update_active_task_label();
     }
     
     // Close the dialog - ensure this happens in all cases
@@ -333,9 +430,9 @@ static void dialog_no_cb(lv_event_t *e) {
     current_dialog = DIALOG_NONE;
 }
 
-static void button_press_down_cb(void *arg, void *data) {
-    ESP_LOGI(TAG, "Button Pressed Down!");
-    
+static void handle_button_press() {
+    TRACE_LOGI(TAG, "Button Pressed Down!");
+
     // If dialog is open, trigger the selected action
     if (dialog_box != NULL) {
         trigger_dialog_action();
@@ -358,6 +455,8 @@ static void button_press_down_cb(void *arg, void *data) {
 
 void timer_callback(lv_timer_t * timer)
 {
+    rtc_checkpoint_tick(time(NULL));
+
     for (int i = 0; i < LABEL_COUNT; i++) {
         if (labels[i].timer_running) {
             labels[i].current_time_ms += 100;  // Update every 100 ms
@@ -365,35 +464,36 @@ void timer_callback(lv_timer_t * timer)
             // Always update the time panel when any task is running
             update_time_panel();
             
-            // Update the minute count in the label text
-            uint32_t total_mins = labels[i].total_time_ms / (60 * 1000);
-            uint32_t current_mins = labels[i].current_time_ms / (60 * 1000);
-            lv_label_set_text_fmt(labels[i].lv_label, "%s [%dm]", 
-                                 labels[i].name, total_mins + current_mins);
+            // Update the minute count in the label text when it changes,
+            // a tick adds 100 ms so one in 600 crosses a minute
+            uint64_t ms = labels[i].total_time_ms + labels[i].current_time_ms;
+            if (ms % (60 * 1000) < 100) {
+                lv_label_set_text_fmt(labels[i].lv_label, "%s [%dm]", 
+                                     labels[i].name, (uint32_t)(ms / (60 * 1000)));
+            }
         }
     }
 }
 
 // Update the time panel to always show the active task
 void update_time_panel() {
-    // If no task is running, show a message
-    if (running_label_index < 0) {
-        lv_label_set_text(info_label, "No Active Session");
-        return;
+    // The name only changes with the running task, so only set it then:
+    // setting a label's text redraws all of it
+    if (running_label_index != info_label_index) {
+        info_label_index = running_label_index;
+        if (running_label_index < 0) {
+            lv_label_set_text(info_label, "No Active Session");
+            lv_obj_add_flag(session_clock, LV_OBJ_FLAG_HIDDEN);
+        } else {
+            lv_label_set_text(info_label, labels[running_label_index].name);
+            lv_obj_clear_flag(session_clock, LV_OBJ_FLAG_HIDDEN);
+        }
     }
-    
+
     // Always show the running task's time, regardless of selection
-    label_info_t *active_label = &labels[running_label_index];
-    uint32_t current_time_sec = active_label->current_time_ms / 1000;
-    
-    // Calculate hours, minutes, seconds for better readability
-    uint32_t current_hours = current_time_sec / 3600;
-    uint32_t current_mins = (current_time_sec % 3600) / 60;
-    uint32_t current_secs = current_time_sec % 60;
-    
-    lv_label_set_text_fmt(info_label, "%s\n%02d:%02d:%02d", 
-                         active_label->name,
-                         current_hours, current_mins, current_secs);
+    if (running_label_index >= 0) {
+        session_clock_set(labels[running_label_index].current_time_ms / 1000);
+    }
 }
 
 // Update the background refresh timer to explicitly set opacity
@@ -432,8 +532,40 @@ static void bg_refresh_timer_cb(lv_timer_t *timer) {
     lv_obj_set_style_bg_opa(active_task_label, LV_OPA_COVER, LV_PART_MAIN);
 }
 
+// Set by a press that closed a screen or answered a dialog, the rest of its
+// gesture then does nothing
+static bool gesture_used;
+
+// The first press acts as it goes down, as a single press always did
+static void handle_button_gesture_start() {
+    gesture_used = false;
+    // Any gesture closes the stats or history screen, and does nothing else
+    if (stats_screen_is_open() || history_screen_is_open()) {
+        stats_screen_close();
+        history_screen_close();
+        gesture_used = true;
+        return;
+    }
+    gesture_used = dialog_box != NULL;
+    handle_button_press();
+}
+
+// The button driver counts the presses of a multi-click and reports them
+// once no further press follows
+static void handle_button_clicks(int clicks) {
+    if (gesture_used) return;
+
+    if (clicks == 2) {
+        diag_overlay_toggle(main_container);
+    } else if (clicks == 3) {
+        stats_screen_open(main_container);
+    } else if (clicks == 4) {
+        history_screen_open(main_container);
+    }
+}
+
 // Add this with the other button callbacks
-static void button_long_press_cb(void *arg, void *data) {
+static void handle_button_long_press() {
     ESP_LOGI(TAG, "Button Long Press - Powering Off!");
     
     // Show a brief "Powering Off" message
@@ -458,6 +590,120 @@ static void button_long_press_cb(void *arg, void *data) {
     turn_off_device();
 }
 
+static void post_input(input_type_t type, int64_t stamp_us, int clicks)
+{
+    input_event_t ev = {
+        .type = type,
+        .stamp_us = stamp_us,
+        .clicks = clicks,
+    };
+    xQueueSend(input_queue, &ev, 0);
+}
+
+void tracker_run_on_ui(void (*fn)(void *arg), void *arg)
+{
+    // Several tasks call this at once (console, history fetch), each waits
+    // on its own semaphore so it cannot take another caller's completion
+    StaticSemaphore_t done_buf;
+    input_event_t ev = {
+        .type = INPUT_CALL,
+        .stamp_us = esp_timer_get_time(),
+        .fn = fn,
+        .arg = arg,
+        .done = xSemaphoreCreateBinaryStatic(&done_buf),
+    };
+    xQueueSend(input_queue, &ev, portMAX_DELAY);
+    xSemaphoreTake(ev.done, portMAX_DELAY);
+    vSemaphoreDelete(ev.done);
+}
+
+static void knob_left_cb(void *arg, void *data)
+{
+    post_input(INPUT_KNOB_LEFT, esp_timer_get_time(), 0);
+}
+
+static void knob_right_cb(void *arg, void *data)
+{
+    post_input(INPUT_KNOB_RIGHT, esp_timer_get_time(), 0);
+}
+
+// When the first press of the gesture went down. The button callbacks all
+// run in the esp_timer task.
+static int64_t gesture_start_us;
+
+static void button_press_down_cb(void *arg, void *data)
+{
+    if (iot_button_get_repeat((button_handle_t)arg) != 1) return;
+    gesture_start_us = esp_timer_get_time();
+    post_input(INPUT_BUTTON_PRESS, gesture_start_us, 0);
+}
+
+static void button_repeat_done_cb(void *arg, void *data)
+{
+    int clicks = iot_button_get_repeat((button_handle_t)arg);
+    if (clicks > 1) {
+        post_input(INPUT_BUTTON_CLICKS, gesture_start_us, clicks);
+    }
+}
+
+// The driver ends a multi-click without PRESS_REPEAT_DONE when its last
+// press was held for the short press time or longer
+static void button_press_up_cb(void *arg, void *data)
+{
+    button_handle_t btn = (button_handle_t)arg;
+    int clicks = iot_button_get_repeat(btn);
+    if (clicks > 1 && iot_button_get_ticks_time(btn) >= CONFIG_BUTTON_SHORT_PRESS_TIME_MS) {
+        post_input(INPUT_BUTTON_CLICKS, gesture_start_us, clicks);
+    }
+}
+
+static void button_long_press_cb(void *arg, void *data)
+{
+    post_input(INPUT_BUTTON_LONG_PRESS, esp_timer_get_time(), 0);
+}
+
+// Apply the queued input events, called from the LVGL loop
+static void process_input_events()
+{
+    input_event_t ev;
+    perf_input_queue_sample(uxQueueMessagesWaiting(input_queue));
+    while (xQueueReceive(input_queue, &ev, 0) == pdTRUE) {
+        perf_input_source_t src = PERF_INPUT_BUTTON;
+        uint16_t dirty_areas = lvgl_disp->inv_p;
+        switch (ev.type) {
+        case INPUT_KNOB_LEFT:
+            handle_knob_left();
+            src = PERF_INPUT_KNOB;
+            break;
+        case INPUT_KNOB_RIGHT:
+            handle_knob_right();
+            src = PERF_INPUT_KNOB;
+            break;
+        case INPUT_BUTTON_PRESS:
+            handle_button_gesture_start();
+            break;
+        case INPUT_BUTTON_CLICKS:
+            handle_button_clicks(ev.clicks);
+            break;
+        case INPUT_BUTTON_LONG_PRESS:
+            handle_button_long_press();
+            break;
+        case INPUT_CALL:
+            ev.fn(ev.arg);
+            xSemaphoreGive(ev.done);
+            continue;
+        }
+
+        // Only events whose handler invalidated part of the screen reach a
+        // frame, LVGL then adds a dirty area. The areas left by an earlier
+        // event or timer do not count, and neither does one inside an area
+        // already dirty, or a change that waits for the next layout update.
+        if (lvgl_disp->inv_p != dirty_areas) {
+            perf_input_handled(src, ev.stamp_us);
+        }
+    }
+}
+
 void lvgl_demo_ui(lv_disp_t *disp) {
     // Store display for later reference
     lvgl_disp = disp;
@@ -469,6 +715,8 @@ void lvgl_demo_ui(lv_disp_t *disp) {
     lv_obj_t *scr = lv_disp_get_scr_act(disp);
     lv_obj_set_style_bg_color(scr, lv_color_hex(0x000000), LV_PART_MAIN);
     lv_obj_set_style_bg_opa(scr, LV_OPA_COVER, LV_PART_MAIN);
+    // Everything on the screen inherits the subset font
+    lv_obj_set_style_text_font(scr, &ui_font_18, LV_PART_MAIN);
     
     // Create a single main container that covers the whole screen
     main_container = lv_obj_create(scr);
@@ -500,9 +748,7 @@ void lvgl_demo_ui(lv_disp_t *disp) {
     // Create active task label directly on left panel 
     active_task_label = lv_label_create(left_panel);
     lv_obj_set_size(active_task_label, 140, 40);
-    lv_label_set_text(active_task_label, "No Active Task");
-    lv_obj_set_style_text_color(active_task_label, lv_color_hex(0xFFFFFF), LV_PART_MAIN);
-    lv_obj_set_style_bg_color(active_task_label, lv_color_hex(0x333333), LV_PART_MAIN);
+    update_active_task_label();
     lv_obj_set_style_bg_opa(active_task_label, LV_OPA_COVER, LV_PART_MAIN);
     lv_obj_set_style_radius(active_task_label, 5, LV_PART_MAIN);
     lv_obj_align(active_task_label, LV_ALIGN_TOP_MID, 0, 15);
@@ -513,6 +759,11 @@ void lvgl_demo_ui(lv_disp_t *disp) {
     lv_label_set_text(info_label, "");
     lv_obj_set_style_text_color(info_label, lv_color_hex(0xFFFFFF), LV_PART_MAIN);
     lv_obj_align(info_label, LV_ALIGN_BOTTOM_MID, 0, -15);
+
+    // The running time, on the label's second line
+    const lv_font_t *info_font = lv_obj_get_style_text_font(info_label, LV_PART_MAIN);
+    session_clock = session_clock_create(left_panel, info_font, lv_color_hex(0xFFFFFF), lv_color_hex(0x000000));
+    lv_obj_align_to(session_clock, info_label, LV_ALIGN_TOP_LEFT, 0, lv_font_get_line_height(info_font));
     
     // Create task labels directly on right panel
     for (int i = 0; i < LABEL_COUNT; i++) {
@@ -548,15 +799,45 @@ void lvgl_demo_ui(lv_disp_t *disp) {
     timer = lv_timer_create(timer_callback, 100, NULL);
 }
 
+// Restore the time recorded so far and the session that was running
+static void load_sessions()
+{
+    snapshot_t state;
+    if (session_store_open(&state) != ESP_OK) return;
+    for (int i = 0; i < LABEL_COUNT; i++) {
+        // The totals keep sessions the ring has dropped, 32 bits of
+        // milliseconds would wrap after about 1193 hours
+        labels[i].total_time_ms += (uint64_t)state.totals_s[i] * 1000;
+    }
+
+    if (state.running_activity < LABEL_COUNT) {
+        label_info_t *label = &labels[state.running_activity];
+        label->timer_running = true;
+        label->current_time_ms = (time(NULL) - state.running_start) * 1000;
+        running_label_index = state.running_activity;
+        selected_label_index = running_label_index;
+        session_start = state.running_start;
+        ESP_LOGI(TAG, "Resumed timer for label %s", label->name);
+    }
+}
+
 void app_main(void)
 {
     ESP_LOGI(TAG,"Hello lcd!");
 
+    tracelog_init();
+    perf_init();
+    input_queue = xQueueCreate(INPUT_QUEUE_LEN, sizeof(input_event_t));
+    assert(input_queue);
+    load_sessions();
+
     // Initialize the T-Embed
     tembed_t tembed = tembed_init(notify_lvgl_flush_ready, &lvgl_disp_drv);
 
     // Register button and knob callbacks
     iot_button_register_cb(tembed->dial.btn, BUTTON_PRESS_DOWN, button_press_down_cb, NULL);
+    iot_button_register_cb(tembed->dial.btn, BUTTON_PRESS_UP, button_press_up_cb, NULL);
+    iot_button_register_cb(tembed->dial.btn, BUTTON_PRESS_REPEAT_DONE, button_repeat_done_cb, NULL);
     iot_button_register_cb(tembed->dial.btn, BUTTON_LONG_PRESS_START, button_long_press_cb, NULL);
     iot_knob_register_cb(tembed->dial.knob, KNOB_LEFT, knob_left_cb, NULL);
     iot_knob_register_cb(tembed->dial.knob, KNOB_RIGHT, knob_right_cb, NULL);
@@ -570,9 +851,15 @@ void app_main(void)
     ESP_LOGI(TAG, "Display LVGL");
     lvgl_demo_ui(lvgl_disp);
 
+    vTaskPrioritySet(NULL, UI_TASK_PRIORITY);
+    console_start(tembed);
+    compaction_start();
+
     while (1) {
         // LVGL timer handler
         vTaskDelay(pdMS_TO_TICKS(10));
+        perf_ui_loop_tick();
+        process_input_events();
         lv_timer_handler();
     }
 }
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "lvgl.h"
+#include "journal.h"
+#include "snapshot.h"
+
+typedef struct {
+    char *name;                // Label name
+    uint64_t total_time_ms;    // Total time in milliseconds, all sessions ever
+    uint32_t current_time_ms;  // Current session time in milliseconds
+    bool timer_running;        // Is the timer running?
+    lv_obj_t *lv_label;
+    uint32_t color;
+} label_info_t;
+
+// Increase number of labels for more activities
+#define LABEL_COUNT 5
+
+extern label_info_t labels[LABEL_COUNT];
+extern int running_label_index;
+extern lv_disp_t *lvgl_disp;
+
+// Finished sessions. Take the lock around every access from outside the UI
+// loop, and keep it only for a few records at a time.
+extern journal_t session_journal;
+// Older sessions merged per day, see compact.h. Same lock.
+extern journal_t session_archive;
+void session_journal_lock(void);
+void session_journal_unlock(void);
+
+// Open the journal and restore the totals, rollups and running session into
+// `state`
+esp_err_t session_store_open(snapshot_t *state);
+
+// Remember the running session, so it survives a restart. Queued for the
+// store's task, the caller does not wait for the flash.
+void session_store_start(uint8_t activity, uint32_t start);
+
+// Append a finished session and update the totals and rollups. Queued the
+// same way, in order with the starts.
+void session_store_record(const session_record_t *rec);
+
+// Rollups of the current day, week and month, without the running session.
+// Sessions still queued are counted. Never waits for the journal lock.
+void session_store_rollup(rollup_t *rollup);
+
+// Where the journal ended after the last finished job, the same as
+// journal_end() but without the journal lock
+journal_pos_t session_store_journal_end(void);
+
+// The same with the running session counted up to now
+void tracker_rollup_get(rollup_t *rollup);
+
+// The running session up to now, false if there is none. UI loop only.
+bool tracker_running_session(session_record_t *rec);
+
+// Run `fn` in the UI loop between two input events and wait until it returns.
+// For the console and the history and chart tasks, which must not touch LVGL
+// from their own tasks; any number of tasks may wait in it at once.
+void tracker_run_on_ui(void (*fn)(void *arg), void *arg);
@@ -0,0 +1,22 @@
+#include "lvgl.h"
+#include "ui_fonts.h"
+
+static ui_fonts_stats_t stats;
+
+bool ui_fonts_get_glyph_dsc(const lv_font_t *font, lv_font_glyph_dsc_t *dsc, uint32_t letter, uint32_t letter_next)
+{
+    if (lv_font_get_glyph_dsc_fmt_txt(font, dsc, letter, letter_next)) {
+        return true;
+    }
+    // Line breaks and the like are looked up too, they have no glyph anyway
+    if (letter >= ' ') {
+        stats.misses++;
+        stats.last_miss = letter;
+    }
+    return false;
+}
+
+void ui_fonts_stats_get(ui_fonts_stats_t *out)
+{
+    *out = stats;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "lvgl.h"
+
+// Montserrat 18 and 14 cut down to the glyphs of the UI's strings, the
+// activity names among them, and the digits. main/CMakeLists.txt generates
+// them at build time with host/tools/font_subset.py from the UI sources, so
+// a new string brings its glyphs along. Any other character is drawn from
+// unscii 8 rather than left out.
+extern const lv_font_t ui_font_18;
+extern const lv_font_t ui_font_14;
+
+// The characters both fonts were cut for, in code point order, UTF-8
+extern const char ui_fonts_chars[];
+
+// get_glyph_dsc of both fonts, counts the characters they lack
+bool ui_fonts_get_glyph_dsc(const lv_font_t *font, lv_font_glyph_dsc_t *dsc, uint32_t letter, uint32_t letter_next);
+
+typedef struct {
+    uint32_t misses;        // glyph lookups that went to the fallback
+    uint32_t last_miss;     // code point of the latest
+} ui_fonts_stats_t;
+
+void ui_fonts_stats_get(ui_fonts_stats_t *stats);